@@ -0,0 +1,80 @@
+/*
+Arena.cpp
+
+Arena class implementation, regions are sized here, where whole frame configuration is known.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "Arena.h"
+#include "../DigitalFrame/DigitalFrame.h"
+
+#define ARENA_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+// Image in deepest album: images directory, INDEX_MAX_DEPTH albums and file name, 8.3 names separated by '/'
+#define ARENA_PATH_SIZE ((INDEX_MAX_DEPTH + 2) * (INDEX_NAME_LEN + 1))
+
+// Texts formatted for display: caption or "Off in " status with time, time label, playlist name
+#define ARENA_TEXT_SIZE ARENA_MAX(OVERLAY_TEXT_LEN + 8, ARENA_MAX(TIME_TEXT_SIZE, PLAYLIST_NAME_LEN + 1))
+
+// Image is loaded into display in loop() and copied into cache between loops, so they share stream buffer
+struct Regions {
+    uint16_t stream[PORTION_BUFFER(ARENA_MAX(IMG_BUFFER, CACHE_CHUNK))];
+    char path[ARENA_PATH_SIZE];
+    char text[ARENA_TEXT_SIZE];
+    uint8_t buckets[(DIFF_RAND_IMG_N + 7) / 8];
+};
+
+static Regions regions;
+
+static_assert( (ARENA_PATH_SIZE <= 255) && (ARENA_TEXT_SIZE <= 255), "Sizes of path and text are stored in 8 bits");
+
+#ifdef __AVR__
+// Sizes of objects differ on PC, budget applies to firmware only
+static_assert(sizeof(Regions) + sizeof(DigitalFrame) + sizeof(SDStorage) + sizeof(Calibration) + sizeof(ILI9486) + sizeof(XPT2046_Touchscreen)
+    + RAM_RESERVED + RAM_STACK <= RAM_SIZE, "Arena and frame objects exceed RAM budget, decrease IMG_BUFFER, HISTORY_N or DIFF_RAND_IMG_N");
+#endif
+
+const uint8_t Arena::pathSize = ARENA_PATH_SIZE;
+const uint8_t Arena::textSize = ARENA_TEXT_SIZE;
+
+uint16_t *Arena::stream() {
+    return regions.stream;
+}
+
+char *Arena::path() {
+    return regions.path;
+}
+
+char *Arena::text() {
+    return regions.text;
+}
+
+uint8_t *Arena::buckets() {
+    return regions.buckets;
+}
+
+uint16_t Arena::size(Region region) {
+    switch (region) {
+        case STREAM: return sizeof(regions.stream);
+        case PATH: return sizeof(regions.path);
+        case TEXT: return sizeof(regions.text);
+        case BUCKETS: return sizeof(regions.buckets);
+        default: return 0;
+    }
+}
+
+uint16_t Arena::size() {
+    return sizeof(Regions);
+}
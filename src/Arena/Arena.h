@@ -0,0 +1,52 @@
+/*
+Arena.h
+
+Arena is single static block of RAM holding working buffers of frame as named regions.
+Buffers which are never used at the same time share region, region sizes are computed at compile time
+from buffer and feature configuration (see Arena.cpp), so loading buffers do not take stack
+and firmware build fails if regions and frame objects do not fit into RAM budget.
+This header does not depend on Arduino, so it is shared with tools running on PC.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// RAM budget checked when building firmware, frame objects are created once in setup()
+#define RAM_SIZE 2048 // SRAM of ATmega328P
+#define RAM_RESERVED 650 // Static data of Arduino core and libraries (512 B sd block cache) and heap headers, compare with tools/sizereport.sh
+#define RAM_STACK 320 // Deepest call chain, replay tool reports peak stack of PC build for comparison
+
+class Arena {
+public:
+    enum Region {
+        STREAM, // Pixels of portion loaded into display or copied into cache
+        PATH, // Path of file being opened
+        TEXT, // Text formatted for display, caption, time label or playlist name
+        BUCKETS, // Bit of every bucket of random mode, set if bucket was displayed recently
+        REGIONS_N
+    };
+
+    static uint16_t *stream(); // PORTION_BUFFER(IMG_BUFFER) words, at least PORTION_BUFFER(CACHE_CHUNK)
+    static char *path(); // pathSize characters
+    static char *text(); // textSize characters
+    static uint8_t *buckets(); // DIFF_RAND_IMG_N bits
+
+    static const uint8_t pathSize;
+    static const uint8_t textSize;
+    static uint16_t size(Region region); // Bytes of region
+    static uint16_t size(); // Bytes of whole arena
+};
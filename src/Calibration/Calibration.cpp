@@ -45,23 +45,39 @@ void Calibration::calibrate() {
 
 
     // Draw points one by one
+    SPIBus::acquire(SPIBus::PANEL);
     display->clear(ILI9486_BLACK);
+    SPIBus::release();
     for (uint8_t i = 0; i < 4; i++) {
 
+        SPIBus::acquire(SPIBus::PANEL);
         display->drawCircle(positions[i][0], positions[i][1], size, ILI9486_WHITE, true);
+        SPIBus::release();
         
         // Repeat measure
         uint16_t x = 0, y = 0;
         for (uint8_t j = 0; j < repeat; j++) {
             delay(touchDelay);
-            while (!touch->tirqTouched() || !touch->touched()) {} // Wait for touch
+            // Wait for touch, controller is read only after its interrupt
+            bool pressed = false;
+            while (!pressed) {
+                if (!touch->tirqTouched()) { continue; }
 
+                SPIBus::acquire(SPIBus::TOUCH);
+                pressed = touch->touched();
+                SPIBus::release();
+            }
+
+            SPIBus::acquire(SPIBus::TOUCH);
             TS_Point p = touch->getPoint();
+            SPIBus::release();
             x += p.x;
             y += p.y;
         }
 
+        SPIBus::acquire(SPIBus::PANEL);
         display->drawCircle(positions[i][0], positions[i][1], size, ILI9486_BLACK, true);
+        SPIBus::release();
 
         // Set point coordinates as average
         points[i].x = x / repeat;
@@ -95,7 +111,9 @@ void Calibration::calibrate() {
         Serial.println(yEnd);
     }
 
+    SPIBus::acquire(SPIBus::PANEL);
     display->clear();
+    SPIBus::release();
 }
 
 void Calibration::calibrate(uint16_t xBegin, uint16_t xEnd, uint16_t yBegin, uint16_t yEnd) {
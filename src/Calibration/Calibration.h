@@ -21,6 +21,8 @@ along with this program.  If not, see https://www.gnu.org/licenses/.
 #include <ILI9486.h>
 #include <XPT2046_Touchscreen.h>
 
+#include "../SPIBus/SPIBus.h"
+
 class Calibration {
 public:
     Calibration(bool swapxy, ILI9486 *display, XPT2046_Touchscreen *touch);
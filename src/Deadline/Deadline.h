@@ -0,0 +1,52 @@
+/*
+Deadline.h
+
+Timer of event scheduled ahead (turn off of the frame), checked from frame loop.
+This header does not depend on Arduino, so it is shared with tools running on PC.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Time when deadline was set is kept instead of time when it passes (which can be past millis() overflow),
+// comparisons use time differences, so millis() overflow does not matter, duration must be shorter than 49 days
+class Deadline {
+public:
+    Deadline(): start(0), duration(0), scheduled(false) {}
+
+    // Pass duration [ms] after now
+    void set(uint32_t now, uint32_t duration) {
+        this->start = now;
+        this->duration = duration;
+        this->scheduled = true;
+    }
+
+    void cancel() { this->scheduled = false; }
+    bool isSet() const { return this->scheduled; }
+    bool passed(uint32_t now) const { return (this->scheduled) && (now - this->start >= this->duration); }
+
+    // Time until deadline passes [ms], 0 if it passed or is not set
+    uint32_t left(uint32_t now) const {
+        uint32_t elapsed = now - this->start;
+        return ( (this->scheduled) && (elapsed < this->duration) ) ? this->duration - elapsed : 0;
+    }
+
+private:
+    uint32_t start; // Time when deadline was set
+    uint32_t duration; // [ms]
+    bool scheduled;
+};
@@ -19,6 +19,70 @@ along with this program.  If not, see https://www.gnu.org/licenses/.
 
 #include "DigitalFrame.h"
 
+// Touch zones of screens, coordinates match ui images
+static const TouchZone imageZones[] PROGMEM = {
+	{{0, 0, 63, 479}, DigitalFrame::ZONE_PREV_IMAGE},
+	{{256, 0, 319, 479}, DigitalFrame::ZONE_NEXT_IMAGE}
+};
+
+static const TouchZone menuZones[] PROGMEM = {
+	{{0, 385, 319, 479}, DigitalFrame::ZONE_BRIGHTNESS},
+	{{0, 289, 319, 384}, DigitalFrame::ZONE_DISP_TIME},
+	{{0, 193, 319, 288}, DigitalFrame::ZONE_DISP_MODE},
+	{{0, 97, 319, 192}, DigitalFrame::ZONE_TURN_OFF},
+	{{0, 0, 159, 96}, DigitalFrame::ZONE_GALLERY},
+	{{160, 0, 319, 96}, DigitalFrame::ZONE_BACK}
+};
+
+static const TouchZone levelZones[] PROGMEM = {
+	{{0, 361, 319, 479}, DigitalFrame::ZONE_UP},
+	{{0, 241, 319, 360}, DigitalFrame::ZONE_VALUE},
+	{{0, 121, 319, 240}, DigitalFrame::ZONE_DOWN},
+	{{0, 0, 319, 120}, DigitalFrame::ZONE_BACK}
+};
+
+static const TouchZone dispModeZones[] PROGMEM = {
+	{{0, 400, 319, 479}, DigitalFrame::ZONE_RANDOM},
+	{{0, 320, 319, 399}, DigitalFrame::ZONE_IN_ORDER},
+	{{0, 240, 319, 319}, DigitalFrame::ZONE_ONLY_CURRENT},
+	{{0, 160, 319, 239}, DigitalFrame::ZONE_WEIGHTED},
+	{{0, 80, 319, 159}, DigitalFrame::ZONE_LEAST_RECENT},
+	{{0, 0, 159, 79}, DigitalFrame::ZONE_PLAYLIST},
+	{{160, 0, 319, 79}, DigitalFrame::ZONE_BACK}
+};
+
+static const TouchZone turnOffZones[] PROGMEM = {
+	{{0, 361, 319, 479}, DigitalFrame::ZONE_UP},
+	{{0, 241, 319, 360}, DigitalFrame::ZONE_VALUE},
+	{{0, 121, 319, 240}, DigitalFrame::ZONE_DOWN},
+	{{0, 0, 159, 120}, DigitalFrame::ZONE_BACK},
+	{{160, 0, 319, 120}, DigitalFrame::ZONE_CONFIRM}
+};
+
+static const TouchZone playlistZones[] PROGMEM = {
+	{{0, 361, 319, 479}, DigitalFrame::ZONE_UP},
+	{{0, 121, 319, 240}, DigitalFrame::ZONE_DOWN},
+	{{0, 0, 159, 120}, DigitalFrame::ZONE_BACK},
+	{{160, 0, 319, 120}, DigitalFrame::ZONE_CONFIRM}
+};
+
+static const TouchZone galleryZones[] PROGMEM = {
+	{{0, 352, 106, 479}, DigitalFrame::ZONE_THUMB + 0},
+	{{107, 352, 212, 479}, DigitalFrame::ZONE_THUMB + 1},
+	{{213, 352, 319, 479}, DigitalFrame::ZONE_THUMB + 2},
+	{{0, 224, 106, 351}, DigitalFrame::ZONE_THUMB + 3},
+	{{107, 224, 212, 351}, DigitalFrame::ZONE_THUMB + 4},
+	{{213, 224, 319, 351}, DigitalFrame::ZONE_THUMB + 5},
+	{{0, 96, 106, 223}, DigitalFrame::ZONE_THUMB + 6},
+	{{107, 96, 212, 223}, DigitalFrame::ZONE_THUMB + 7},
+	{{213, 96, 319, 223}, DigitalFrame::ZONE_THUMB + 8},
+	{{0, 0, 106, 95}, DigitalFrame::ZONE_PREV_PAGE},
+	{{107, 0, 212, 95}, DigitalFrame::ZONE_BACK},
+	{{213, 0, 319, 95}, DigitalFrame::ZONE_NEXT_PAGE}
+};
+
+#define ZONES_N(zones) (sizeof(zones) / sizeof(TouchZone))
+
 DigitalFrame::DigitalFrame(ILI9486 *display, XPT2046_Touchscreen *touch, Calibration *calibration, SDStorage *storage, bool dispIntro):
 	display(display),
 	touch(touch),
@@ -27,17 +91,43 @@ DigitalFrame::DigitalFrame(ILI9486 *display, XPT2046_Touchscreen *touch, Calibra
 	state(IMAGE_DISPLAY),
 	dispMode(RANDOM),
 	randDisplayedN(0),
+	lastCardCheck(0),
 	lastImageDisTime(0),
 	lastTouchTime(0),
-	turnOffTime(0),
+	lastFrameTime(0),
+	frameInterval(0),
 	brightnessLvl(BRIGHTNESS_LEVELS_N - 1),
 	dispTimeLvl(DEFAULT_DISP_TIME_LEVEL),
 	turnOffTimeLvl(0),
-	turnOffScheduled(false),
 	forceImageDisplay(true),
-	imageRandDisplayed({})
+	imageChosen(false),
+	introShown(false),
+	hiding(false),
+	revealing(false),
+	switchStart(0),
+	chosenImage(0),
+	galleryPage(0),
+	historyPos(0),
+	historyOlder(-1),
+	historyNewer(0),
+	historyBack(false),
+	playlist(0),
+	playlistChoice(0),
+	playlistLen(0),
+	playlistPos(0),
+	brightnessBar(50, 270, 330, BRIGHTNESS_LEVELS_N - 1),
+	modeRadio(305, 440, -80, 10, DISP_MODES_N),
+	timeLabel({10, 270, 309, 330}, 30, 300),
+	playlistLabel({10, 270, 309, 330}, 20, 300),
+	loader(storage, PanelSink<ILI9486>(display), Arena::stream())
 {
-	// Check if sd card initialized correctly
+	// Pin A0 is unconnected
+	// Electric noise will cause to generate different seed values
+	uint16_t seed = analogRead(A0);
+	TRACE(SEED, seed);
+	randomSeed(seed);
+
+	// Check if sd card initialized correctly, loop() tries to mount it again
 	if (storage->error()) { 
 		this->changeState(SD_ERROR);
 		return;
@@ -45,49 +135,74 @@ DigitalFrame::DigitalFrame(ILI9486 *display, XPT2046_Touchscreen *touch, Calibra
 	
 	this->loadSettings();
 
-	// Pin A0 is unconnected
-	// Electric noise will cause to generate different seed values
-	randomSeed(analogRead(A0));
-
 	if (dispIntro) { 
 		storage->toImage(INTRO_BMP);
 		this->loadImage();
 	}
 
 	display->changeDefaultBacklight(brightnessLvls[brightnessLvl]);
-	display->setDefaultBacklight();
+	this->setBacklight(display->getDefaultBacklight());
 
-	if (dispIntro) {
-		// Wait to the end of intro display time
-		delay(INTRO_DISPLAY_TIME);
-	}
+	// Intro is replaced by first image in loop(), touch is handled in the meantime
+	this->introShown = dispIntro;
+	this->lastImageDisTime = millis();
 }
 
 void DigitalFrame::loop() {
+	this->stepFade();
+
 	// Check if touch occurred
 	if (this->touched()) {
 		this->handleTouch();
 	}
 
+	// Card removal is detected between images, loading of image stops on touch only
+	if ( (this->state != SD_ERROR) && (this->state != SLEEP) && (millis() - this->lastCardCheck >= CARD_CHECK_INTERVAL) ) {
+		this->lastCardCheck = millis();
+		if (!storage->cardPresent()) { this->changeState(SD_ERROR); }
+	}
+
 	// Check of sd errors
 	if ( (storage->error()) && (this->state != SD_ERROR) ) {
 		this->changeState(SD_ERROR);
 	}
 
+	if (this->state == SD_ERROR) {
+		this->retryStorage();
+		return;
+	}
+
 	// Check for turn off time if scheduled
-	if ( (!this->forceImageDisplay) && (this->turnOffScheduled) && (millis() >= this->turnOffTime) ) {
+	if ( (!this->forceImageDisplay) && (this->turnOff.passed(millis())) ) {
 		this->changeState(SLEEP);
 	}
 
-	if (this->state == SLEEP) {
+	if ( (this->state == SLEEP) && (!this->backlight.active()) ) {
 		delay(50);
 	}
 
+	// Displayed image is copied into cache in short steps, so touch is still handled
+	if ( (this->state == IMAGE_DISPLAY) || (this->state == SLEEP) ) {
+		storage->cacheStep();
+		if (ENERGY_DUE()) { this->reportEnergy(); }
+	}
+
 	// Only check touch if not loading new images
 	if (this->state != IMAGE_DISPLAY) { 
 		return; 
 	}
 
+	// First image replaces intro after its display time
+	if ( (this->introShown) && (millis() - this->lastImageDisTime < INTRO_DISPLAY_TIME) ) {
+		return;
+	}
+	this->introShown = false;
+
+	// Animated image is played until display time passes
+	if ( (this->frameInterval) && (millis() - this->lastFrameTime >= this->frameInterval) ) {
+		this->playFrame();
+	}
+
 	// Display new image only if display time for old image passed
 	if ( (!this->forceImageDisplay) && (millis() - this->lastImageDisTime < dispTimeLvls[this->dispTimeLvl]) ) {
 		return;   
@@ -98,103 +213,342 @@ void DigitalFrame::loop() {
 		return;
 	}
 
+	// Next image is loaded after current one went dark
+	if ( (HIDDEN_LOADING) && (this->backlight.getLevel() > 0) ) {
+		if (!this->hiding) {
+			this->hiding = true;
+			this->switchStart = millis();
+			this->backlight.to(0, HIDE_STEP_TIME, millis());
+		}
+		return;
+	}
+
+	// Switch of image already dark starts now
+	if (!this->hiding) { this->switchStart = millis(); }
+
+	this->hiding = false;
 	this->forceImageDisplay = false;
 	this->moveToNextImg();
 }
 
 void DigitalFrame::moveToNextImg() {
-	// Choose new image based on current state
-	switch(this->dispMode) {
-		case IN_ORDER:
-			storage->nextImage();
-			break;
-
-		case RANDOM: {
-			// Pick random image from those not displayed recently
-			uint16_t imageN = random(storage->imagesInDir() - this->randDisplayedN);
-			// Find image not displayed recently
-			uint16_t notDisp = imageN;
-			uint16_t index = 0;
-			for (uint16_t i = 0; i < imageN + 1; i++) {
-				if (this->imageRandDisplayed[index % DIFF_RAND_IMG_N]) { 
-					notDisp++;
-					i--;
-				}
+	this->frameInterval = 0;
 
-				index++;
-			}
+	// Image chosen in gallery is displayed even when going forward in history
+	if ( (this->imageChosen) || (!this->moveInHistory()) ) {
+		this->selectNextImage();
+		this->rememberImage();
+	}
+
+	// Image shown while least recent order is chosen counts for it, also from history or gallery
+	if (this->dispMode == LEAST_RECENT) {
+		storage->markShown(storage->getImageNumber());
+	}
+	TRACE(IMAGE, storage->getImageNumber());
+
+	this->prepareOverlay();
+			
+	uint32_t start = millis();
+	bool hidden = (HIDDEN_LOADING) && (this->backlight.getLevel() == 0);
+
+	// Coarse passes are not worth their extra pixels when nobody sees them
+	auto interrupt = [this]() { return this->touchInterrupt(); };
+	bool progressive = storage->isInterlaced() || (PROGRESSIVE_LOADING && !hidden && storage->canSeekRows());
+	bool loaded = progressive ? loader.loadProgressive(interrupt, !hidden) : loader.loadSequential(interrupt);
+
+	// Complete image appears at once, also screen shown after interrupting touch
+	if (hidden) {
+		this->revealing = loaded;
+		this->backlight.to(display->getDefaultBacklight(), REVEAL_STEP_TIME, millis());
+	} else if (loaded) {
+		PROFILE_ADD(SWITCH_MS, millis() - this->switchStart);
+	}
+
+	//  If image fully loaded
+	if ( (loaded) && (this->state == IMAGE_DISPLAY) ) {
+		this->lastImageDisTime = millis();
+		PROFILE_ADD(FULL_MS, millis() - start);
+
+		if (storage->isAnimated()) {
+			this->frameInterval = storage->startAnimation();
+			this->lastFrameTime = millis();
+		}
+	}
+
+	// Load times of cached and converted BMP24 images are reported separately
+	PROFILE_REPORT(storage->isCached() ? "cached image" : "image");
+}
 
-			// Mark image as recently displayed
-			this->imageRandDisplayed[notDisp % DIFF_RAND_IMG_N] = true;
-			this->randDisplayedN++;
+void DigitalFrame::selectNextImage() {
+	// Image chosen in gallery is displayed once, then display mode continues
+	if (this->imageChosen) {
+		this->imageChosen = false;
+		storage->toImage(this->chosenImage);
+	} else if (this->playlistLen > 0) {
+		this->selectPlaylistImage();
+	} else {
+		switch(this->dispMode) {
+			case IN_ORDER:
+				storage->nextImage();
+				break;
+
+			case RANDOM:
+				storage->toImage(this->pickRandom(storage->imagesInDir()));
+				break;
+
+			case WEIGHTED: {
+				// Without weights file for current images all are equally likely
+				int32_t image = storage->pickWeighted(random(storage->imagesInDir()), random(0x10000));
+				storage->toImage( (image >= 0) ? (uint32_t)image : this->pickRandom(storage->imagesInDir()) );
+				break;
+			}
 
-			// If all recently displayed, reset 
-			if (this->randDisplayedN >= min(this->storage->imagesInDir(), DIFF_RAND_IMG_N) ) {
-				this->randDisplayedN = 0;
-				for (uint32_t i = 0; i < DIFF_RAND_IMG_N; i++) { this->imageRandDisplayed[i] = false; }
+			case LEAST_RECENT: {
+				int32_t image = storage->pickLeastRecent();
+				storage->toImage( (image >= 0) ? (uint32_t)image : this->pickRandom(storage->imagesInDir()) );
+				break;
 			}
 
-			storage->toImage(notDisp);
-			break;
+			case ONLY_CURRENT:
+				storage->toImage( storage->getImageNumber() );
+				break;
 		}
- 
+	}
+}
+
+void DigitalFrame::selectPlaylistImage() {
+	switch (this->dispMode) {
+		case IN_ORDER:
+			this->playlistPos = (this->playlistPos + 1) % this->playlistLen;
+			break;
+
 		case ONLY_CURRENT:
 			storage->toImage( storage->getImageNumber() );
+			return;
+
+		default:
+			// Random orders shuffle playlist, weights and order files cover all images
+			this->playlistPos = this->pickRandom(this->playlistLen);
 			break;
 	}
-			
-	display->openWindow(0, 0, display->getWidth(), display->getHeight());
-
-	// Load image by portions and check for touch in the meantime
-	for (uint32_t i = 0; i < display->getSize() / IMG_BUFFER; i++) {
-		this->loadImagePortion();
-		if (this->touched()) { 
-			this->handleTouch();
-			break; 
+
+	// If playlist was removed from sd card, all images are played
+	if (!storage->toPlaylistEntry(this->playlist, this->playlistPos)) {
+		this->playPlaylist(0);
+		this->selectNextImage();
+	}
+}
+
+uint32_t DigitalFrame::pickRandom(uint32_t n) {
+	if (n == 0) { return 0; }
+
+	// Image i belongs to bucket i % DIFF_RAND_IMG_N, so cost does not grow with number of images
+	uint16_t buckets = min(n, (uint32_t)DIFF_RAND_IMG_N);
+
+	// Buckets marked for larger number of images (or playlist) could all be displayed already
+	if (this->randDisplayedN >= buckets) { this->resetRandom(); }
+
+	// Pick random bucket from those not displayed recently, marked buckets above current number are not counted
+	uint8_t *displayed = Arena::buckets();
+	uint16_t unmarked = 0;
+	for (uint16_t i = 0; i < buckets; i++) {
+		if (!(displayed[i / 8] & (1 << (i % 8)))) { unmarked++; }
+	}
+
+	if (unmarked == 0) {
+		this->resetRandom();
+		unmarked = buckets;
+	}
+
+	uint16_t k = random(unmarked);
+	uint16_t bucket = 0;
+	for (; bucket < buckets; bucket++) {
+		if (displayed[bucket / 8] & (1 << (bucket % 8))) { continue; }
+		if (k == 0) { break; }
+		k--;
+	}
+
+	// Mark bucket as recently displayed
+	displayed[bucket / 8] |= 1 << (bucket % 8);
+	this->randDisplayedN++;
+
+	// If all recently displayed, reset 
+	if (this->randDisplayedN >= buckets) { this->resetRandom(); }
+
+	// Any image from bucket
+	uint32_t inBucket = (n - bucket + DIFF_RAND_IMG_N - 1) / DIFF_RAND_IMG_N;
+	return bucket + random(inBucket) * DIFF_RAND_IMG_N;
+}
+
+void DigitalFrame::resetRandom() {
+	this->randDisplayedN = 0;
+	memset(Arena::buckets(), 0, Arena::size(Arena::BUCKETS));
+}
+
+void DigitalFrame::playPlaylist(uint8_t list) {
+	char *name = Arena::text();
+	this->playlistLen = (list > 0) ? storage->openPlaylist(list, name) : 0;
+	this->playlist = (this->playlistLen > 0) ? list : 0;
+
+	// In order playback starts from first entry
+	this->playlistPos = this->playlistLen - 1;
+
+	// Buckets of previous set of images do not apply
+	this->resetRandom();
+}
+
+bool DigitalFrame::moveInHistory() {
+	bool back = this->historyBack;
+	this->historyBack = false;
+
+	if (back) {
+		if (this->historyOlder < 0) { return false; }
+
+		// Without older images displayed one is shown again
+		if (this->historyOlder > 0) {
+			this->historyPos = (this->historyPos + HISTORY_N - 1) % HISTORY_N;
+			this->historyOlder--;
+			this->historyNewer++;
 		}
+	} else {
+		// After going back images are shown forward again
+		if (this->historyNewer == 0) { return false; }
+
+		this->historyPos = (this->historyPos + 1) % HISTORY_N;
+		this->historyNewer--;
+		this->historyOlder++;
 	}
 
-	//  If image fully loaded
-	if (this->state == IMAGE_DISPLAY) {
-		this->lastImageDisTime = millis();
+	// Cached metadata skips directory lookup and header validation
+	storage->toImage(this->history[this->historyPos]);
+	return true;
+}
+
+void DigitalFrame::rememberImage() {
+	bool same = (this->historyOlder >= 0) && (this->history[this->historyPos].number == storage->getImageNumber());
+
+	// Image displayed again (ONLY_CURRENT mode) takes one entry, newer entries are dropped
+	if ( (!same) && (this->historyOlder >= 0) ) {
+		this->historyPos = (this->historyPos + 1) % HISTORY_N;
 	}
+
+	if (!same) { this->historyOlder = min(this->historyOlder + 1, HISTORY_N - 1); }
+	this->historyNewer = 0;
+	this->history[this->historyPos] = storage->getImageInfo();
 }
 
-void DigitalFrame::loadImage() {
-	uint16_t buffer[IMG_BUFFER];
+void DigitalFrame::playFrame() {
+	uint32_t start = millis();
 
-	// Load image into display
-	display->openWindow(0, 0, display->getWidth(), display->getHeight());
-	for (uint32_t i = 0; i < display->getSize() / IMG_BUFFER; i++) {
-		storage->readImagePortion(buffer, IMG_BUFFER);
-		display->writeBuffer(buffer, IMG_BUFFER);
+	// Keep constant frame rate, skip missed frames time if frame took too long
+	this->lastFrameTime += this->frameInterval;
+	if (millis() - this->lastFrameTime >= this->frameInterval) {
+		this->lastFrameTime = millis();
+	}
+
+	// Only rectangles changed since previous frame are written
+	uint16_t rects = storage->nextFrame();
+	for (uint16_t i = 0; i < rects; i++) {
+		uint16_t x, y, width, height;
+		if (!storage->readFrameRect(x, y, width, height)) {
+			this->frameInterval = 0;
+			return;
+		}
+
+		loader.loadRect(x, y, width, height);
+	}
+
+	PROFILE_ADD(FRAME_MS, millis() - start);
+	PROFILE_REPORT("frame");
+}
+
+bool DigitalFrame::touchInterrupt() {
+	// Backlight keeps fading while image is loaded
+	this->stepFade();
+
+	if (!this->touched()) { return false; }
+
+	this->handleTouch();
+	return true;
+}
+
+void DigitalFrame::prepareOverlay() {
+	char *text = Arena::text();
+	Overlay &overlay = loader.getTransform();
+	overlay.hideAll();
+
+	if ( (SHOW_CAPTION) && (storage->readCaption(text, Arena::textSize)) ) {
+		overlay.setText(Overlay::CAPTION, text, OVERLAY_POS, OVERLAY_POS);
+	}
+
+	// Time left is refreshed with every image, overlay is not redrawn between images
+	if ( (SHOW_STATUS) && (this->turnOff.left(millis()) > 0) ) {
+		strcpy(text, "Off in ");
+		TimeLabel::format(this->turnOff.left(millis()), text + 7);
+
+		uint16_t x = FrameLoader::width - OVERLAY_POS - Overlay::textWidth(strlen(text));
+		uint16_t y = FrameLoader::height - OVERLAY_POS - Overlay::textHeight();
+		overlay.setText(Overlay::STATUS, text, x, y);
 	}
 }
 
-void DigitalFrame::loadImagePortion() {
-	uint16_t buffer[IMG_BUFFER];
+void DigitalFrame::loadImage() {
+	// Ui images are loaded without overlay
+	loader.getTransform().hideAll();
 
-	// Load only one portion
-	storage->readImagePortion(buffer, IMG_BUFFER);
-	display->writeBuffer(buffer, IMG_BUFFER);
+	// Load image into display
+	loader.loadRect(0, 0, FrameLoader::width, FrameLoader::height);
 }
 
 bool DigitalFrame::touched() {
 	// To prevent multi-touches 
 	if (millis() - lastTouchTime < TOUCH_DELAY) { return false; }
-	
-	return (touch->tirqTouched() && touch->touched());
+
+	// Touch controller is accessed over SPI only after interrupt
+	if (!touch->tirqTouched()) { return false; }
+
+	SPIBus::acquire(SPIBus::TOUCH);
+	bool touched = touch->touched();
+	SPIBus::release();
+
+	return touched;
+}
+
+void DigitalFrame::setBacklight(uint8_t level) {
+	this->backlight.set(level);
+	display->setBacklight(level);
+	ENERGY_BACKLIGHT(level);
+}
+
+void DigitalFrame::stepFade() {
+	// Backlight is PWM output, so it is changed even in the middle of image transfer on SPI bus
+	if (!this->backlight.update(millis())) { return; }
+
+	display->setBacklight(this->backlight.getLevel());
+	ENERGY_BACKLIGHT(this->backlight.getLevel());
+
+	if ( (this->revealing) && (!this->backlight.active()) ) {
+		this->revealing = false;
+		PROFILE_ADD(SWITCH_MS, millis() - this->switchStart);
+		PROFILE_REPORT("reveal");
+	}
+}
+
+void DigitalFrame::reportEnergy() {
+	if (Serial) { Energy::report(Serial); }
+	storage->writeFile(ENERGY_FILE, Energy::report);
 }
 
 void DigitalFrame::handleTouch() {
 	uint16_t x, y;
 	this->getTouchPos(x, y);
 	lastTouchTime = millis();
+	this->introShown = false;
 
 	// Handle touch based on current state
 	switch(this->state) {
 		case IMAGE_DISPLAY:
-			this->changeState(MENU_DISPLAY);
+			this->handleImageTouch(x, y);
 			break;
 
 		case MENU_DISPLAY:
@@ -216,20 +570,33 @@ void DigitalFrame::handleTouch() {
 		case SET_TURN_OFF:
 			this->handleSetTurnOffTimeTouch(x, y);
 			break;
+
+		case GALLERY:
+			this->handleGalleryTouch(x, y);
+			break;
+
+		case SET_PLAYLIST:
+			this->handleSetPlaylistTouch(x, y);
+			break;
 		
 		case SLEEP:
 			this->changeState(IMAGE_DISPLAY);
 			break;
 
 		case SD_ERROR:
-			display->turnOffBacklight();
-			this->reset();
+			// Retry without waiting for backoff delay
+			this->remountBackoff.reset();
 			break;
 	}
+
+	PROFILE_REPORT("touch");
 }
 
 void DigitalFrame::getTouchPos(uint16_t &x, uint16_t &y) {
+	SPIBus::acquire(SPIBus::TOUCH);
 	TS_Point p = touch->getPoint();
+	SPIBus::release();
+	TRACE(TOUCH, p.x, p.y);
 	calibration->translate(p);
 
 	x = p.x;
@@ -237,21 +604,33 @@ void DigitalFrame::getTouchPos(uint16_t &x, uint16_t &y) {
 }
 
 void DigitalFrame::changeState(State newState) {
+	TRACE(STATE, newState);
+
 	// If current state need to save setting to sd
 	if ( (this->state == SET_BRIGHTNESS) || (this->state == SET_DISP_TIME) || (this->state == SET_DISP_MODE) ) {
 		this->saveSettings();
 	}
 
-	// Prepare screen for state change
+	// Animation is continued only while image is displayed
+	this->frameInterval = 0;
+
+	// Image change was interrupted while backlight was going down
+	if (this->hiding) {
+		this->hiding = false;
+		this->backlight.to(display->getDefaultBacklight(), REVEAL_STEP_TIME, millis());
+	}
+
+	// Prepare screen for state change, backlight fades in while next image is loaded (or after it was loaded hidden)
 	if (state == SLEEP ) {
-		for (uint8_t i = 0 ; i < display->getDefaultBacklight(); i++) {
-			display->setBacklight(i);
-			delay(10);
-		}
+		if (!HIDDEN_LOADING) { this->backlight.to(display->getDefaultBacklight(), FADE_STEP_TIME, millis()); }
+		ENERGY_SLEEP(false);
 	}
 
-	if ( (newState != SLEEP) && (state != SLEEP) ) {
+	// Settings screens cover whole display with ui image, only image display needs clean screen
+	if ( (newState == IMAGE_DISPLAY) && (state != SLEEP) ) {
+		SPIBus::Use bus(SPIBus::PANEL);
 		display->clear();
+		PROFILE_ADD(PANEL_PIXELS, (uint32_t)PANEL_WIDTH * PANEL_HEIGHT);
 	}
 
 
@@ -270,283 +649,427 @@ void DigitalFrame::changeState(State newState) {
 		case SET_BRIGHTNESS:
 			storage->toImage(BRIGHTNESS_BMP);
 			this->loadImage();
-			this->dispLevel(this->brightnessLvl, BRIGHTNESS_LEVELS_N);
+			this->brightnessBar.invalidate();
+			this->brightnessBar.setLevel(this->brightnessLvl);
 			break;
 
 		case SET_DISP_TIME:
 			storage->toImage(DISP_TIME_BMP);
 			this->loadImage();
-			this->dispTime(dispTimeLvls[this->dispTimeLvl]);
+			this->timeLabel.invalidate();
+			this->timeLabel.setTime(dispTimeLvls[this->dispTimeLvl]);
 			break;
 
 		case SET_DISP_MODE:
 			storage->toImage(DISP_MODE_BMP);
 			this->loadImage();
-			this->dispSelected((uint8_t)this->dispMode);
+			this->modeRadio.invalidate();
+			this->modeRadio.setSelected((uint8_t)this->dispMode);
 			break;
 
 		case SET_TURN_OFF:
 			storage->toImage(SET_TURN_OFF_BMP);
 			this->loadImage();
 			this->turnOffTimeLvl = 0;
-			this->dispTime(turnOffTimes[this->turnOffTimeLvl]);
+			this->timeLabel.invalidate();
+			this->timeLabel.setTime(turnOffTimes[this->turnOffTimeLvl]);
+			break;
+
+		case GALLERY:
+			// Start browsing from page of currently displayed image
+			this->galleryPage = (storage->getImageNumber() < storage->imagesInDir()) ? storage->getImageNumber() / THUMBS_N : 0;
+			storage->toImage(GALLERY_BMP);
+			this->loadImage();
+			this->loadGalleryPage();
+			break;
+
+		case SET_PLAYLIST:
+			storage->toImage(PLAYLIST_BMP);
+			this->loadImage();
+			this->playlistChoice = this->playlist;
+			this->playlistLabel.invalidate();
+			this->showPlaylistChoice();
 			break;
 
 		case SLEEP:
-			this->turnOffScheduled = false;
-			// Dim screen and turn off backlight
-			for (int i  = display->getDefaultBacklight(); i > -1; i--) {
-				display->setBacklight(i);
-				delay(10);
-			}
+			this->turnOff.cancel();
+			// Dim screen and turn off backlight, loop() continues in the meantime
+			this->backlight.to(0, FADE_STEP_TIME, millis());
+			ENERGY_SLEEP(true);
 			break;
 
 		case SD_ERROR:
-			display->setBacklight(255);
+			this->turnOff.cancel();
+			this->remountBackoff.reset();
+			this->setBacklight(255);
 			this->dispStorageError();
 			break;
 	}
+
+	this->renderWidgets();
 }
 
-void DigitalFrame::handleMenuTouch(uint16_t x, uint16_t y) {
-	// Touch on set brightness option
-	if (y > 384) {
-		this->changeState(SET_BRIGHTNESS);
-	}
+void DigitalFrame::handleImageTouch(uint16_t x, uint16_t y) {
+	// Image is changed in loop(), touch may interrupt loading of previous one
+	switch (hitTest(imageZones, ZONES_N(imageZones), x, y)) {
+		case ZONE_PREV_IMAGE:
+			this->historyBack = true;
+			this->forceImageDisplay = true;
+			break;
 
-	// Touch on set display time option
-	else if (y > 288) {
-		this->changeState(SET_DISP_TIME);
-	}
+		case ZONE_NEXT_IMAGE:
+			this->forceImageDisplay = true;
+			break;
 
-	// Touch on set display mode option
-	else if (y > 192) {
-		this->changeState(SET_DISP_MODE);
+		default:
+			this->changeState(MENU_DISPLAY);
+			break;
 	}
+}
 
-	// Touch on schedule turn off option
-	else if (y > 96) {
-		this->changeState(SET_TURN_OFF);
-	}
+void DigitalFrame::handleMenuTouch(uint16_t x, uint16_t y) {
+	switch (hitTest(menuZones, ZONES_N(menuZones), x, y)) {
+		case ZONE_BRIGHTNESS:
+			this->changeState(SET_BRIGHTNESS);
+			break;
 
-	// Touch on go back option
-	else {
-		this->changeState(IMAGE_DISPLAY);
-	}
-}
+		case ZONE_DISP_TIME:
+			this->changeState(SET_DISP_TIME);
+			break;
 
-void DigitalFrame::dispLevel(uint8_t level, uint8_t max) {
-	uint16_t x = 50;
-	for (uint8_t i = 0; i < max - 1; i++) {
-		ILI9486_COLOR c = (i < level) ? ILI9486_WHITE : ILI9486_BLACK;
-		display->fill(x, 270, x + 15, 330, c);
-		x += 20;
-	}
-}
+		case ZONE_DISP_MODE:
+			this->changeState(SET_DISP_MODE);
+			break;
+
+		case ZONE_TURN_OFF:
+			this->changeState(SET_TURN_OFF);
+			break;
 
-void DigitalFrame::dispSelected(uint8_t selected) {
-	uint16_t y = 420;
-	for (uint8_t i = 0; i < 3; i++) {
-		ILI9486_COLOR c = (i == selected) ? ILI9486_WHITE : ILI9486_BLACK;
-		display->drawCircle(305, y, 10, c, true);
-		y -= 120;
+		case ZONE_GALLERY:
+			this->changeState(GALLERY);
+			break;
+
+		case ZONE_BACK:
+			this->changeState(IMAGE_DISPLAY);
+			break;
 	}
 }
 
-void DigitalFrame::dispTime(uint32_t time) {
-	display->fill(0, 270, display->getWidth(), 330, ILI9486_BLACK);
-	
-	char text[128];
-	bool seconds = true;
+void DigitalFrame::renderWidgets() {
+	uint32_t written = 0;
 
-	if (time >= 60000) {
-		time /= 60000;
-		seconds = false;
-	} else {
-		time /= 1000;
-	}
-	
-	uint16_t digitCount = 0;
-
-	uint32_t tmp = time;
-	do {
-		digitCount++;
-		tmp /= 10;
-	} while (tmp);
-
-	uint16_t i = digitCount;
-	while(i) {
-		text[i-1] = (time % 10) + '0';
-		time /= 10;
-		i--;
-	}
-
-	text[digitCount] = ' ';
-
-	if (seconds) {
-		text[digitCount+1] = 's';
-		text[digitCount+2] = 'e';
-		text[digitCount+3] = 'c';
-		text[digitCount+4] = 'o';
-		text[digitCount+5] = 'n';
-		text[digitCount+6] = 'd';
-	} else {
-		text[digitCount+1] = 'm';
-		text[digitCount+2] = 'i';
-		text[digitCount+3] = 'n';
-		text[digitCount+4] = 'u';
-		text[digitCount+5] = 't';
-		text[digitCount+6] = 'e';
-	}
+	// Widgets not visible on current screen are not rendered
+	switch (this->state) {
+		case SET_BRIGHTNESS:
+			written = this->brightnessBar.render(display);
+			break;
+
+		case SET_DISP_TIME:
+		case SET_TURN_OFF:
+			written = this->timeLabel.render(display);
+			break;
 
-	text[digitCount+7] = (text[0] != '1' || digitCount != 1) ? 's' : ' ';
-	text[digitCount+8] = '\0';
+		case SET_DISP_MODE:
+			written = this->modeRadio.render(display);
+			break;
 
-	display->drawString(30, 300, (uint8_t*)text,ILI9486::L, ILI9486_WHITE );
+		case SET_PLAYLIST:
+			written = this->playlistLabel.render(display);
+			break;
+
+		default:
+			break;
+	}
+
+	PROFILE_ADD(PANEL_PIXELS, written);
 }
 
 void DigitalFrame::dispStorageError() {
+	SPIBus::Use bus(SPIBus::PANEL);
 	display->clear();
-	display->drawLine(80, 120, display->getWidth()-80, display->getHeight()-120, ILI9486_RED);
-	display->drawLine(80, display->getHeight()-120, display->getWidth()-80, 120, ILI9486_RED);
+	display->drawLine(80, 120, PANEL_WIDTH-80, PANEL_HEIGHT-120, ILI9486_RED);
+	display->drawLine(80, PANEL_HEIGHT-120, PANEL_WIDTH-80, 120, ILI9486_RED);
 	display->drawString(70, 400, "SD card error", ILI9486::L, ILI9486_RED);
-	display->drawString(70, 80, "Tap to reboot", ILI9486::L, ILI9486_RED);
+	display->drawString(70, 80, "Tap to retry", ILI9486::L, ILI9486_RED);
 }
 
-void DigitalFrame::handleSetBrightnessTouch(uint16_t x, uint16_t y) {
-	// Touch on brightness up
-	if (y > 360) {
-		if (this->brightnessLvl == BRIGHTNESS_LEVELS_N - 1) { return; }
-		this->brightnessLvl++;
-		display->changeDefaultBacklight(brightnessLvls[this->brightnessLvl]);
-		display->setDefaultBacklight();
-	}
+void DigitalFrame::retryStorage() {
+	if (!this->remountBackoff.due(millis())) { return; }
 
-	// Touch on current brightness level
-	else if (y > 240) {}
-	
-	// Touch on brightness down
-	else if (y > 120) {
-		if (this->brightnessLvl == 0) { return; }
-		this->brightnessLvl--;
-		display->changeDefaultBacklight(brightnessLvls[this->brightnessLvl]);
-		display->setDefaultBacklight();
-	}
-	
-	// Touch on go back option
-	else {
-		this->changeState(MENU_DISPLAY);
+	if (!storage->remount()) {
+		this->remountBackoff.failed(millis());
+		return;
 	}
 
-	// If brightness level changed
-	if ( (y > 360) || ( (y < 240) && (y > 120) ) ) {
-		this->dispLevel(this->brightnessLvl, BRIGHTNESS_LEVELS_N);
+	// Card may have been replaced, history refers to blocks of old images
+	this->historyOlder = -1;
+	this->historyNewer = 0;
+	this->imageChosen = false;
+	this->lastCardCheck = millis();
+
+	// Number of images could shrink, buckets displayed before may not exist any more
+	this->resetRandom();
+
+	// Settings and playlists are read again, they could change with card
+	this->loadSettings();
+	display->changeDefaultBacklight(brightnessLvls[brightnessLvl]);
+	this->setBacklight(display->getDefaultBacklight());
+
+	this->changeState(IMAGE_DISPLAY);
+}
+
+void DigitalFrame::handleSetBrightnessTouch(uint16_t x, uint16_t y) {
+	switch (hitTest(levelZones, ZONES_N(levelZones), x, y)) {
+		case ZONE_UP:
+			if (this->brightnessLvl == BRIGHTNESS_LEVELS_N - 1) { return; }
+			this->brightnessLvl++;
+			break;
+
+		case ZONE_DOWN:
+			if (this->brightnessLvl == 0) { return; }
+			this->brightnessLvl--;
+			break;
+
+		case ZONE_BACK:
+			this->changeState(MENU_DISPLAY);
+			return;
+
+		default:
+			return;
 	}
+
+	display->changeDefaultBacklight(brightnessLvls[this->brightnessLvl]);
+	this->setBacklight(display->getDefaultBacklight());
+
+	this->brightnessBar.setLevel(this->brightnessLvl);
+	this->renderWidgets();
 }
 
 void DigitalFrame::handleSetDispTimeTouch(uint16_t x, uint16_t y) {
-	// Touch on longer
-	if (y > 360) {
-		if (this->dispTimeLvl >= DISP_TIME_LEVEL_N - 1) { return; }
-		this->dispTimeLvl++;
-	}
+	switch (hitTest(levelZones, ZONES_N(levelZones), x, y)) {
+		case ZONE_UP:
+			if (this->dispTimeLvl >= DISP_TIME_LEVEL_N - 1) { return; }
+			this->dispTimeLvl++;
+			break;
 
-	// Touch on current display time
-	else if (y > 240) {}
-	
-	// Touch on shorter
-	else if (y > 120) {
-		if (this->dispTimeLvl <= 0) { return; }
-		this->dispTimeLvl--;
-	}
-	
-	// Touch on go back option
-	else {
-		this->changeState(MENU_DISPLAY);
-	}
+		case ZONE_DOWN:
+			if (this->dispTimeLvl <= 0) { return; }
+			this->dispTimeLvl--;
+			break;
 
-	// If disp time changed
-	if ( (y > 360) || ( (y < 240) && (y > 120) ) ) {
-		this->dispTime(dispTimeLvls[this->dispTimeLvl]);
+		case ZONE_BACK:
+			this->changeState(MENU_DISPLAY);
+			return;
+
+		default:
+			return;
 	}
+
+	this->timeLabel.setTime(dispTimeLvls[this->dispTimeLvl]);
+	this->renderWidgets();
 }
 
 void DigitalFrame::handleSetDispModeTouch(uint16_t x, uint16_t y) {
-	// Touch on random
-	if (y > 360) {
-		this->dispMode = RANDOM;
-	}
+	switch (hitTest(dispModeZones, ZONES_N(dispModeZones), x, y)) {
+		case ZONE_RANDOM:
+			this->dispMode = RANDOM;
+			break;
 
-	// Touch on in order 
-	else if (y > 240) {
-		this->dispMode = IN_ORDER;
-	}
+		case ZONE_IN_ORDER:
+			this->dispMode = IN_ORDER;
+			break;
 
-	// Touch on only current image
-	else if (y > 120) {
-		this->dispMode = ONLY_CURRENT;
-	}
+		case ZONE_ONLY_CURRENT:
+			this->dispMode = ONLY_CURRENT;
+			break;
 
-	// Touch on go back option
-	else {
-		this->changeState(MENU_DISPLAY);
+		case ZONE_WEIGHTED:
+			this->dispMode = WEIGHTED;
+			break;
+
+		case ZONE_LEAST_RECENT:
+			this->dispMode = LEAST_RECENT;
+			break;
+
+		case ZONE_PLAYLIST:
+			this->changeState(SET_PLAYLIST);
+			return;
+
+		case ZONE_BACK:
+			this->changeState(MENU_DISPLAY);
+			return;
+
+		default:
+			return;
 	}
 
-	// If mode changed
-	if (y > 120) {
-		this->dispSelected((uint8_t)this->dispMode);
+	// Other orders do not touch order file
+	if (this->dispMode != LEAST_RECENT) {
+		storage->forgetOrder();
 	}
+
+	this->modeRadio.setSelected((uint8_t)this->dispMode);
+	this->renderWidgets();
 }
 
 void DigitalFrame::handleSetTurnOffTimeTouch(uint16_t x, uint16_t y) {
-	// Touch on later option
-	if (y > 360) {
-		this->turnOffTimeLvl++;
-		this->turnOffTimeLvl %= TURN_OFF_TIMES_N;
+	switch (hitTest(turnOffZones, ZONES_N(turnOffZones), x, y)) {
+		case ZONE_UP:
+			this->turnOffTimeLvl = (this->turnOffTimeLvl + 1) % TURN_OFF_TIMES_N;
+			break;
+
+		case ZONE_DOWN:
+			this->turnOffTimeLvl = (this->turnOffTimeLvl + TURN_OFF_TIMES_N - 1) % TURN_OFF_TIMES_N;
+			break;
+
+		case ZONE_BACK:
+			this->changeState(MENU_DISPLAY);
+			return;
+
+		case ZONE_CONFIRM:
+			this->turnOff.set(millis(), turnOffTimes[this->turnOffTimeLvl]);
+			this->changeState(MENU_DISPLAY);
+			return;
+
+		default:
+			return;
 	}
 
-	// Touch on displayed time
-	else if (y > 240) {}
+	this->timeLabel.setTime(turnOffTimes[this->turnOffTimeLvl]);
+	this->renderWidgets();
+}
+
+void DigitalFrame::handleSetPlaylistTouch(uint16_t x, uint16_t y) {
+	char *name = Arena::text();
 
-	// Touch on earlier option
-	else if (y > 120) {
-		this->turnOffTimeLvl--;
-		this->turnOffTimeLvl %= TURN_OFF_TIMES_N;
+	// Playlists are numbered from 1 without gaps, existence is checked by opening file
+	switch (hitTest(playlistZones, ZONES_N(playlistZones), x, y)) {
+		case ZONE_UP:
+			if ( (this->playlistChoice < PLAYLISTS_N) && (storage->openPlaylist(this->playlistChoice + 1, name) > 0) ) {
+				this->playlistChoice++;
+			} else {
+				this->playlistChoice = 0;
+			}
+			break;
+
+		case ZONE_DOWN:
+			if (this->playlistChoice > 0) {
+				this->playlistChoice--;
+			} else {
+				while ( (this->playlistChoice < PLAYLISTS_N) && (storage->openPlaylist(this->playlistChoice + 1, name) > 0) ) {
+					this->playlistChoice++;
+				}
+			}
+			break;
+
+		case ZONE_BACK:
+			this->changeState(SET_DISP_MODE);
+			return;
+
+		case ZONE_CONFIRM:
+			this->playPlaylist(this->playlistChoice);
+			this->saveSettings();
+			this->changeState(SET_DISP_MODE);
+			return;
+
+		default:
+			return;
 	}
 
-	// Touch on go back option
-	else if (x < 160) {
-		this->changeState(MENU_DISPLAY);
+	this->showPlaylistChoice();
+	this->renderWidgets();
+}
+
+void DigitalFrame::showPlaylistChoice() {
+	char *name = Arena::text();
+	strcpy(name, "All images");
+	if (this->playlistChoice > 0) { storage->openPlaylist(this->playlistChoice, name); }
+
+	this->playlistLabel.setText(name);
+}
+
+void DigitalFrame::handleGalleryTouch(uint16_t x, uint16_t y) {
+	uint32_t pages = (storage->imagesInDir() + THUMBS_N - 1) / THUMBS_N;
+	uint8_t zone = hitTest(galleryZones, ZONES_N(galleryZones), x, y);
+
+	switch (zone) {
+		case ZONE_PREV_PAGE:
+			// Without images there are no pages to turn
+			if (pages == 0) { return; }
+			this->galleryPage = (this->galleryPage + pages - 1) % pages;
+			break;
+
+		case ZONE_NEXT_PAGE:
+			if (pages == 0) { return; }
+			this->galleryPage = (this->galleryPage + 1) % pages;
+			break;
+
+		case ZONE_BACK:
+			this->changeState(MENU_DISPLAY);
+			return;
+
+		case NO_ZONE:
+			return;
+
+		default: {
+			uint32_t image = this->galleryPage * THUMBS_N + (zone - ZONE_THUMB);
+			if (image >= storage->imagesInDir()) { return; }
+
+			this->imageChosen = true;
+			this->chosenImage = image;
+			this->changeState(IMAGE_DISPLAY);
+			return;
+		}
 	}
 
-	// Touch on schedule option
-	else if (x >= 160) {
-		this->turnOffScheduled = true;
-		this->turnOffTime = millis() + turnOffTimes[this->turnOffTimeLvl];
-		this->changeState(MENU_DISPLAY);
+	// Only thumbnails area is cleared, navigation bar stays
+	Rect thumbs = {0, 96, PANEL_WIDTH - 1, PANEL_HEIGHT - 1};
+	uint32_t written = thumbs.fill(display, ILI9486_BLACK);
+	PROFILE_ADD(PANEL_PIXELS, written);
+
+	this->loadGalleryPage();
+}
+
+void DigitalFrame::loadGalleryPage() {
+	// Page left from card with more images starts again from first one
+	if (this->galleryPage * THUMBS_N >= storage->imagesInDir()) { this->galleryPage = 0; }
+
+	uint32_t first = this->galleryPage * THUMBS_N;
+	uint8_t n = (first < storage->imagesInDir()) ? min((uint32_t)THUMBS_N, storage->imagesInDir() - first) : 0;
+
+	// Thumbnails of page are stored one after another, so page is read sequentially
+	if (!storage->toThumbnail(first)) {
+		SPIBus::Use bus(SPIBus::PANEL);
+		display->drawString(70, 240, "No thumbnails", ILI9486::L, ILI9486_WHITE);
+		return;
 	}
 
-	// If mode changed
-	if (y > 120) {
-		this->dispTime(turnOffTimes[this->turnOffTimeLvl]);
+	for (uint8_t i = 0; i < n; i++) {
+		uint16_t x = THUMBS_X + (i % THUMBS_COLUMNS) * THUMBS_STEP_X;
+		uint16_t y = THUMBS_Y - (i / THUMBS_COLUMNS) * THUMBS_STEP_Y;
+		loader.loadRect(x, y, THUMB_WIDTH, THUMB_HEIGHT);
 	}
 }
 
 void DigitalFrame::saveSettings() {
-	uint8_t s[5] = {
+	uint8_t s[8] = {
 		this->brightnessLvl,
 		this->dispTimeLvl,
 		(uint8_t)this->dispMode,
-		(uint8_t)(storage->getImageNumber() >> 8), // Image number is stored in 16 bit variable 
-		(uint8_t)(storage->getImageNumber() & 0xFF)
+		(uint8_t)(storage->getImageNumber() >> 8), // Low 16 bits of image number, where older versions kept whole number
+		(uint8_t)(storage->getImageNumber() & 0xFF),
+		this->playlist,
+		(uint8_t)(storage->getImageNumber() >> 24), // High 16 bits of image number
+		(uint8_t)(storage->getImageNumber() >> 16)
 	};
 
-	storage->saveSettings(s, 5);
+	storage->saveSettings(s, 8);
 }
 
 void DigitalFrame::loadSettings() {
-	uint8_t s[5];
-	storage->loadSettings(s, 5);
+	// Settings saved by older versions have no playlist and 16 bit image number
+	uint8_t s[8] = {};
+	storage->loadSettings(s, 8);
 
 	this->brightnessLvl = s[0];
 	this->dispTimeLvl = s[1];
@@ -559,10 +1082,15 @@ void DigitalFrame::loadSettings() {
 	if (this->dispTimeLvl >= DISP_TIME_LEVEL_N) {
 		this->dispTimeLvl = DISP_TIME_LEVEL_N - 1;
 	}
+	if (this->dispMode >= DISP_MODES_N) {
+		this->dispMode = RANDOM;
+	}
+
+	this->playPlaylist(s[5]);
 
 	// Only ONLY_CURRENT mode uses image number
 	if (dispMode == ONLY_CURRENT) {
-		uint16_t imageN = ((uint16_t)s[3] << 8) | (uint16_t)s[4];
+		uint32_t imageN = ((uint32_t)s[6] << 24) | ((uint32_t)s[7] << 16) | ((uint32_t)s[3] << 8) | (uint32_t)s[4];
 		
 		// Switch to random mode if image number is incorrect
 		if (imageN >= storage->imagesInDir()) {
@@ -26,6 +26,16 @@ along with this program.  If not, see https://www.gnu.org/licenses/.
 
 #include "../Calibration/Calibration.h"
 #include "../SDStorage/SDStorage.h"
+#include "../Widget/Widget.h"
+#include "../Overlay/Overlay.h"
+#include "../ImageLoader/ImageLoader.h"
+#include "../HotPlug/HotPlug.h"
+#include "../Fade/Fade.h"
+#include "../Deadline/Deadline.h"
+#include "../Arena/Arena.h"
+#include "../Profiler/Profiler.h"
+#include "../Trace/Trace.h"
+#include "../Energy/Energy.h"
 
 #define INTRO_BMP "intro.bmp"
 #define MENU_BMP "m.bmp"
@@ -33,15 +43,43 @@ along with this program.  If not, see https://www.gnu.org/licenses/.
 #define DISP_TIME_BMP "t.bmp"
 #define DISP_MODE_BMP "o.bmp"
 #define SET_TURN_OFF_BMP "f.bmp"
+#define GALLERY_BMP "g.bmp"
+#define PLAYLIST_BMP "p.bmp"
+
+#define DISP_MODES_N 5
 
 // Number of guaranteed different images displayed in row in random mode
-// Force different images to appear
+// Force different images to appear, each bucket takes one bit of arena
 #define DIFF_RAND_IMG_N 256
 
-#define IMG_BUFFER 40 // Loading image buffer size in pixels
+#define PLAYLISTS_N 99 // Highest playlist number looked for on sd card
+
+#define HISTORY_N 8 // Displayed images remembered for going back, each takes sizeof(SDStorage::ImageInfo) bytes of RAM
+static_assert( (HISTORY_N >= 2) && (HISTORY_N <= 127), "History counters are 8 bit signed");
+
+#define PANEL_WIDTH 320 // Must match display orientation set in main.cpp
+#define PANEL_HEIGHT 480
+#define IMG_BUFFER 64 // Loading image buffer size in pixels, single burst of display and SD card transfers, buffer is in arena
+#define PROGRESSIVE_LOADING false // Load BMP24 images in interlace passes (interlaced files are always loaded in passes)
+#define HIDDEN_LOADING false // Load next image with backlight off and fade it in, image appears complete instead of being painted
+#define HIDE_STEP_TIME 1 // Time of single backlight level change before hidden loading [ms]
+#define REVEAL_STEP_TIME 2 // Time of single backlight level change after hidden loading [ms]
+#define SHOW_CAPTION true // Draw caption stored in image file over image
+#define SHOW_STATUS true // Draw time left to scheduled turn off over image
+#define OVERLAY_POS 8 // Distance of overlays from display border [px]
 #define INTRO_DISPLAY_TIME 5000 // Time of intro display in miliseconds
+#define FADE_STEP_TIME 10 // Time of single backlight level change while fading into and out of sleep [ms]
 #define TOUCH_DELAY 500
 
+// Gallery page is grid of thumbnails above navigation bar, first thumbnail is in top left corner
+#define THUMBS_COLUMNS 3
+#define THUMBS_ROWS 3
+#define THUMBS_N (THUMBS_COLUMNS * THUMBS_ROWS)
+#define THUMBS_X 13 // Left border of first column
+#define THUMBS_Y 356 // Bottom border of first row
+#define THUMBS_STEP_X 107
+#define THUMBS_STEP_Y 128
+
 #define TURN_OFF_TIMES_N 6
 constexpr uint32_t turnOffTimes[TURN_OFF_TIMES_N] = {0, 300000, 900000, 1800000, 2700000, 3600000};
 
@@ -52,6 +90,9 @@ constexpr uint32_t dispTimeLvls[DISP_TIME_LEVEL_N] = {5000, 30000, 60000, 300000
 #define BRIGHTNESS_LEVELS_N 4
 constexpr uint8_t brightnessLvls[BRIGHTNESS_LEVELS_N] = {10, 40, 90, 255};
 
+// Images are read from sd card, overlay is drawn into them and they are written into display
+typedef ImageLoader<SDStorage, Overlay, PanelSink<ILI9486>, PANEL_WIDTH, PANEL_HEIGHT, IMG_BUFFER> FrameLoader;
+
 class DigitalFrame {
 public:
     enum State {
@@ -61,6 +102,8 @@ public:
         SET_DISP_TIME,
         SET_DISP_MODE,
         SET_TURN_OFF,
+        GALLERY,
+        SET_PLAYLIST,
         SLEEP,
         SD_ERROR
     };
@@ -68,7 +111,34 @@ public:
     enum DispMode {
         RANDOM = 0,
         IN_ORDER = 1,
-        ONLY_CURRENT = 2
+        ONLY_CURRENT = 2,
+        WEIGHTED = 3, // Probability proportional to weights from WEIGHTS_FILE
+        LEAST_RECENT = 4 // Image not shown for longest time, every displayed image is moved to end of ORDER_FILE
+    };
+
+    // Touch zones ids of all screens
+    enum Zone : uint8_t {
+        ZONE_BACK,
+        ZONE_UP,
+        ZONE_VALUE,
+        ZONE_DOWN,
+        ZONE_CONFIRM,
+        ZONE_BRIGHTNESS,
+        ZONE_DISP_TIME,
+        ZONE_DISP_MODE,
+        ZONE_TURN_OFF,
+        ZONE_RANDOM,
+        ZONE_IN_ORDER,
+        ZONE_ONLY_CURRENT,
+        ZONE_WEIGHTED,
+        ZONE_LEAST_RECENT,
+        ZONE_PLAYLIST,
+        ZONE_GALLERY,
+        ZONE_PREV_PAGE,
+        ZONE_NEXT_PAGE,
+        ZONE_PREV_IMAGE,
+        ZONE_NEXT_IMAGE,
+        ZONE_THUMB // First of THUMBS_N thumbnail zones, must be last
     };
 
     DigitalFrame(ILI9486 *display, XPT2046_Touchscreen *touch, Calibration *calibration, SDStorage *storage, bool dispIntro = true);
@@ -77,7 +147,6 @@ public:
     void loop(); // This method must be called in arduino loop function
     void moveToNextImg(); // Move to next image based on current display mode
     void loadImage(); // Load currently selected image into screen
-    void loadImagePortion(); // Load IMG_BUFFER pixels of currently selected images into screen
     void changeState(State newState); // Change current state
     void handleTouch(); // Main touch handler
 
@@ -89,29 +158,70 @@ private:
     State state; // Program state
     DispMode dispMode;
     uint32_t randDisplayedN; // Store number of images displayed in random mode
+    uint32_t lastCardCheck; // Time of last sd card presence check
+    Backoff remountBackoff; // Delays sd card remount attempts after failures
     uint32_t lastImageDisTime; // Time of last image display
     uint32_t lastTouchTime; // Time of last touch
-    uint32_t turnOffTime; // Scheduled turn off time
+    uint32_t lastFrameTime; // Time when last animation frame was due
+    uint16_t frameInterval; // Time between animation frames, 0 if displayed image is not animated
     uint8_t brightnessLvl; // Current brightness level
     uint8_t dispTimeLvl; // Single image display time
     uint8_t turnOffTimeLvl; // Currently displayed time for turn off schedule
-    bool turnOffScheduled; // True if turn off was scheduled
     bool forceImageDisplay; // Force image display, do not look on display time
-    bool imageRandDisplayed[DIFF_RAND_IMG_N]; // Store information if image was displayed in random mode
-
+    bool imageChosen; // True if next displayed image was chosen in gallery
+    bool introShown; // Intro is displayed until INTRO_DISPLAY_TIME passes or screen is touched
+    bool hiding; // Backlight goes down before next image is loaded hidden
+    bool revealing; // Backlight goes up after hidden loading
+    uint32_t switchStart; // Time when displayed image started to change
+    uint32_t chosenImage;
+    uint32_t galleryPage; // Currently displayed gallery page
+    SDStorage::ImageInfo history[HISTORY_N]; // Ring of recently displayed images
+    uint8_t historyPos; // Entry of displayed image
+    int8_t historyOlder; // Number of entries before displayed one, -1 if history is empty
+    uint8_t historyNewer; // Number of entries after displayed one (after going back)
+    bool historyBack; // Previous image was requested
+    uint8_t playlist; // Played playlist, 0 plays all images
+    uint8_t playlistChoice; // Playlist shown on SET_PLAYLIST screen
+    uint16_t playlistLen; // Number of entries of played playlist
+    uint16_t playlistPos; // Entry of displayed image
+    LevelBar brightnessBar; // Brightness level on SET_BRIGHTNESS screen
+    RadioGroup modeRadio; // Selected display mode on SET_DISP_MODE screen
+    TimeLabel timeLabel; // Time on SET_DISP_TIME and SET_TURN_OFF screens
+    TextLabel playlistLabel; // Playlist name on SET_PLAYLIST screen
+    FrameLoader loader; // Streams images into display
+    Fade backlight; // Backlight level, fades are advanced from loop() and while images are loaded
+    Deadline turnOff; // Scheduled turn off
+
+    void selectNextImage(); // Open next image based on display mode
+    void selectPlaylistImage(); // Open next image of played playlist based on display mode
+    uint32_t pickRandom(uint32_t n); // Pick random image (or playlist entry) out of n from bucket not displayed recently
+    void resetRandom(); // Forget buckets displayed in random mode
+    void playPlaylist(uint8_t list); // Switch played playlist, 0 or invalid playlist plays all images
+    void showPlaylistChoice(); // Set name of chosen playlist on SET_PLAYLIST screen
+    bool moveInHistory(); // Open previous or newer image from history if requested or available
+    void rememberImage(); // Add current image to history
+    void playFrame(); // Display next frame of animated image
+    void prepareOverlay(); // Set overlay layers for current image
+    bool touchInterrupt(); // Handle touch during image loading, return true if loading should stop
+    void setBacklight(uint8_t level); // Set backlight immediately, running fade is stopped
+    void stepFade(); // Write backlight level of running fade
+    void reportEnergy(); // Print energy estimate over Serial and write it into ENERGY_FILE
     bool touched();
     void getTouchPos(uint16_t &x, uint16_t &y);
 
-    void dispLevel(uint8_t level, uint8_t max); // Display menu to set brightness
-    void dispSelected(uint8_t selected);
-    void dispTime(uint32_t time);
+    void renderWidgets(); // Push changed widgets of current screen into display
     void dispStorageError();
+    void retryStorage(); // Try to mount sd card again if backoff delay passed, continue displaying images on success
+    void loadGalleryPage(); // Draw thumbnails of current gallery page
 
+    void handleImageTouch(uint16_t x, uint16_t y); // Handle screen touch while image display
     void handleMenuTouch(uint16_t x, uint16_t y); // Handle screen touch while menu display
     void handleSetBrightnessTouch(uint16_t x, uint16_t y); // Handle screen touch while setting brightness
     void handleSetDispTimeTouch(uint16_t x, uint16_t y); // Handle screen touch while setting display time
     void handleSetDispModeTouch(uint16_t x, uint16_t y); // Handle screen touch while setting display mode
     void handleSetTurnOffTimeTouch(uint16_t x, uint16_t y); // Handle screen touch while scheduling turn off
+    void handleGalleryTouch(uint16_t x, uint16_t y); // Handle screen touch while browsing thumbnails
+    void handleSetPlaylistTouch(uint16_t x, uint16_t y); // Handle screen touch while choosing playlist
 
     void saveSettings();
     void loadSettings();
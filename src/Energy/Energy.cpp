@@ -0,0 +1,108 @@
+/*
+Energy.cpp
+
+Energy class implementation.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "Energy.h"
+#include "../DigitalFrame/DigitalFrame.h"
+
+#define LEVEL_OFF BRIGHTNESS_LEVELS_N // Index of time with backlight turned off
+#define LEVEL_OTHER (BRIGHTNESS_LEVELS_N + 1) // Index of time at levels not in brightnessLvls (fading, error screen)
+
+static uint32_t lastAccount = 0; // Time of last Energy::account() [ms]
+static uint32_t lastReport = 0;
+static uint8_t backlightLevel = 0;
+static bool sleeping = false;
+static uint32_t awakeMs = 0;
+static uint32_t sleepMs = 0;
+static uint32_t levelMs[BRIGHTNESS_LEVELS_N + 2] = {}; // Time at each of brightnessLvls, then off and other levels
+static uint64_t levelSum = 0; // Backlight level multiplied by time [ms]
+static uint32_t busMs[SPIBus::DEVICES_N] = {}; // Time of bus use by every device
+static uint16_t busUs[SPIBus::DEVICES_N] = {}; // Part of time below 1 ms
+
+void Energy::setBacklight(uint8_t level) {
+    account();
+    backlightLevel = level;
+}
+
+void Energy::setSleep(bool sleep) {
+    account();
+    sleeping = sleep;
+}
+
+void Energy::addBus(uint8_t device, uint32_t us) {
+    us += busUs[device];
+    busMs[device] += us / 1000;
+    busUs[device] = us % 1000;
+}
+
+bool Energy::due() {
+    return millis() - lastReport >= ENERGY_REPORT_INTERVAL;
+}
+
+void Energy::account() {
+    uint32_t now = millis();
+    uint32_t ms = now - lastAccount;
+    lastAccount = now;
+
+    if (sleeping) { sleepMs += ms; } else { awakeMs += ms; }
+
+    uint8_t index = (backlightLevel == 0) ? LEVEL_OFF : LEVEL_OTHER;
+    for (uint8_t i = 0; i < BRIGHTNESS_LEVELS_N; i++) {
+        if (brightnessLvls[i] == backlightLevel) { index = i; }
+    }
+
+    levelMs[index] += ms;
+    levelSum += (uint64_t)backlightLevel * ms;
+}
+
+void Energy::report(Print &out) {
+    account();
+    lastReport = millis();
+
+    uint32_t totalMs = awakeMs + sleepMs;
+    out.print(F("energy | ms: "));
+    out.print(totalMs);
+    out.print(F(" | sleep ms: "));
+    out.print(sleepMs);
+
+    for (uint8_t i = 0; i < BRIGHTNESS_LEVELS_N; i++) {
+        out.print(F(" | backlight "));
+        out.print(brightnessLvls[i]);
+        out.print(F(" ms: "));
+        out.print(levelMs[i]);
+    }
+
+    out.print(F(" | backlight off ms: "));
+    out.print(levelMs[LEVEL_OFF]);
+    out.print(F(" | backlight other ms: "));
+    out.print(levelMs[LEVEL_OTHER]);
+    out.print(F(" | sd ms: "));
+    out.print(busMs[SPIBus::SD_CARD]);
+    out.print(F(" | panel ms: "));
+    out.print(busMs[SPIBus::PANEL]);
+
+    // Power [mW] multiplied by time [ms] gives energy in mWh after division by ms in hour
+    double mWh = ( (double)POWER_AWAKE_MW * awakeMs + (double)POWER_SLEEP_MW * sleepMs + (double)POWER_BACKLIGHT_MW * levelSum / 255
+        + (double)POWER_SD_MW * busMs[SPIBus::SD_CARD] + (double)POWER_PANEL_MW * busMs[SPIBus::PANEL] ) / 3600000;
+
+    out.print(F(" | mWh: "));
+    out.print(mWh, 2);
+    out.print(F(" | mWh per day: "));
+    out.print( (totalMs > 0) ? mWh * 86400000 / totalMs : 0.0, 1);
+    out.println();
+}
@@ -0,0 +1,61 @@
+/*
+Energy.h
+
+Energy estimates power use of frame from time spent at every backlight level, time when sd card
+and display use SPI bus and time in sleep, multiplied by power of components set below.
+Report is printed over Serial and written into ENERGY_FILE every ENERGY_REPORT_INTERVAL.
+Accounting is compiled out unless ENERGY_ACCOUNTING is defined.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// #define ENERGY_ACCOUNTING // Uncomment to estimate energy use
+#define ENERGY_BAUD 115200
+#define ENERGY_FILE "energy.txt" // Latest report, overwritten every interval
+#define ENERGY_REPORT_INTERVAL 3600000 // [ms]
+
+// Power of components [mW], measure own frame with ammeter for better estimate
+#define POWER_AWAKE_MW 150 // Arduino, display controller and touch controller, without backlight
+#define POWER_SLEEP_MW 150 // The same in SLEEP, loop() keeps running
+#define POWER_BACKLIGHT_MW 500 // Backlight at level 255, power is proportional to level
+#define POWER_SD_MW 100 // Sd card reading or writing, added while card uses SPI bus
+#define POWER_PANEL_MW 20 // Display receiving pixels, added while display uses SPI bus
+
+class Energy {
+public:
+    static void setBacklight(uint8_t level); // Called when backlight level changes
+    static void setSleep(bool sleeping); // Called when frame enters or leaves SLEEP
+    static void addBus(uint8_t device, uint32_t us); // Add time when SPIBus device used bus
+    static bool due(); // True if ENERGY_REPORT_INTERVAL passed since last report
+    static void report(Print &out); // Print times and estimated energy since start, counting continues
+
+private:
+    static void account(); // Add time since last call to current backlight level and sleep state
+};
+
+#ifdef ENERGY_ACCOUNTING
+#define ENERGY_BACKLIGHT(level) Energy::setBacklight(level)
+#define ENERGY_SLEEP(sleeping) Energy::setSleep(sleeping)
+#define ENERGY_BUS(device, us) Energy::addBus((device), (us))
+#define ENERGY_DUE() Energy::due()
+#else
+#define ENERGY_BACKLIGHT(level)
+#define ENERGY_SLEEP(sleeping)
+#define ENERGY_BUS(device, us)
+#define ENERGY_DUE() false
+#endif
@@ -0,0 +1,68 @@
+/*
+Fade.h
+
+Backlight level changing linearly in time, advanced from frame loop, so fading in and out
+of sleep does not block touch handling and image loading.
+This header does not depend on Arduino, so it is shared with tools running on PC.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Level is computed from time since start of fade, so it reaches target on time
+// however rarely update() is called, comparisons use time differences, so millis() overflow does not matter
+class Fade {
+public:
+    Fade(): level(0), from(0), target(0), start(0), duration(0) {}
+
+    // Jump to level, running fade is stopped
+    void set(uint8_t level) {
+        this->level = this->from = this->target = level;
+        this->duration = 0;
+    }
+
+    // Fade from current level, stepTime per level [ms]
+    void to(uint8_t target, uint8_t stepTime, uint32_t now) {
+        this->from = this->level;
+        this->target = target;
+        this->start = now;
+        this->duration = (uint16_t)((target > this->level) ? target - this->level : this->level - target) * stepTime;
+    }
+
+    // Return true if level changed
+    bool update(uint32_t now) {
+        if (this->level == this->target) { return false; }
+
+        uint32_t elapsed = now - this->start;
+        uint8_t level = (elapsed >= this->duration) ? this->target
+            : this->from + ((int32_t)this->target - this->from) * (int32_t)elapsed / (int32_t)this->duration;
+
+        bool changed = level != this->level;
+        this->level = level;
+        return changed;
+    }
+
+    bool active() const { return this->level != this->target; }
+    uint8_t getLevel() const { return this->level; }
+
+private:
+    uint8_t level;
+    uint8_t from;
+    uint8_t target;
+    uint32_t start; // Time when fade started
+    uint16_t duration; // [ms]
+};
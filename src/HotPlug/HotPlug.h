@@ -0,0 +1,89 @@
+/*
+HotPlug.h
+
+Helpers for sd card removal and remount without reboot.
+Frame checks card presence every CARD_CHECK_INTERVAL, after removal or sd error it tries
+to mount card again, delays between attempts grow with Backoff, so failed attempts
+(each may wait for card initialization timeout) do not block touch handling all the time.
+After remount number of images is updated by rescanImages.
+This header does not depend on Arduino, so it is shared with tools running on PC.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define CARD_CHECK_INTERVAL 1000 // Time between card presence checks [ms]
+#define REMOUNT_FIRST_DELAY 250 // Delay after first failed remount [ms]
+#define REMOUNT_MAX_DELAY 8000
+
+// Delay between attempts doubles after every failure up to REMOUNT_MAX_DELAY,
+// comparisons use time differences, so millis() overflow does not matter
+class Backoff {
+public:
+    Backoff(): delay(0), last(0) {}
+
+    void reset() { this->delay = 0; } // Next attempt is due immediately
+    bool due(uint32_t now) const { return now - this->last >= this->delay; }
+    uint16_t getDelay() const { return this->delay; }
+
+    void failed(uint32_t now) {
+        this->last = now;
+        this->delay = (this->delay == 0) ? REMOUNT_FIRST_DELAY
+            : (this->delay >= REMOUNT_MAX_DELAY / 2) ? REMOUNT_MAX_DELAY : this->delay * 2;
+    }
+
+private:
+    uint16_t delay; // Time from last failure to next attempt [ms]
+    uint32_t last; // Time of last failure
+};
+
+// Images are named by numbers without gaps, so count is updated by looking up numbers around previous count:
+// unchanged count costs two lookups, otherwise steps away from previous count double until
+// boundary is passed and then it is bisected, so many added or removed images still cost few lookups.
+// exists(number) returns true if image with number is on card.
+template <class Exists>
+uint32_t rescanImages(uint32_t count, Exists exists) {
+    uint32_t low = 0, high = UINT32_MAX; // Images below low exist, image high and above do not
+    uint32_t step = 1;
+
+    if ( (count > 0) && (!exists(count - 1)) ) {
+        // Images were removed
+        high = count - 1;
+        while (high > 0) {
+            uint32_t n = (high > step) ? high - step : 0;
+            if (exists(n)) { low = n + 1; break; }
+            high = n;
+            step *= 2;
+        }
+    } else {
+        // Images were added or count did not change
+        low = count;
+        while (low < high) {
+            uint32_t n = (step <= high - low) ? low + step - 1 : high - 1;
+            if (!exists(n)) { high = n; break; }
+            low = n + 1;
+            step *= 2;
+        }
+    }
+
+    while (low < high) {
+        uint32_t n = low + (high - low) / 2;
+        if (exists(n)) { low = n + 1; } else { high = n; }
+    }
+
+    return low;
+}
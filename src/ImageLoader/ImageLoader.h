@@ -0,0 +1,138 @@
+/*
+ImageLoader.h
+
+ImageLoader loads current image into display through pixel pipeline (see Pipeline.h),
+sequentially or in interlace passes, and stops when interrupted by touch.
+Pipeline stages, resolution and buffer size are template parameters, so loop bounds are
+compile time constants and build for other panel does not pay for generality.
+Whole class is in header, because it is a template.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include "../Pipeline/Pipeline.h"
+#include "../Profiler/Profiler.h"
+#include "../SPIBus/SPIBus.h"
+
+// Pipeline sink writing into display window, Panel must provide openWindow(x1, y1, x2, y2) and writeBuffer(buffer, n)
+template <class Panel>
+class PanelSink {
+public:
+    PanelSink(Panel *panel): panel(panel) {}
+
+    void open(uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+        SPIBus::acquire(SPIBus::PANEL);
+        this->panel->openWindow(x, y, x + width, y + height);
+        SPIBus::release();
+    }
+
+    // Panel library selects display for every buffer, so bus is reported around each write
+    void begin() {}
+    void end() {}
+
+    void write(const uint16_t *pixels, uint16_t n) {
+        SPIBus::acquire(SPIBus::PANEL);
+        this->panel->writeBuffer((uint16_t*)pixels, n);
+        SPIBus::release();
+        PROFILE_ADD(PANEL_PIXELS, n);
+    }
+
+private:
+    Panel *panel;
+};
+
+template <class Source, class Transform, class Sink, uint16_t WIDTH, uint16_t HEIGHT, uint16_t BUFFER>
+class ImageLoader {
+public:
+    static constexpr uint16_t width = WIDTH;
+    static constexpr uint16_t height = HEIGHT;
+    static constexpr uint32_t size = (uint32_t)WIDTH * HEIGHT;
+
+    ImageLoader(Source *source, const Sink &sink, uint16_t *buffer); // buffer has PORTION_BUFFER(BUFFER) words
+
+    // interrupted() is called between portions, loading stops if it returns true
+    template <class Interrupt> bool loadSequential(Interrupt interrupted); // Load image row by row, return false if interrupted
+    template <class Interrupt> bool loadProgressive(Interrupt interrupted, bool preview = true); // Load image in interlace passes, return false if interrupted
+    void loadRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h); // Load next w * h pixels of image into rectangle
+
+    Transform &getTransform(); // Transform applied to every loaded image
+
+private:
+    Source *source;
+    Pipeline<Source, Transform, Sink, BUFFER> pipeline;
+};
+
+template <class Source, class Transform, class Sink, uint16_t WIDTH, uint16_t HEIGHT, uint16_t BUFFER>
+ImageLoader<Source, Transform, Sink, WIDTH, HEIGHT, BUFFER>::ImageLoader(Source *source, const Sink &sink, uint16_t *buffer):
+    source(source),
+    pipeline(source, sink, buffer)
+{}
+
+template <class Source, class Transform, class Sink, uint16_t WIDTH, uint16_t HEIGHT, uint16_t BUFFER>
+template <class Interrupt>
+bool ImageLoader<Source, Transform, Sink, WIDTH, HEIGHT, BUFFER>::loadSequential(Interrupt interrupted) {
+    this->pipeline.open(0, 0, WIDTH, HEIGHT);
+
+    // Load image by portions and check for interrupt in the meantime
+    for (uint32_t left = size; left > 0; ) {
+        left -= this->pipeline.push(left);
+        if (interrupted()) { return false; }
+    }
+
+    return true;
+}
+
+template <class Source, class Transform, class Sink, uint16_t WIDTH, uint16_t HEIGHT, uint16_t BUFFER>
+template <class Interrupt>
+bool ImageLoader<Source, Transform, Sink, WIDTH, HEIGHT, BUFFER>::loadProgressive(Interrupt interrupted, bool preview) {
+    bool interlaced = this->source->isInterlaced();
+    uint32_t start = millis();
+
+    // First pass shows coarse image, following passes fill rows between
+    for (uint8_t p = 0; p < INTERLACE_PASSES; p++) {
+        for (uint16_t row = interlaceStart[p]; row < HEIGHT; row += interlaceStep[p]) {
+            // Interlaced files store rows in passes order, others are read row by row
+            if (!interlaced) { this->source->seekRow(row); }
+
+            // Row portion is stretched over rows not loaded yet, unless coarse preview is not needed
+            uint8_t rows = preview ? min((uint16_t)interlaceHeight[p], (uint16_t)(HEIGHT - row)) : 1;
+            for (uint16_t x = 0; x < WIDTH; x += BUFFER) {
+                this->pipeline.pushRow(x, row, min(BUFFER, (uint16_t)(WIDTH - x)), rows);
+            }
+
+            if (interrupted()) { return false; }
+        }
+
+        if (p == 0) { PROFILE_ADD(COARSE_MS, millis() - start); }
+    }
+
+    return true;
+}
+
+template <class Source, class Transform, class Sink, uint16_t WIDTH, uint16_t HEIGHT, uint16_t BUFFER>
+void ImageLoader<Source, Transform, Sink, WIDTH, HEIGHT, BUFFER>::loadRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+    this->pipeline.open(x, y, w, h);
+    for (uint32_t left = (uint32_t)w * h; left > 0; ) {
+        left -= this->pipeline.push(left);
+    }
+}
+
+template <class Source, class Transform, class Sink, uint16_t WIDTH, uint16_t HEIGHT, uint16_t BUFFER>
+Transform &ImageLoader<Source, Transform, Sink, WIDTH, HEIGHT, BUFFER>::getTransform() {
+    return this->pipeline.getTransform();
+}
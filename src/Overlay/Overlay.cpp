@@ -0,0 +1,209 @@
+/*
+Overlay.cpp
+
+Overlay class implementation.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "Overlay.h"
+
+#define FIRST_GLYPH ' '
+#define LAST_GLYPH '~'
+
+// ASCII glyphs from ' ' to '~', 5 columns each, bit 0 is top row
+static const uint8_t glyphs[] PROGMEM = {
+    0x00, 0x00, 0x00, 0x00, 0x00, // ' '
+    0x00, 0x00, 0x5F, 0x00, 0x00, // !
+    0x00, 0x07, 0x00, 0x07, 0x00, // "
+    0x14, 0x7F, 0x14, 0x7F, 0x14, // #
+    0x24, 0x2A, 0x7F, 0x2A, 0x12, // $
+    0x23, 0x13, 0x08, 0x64, 0x62, // %
+    0x36, 0x49, 0x55, 0x22, 0x50, // &
+    0x00, 0x05, 0x03, 0x00, 0x00, // '
+    0x00, 0x1C, 0x22, 0x41, 0x00, // (
+    0x00, 0x41, 0x22, 0x1C, 0x00, // )
+    0x08, 0x2A, 0x1C, 0x2A, 0x08, // *
+    0x08, 0x08, 0x3E, 0x08, 0x08, // +
+    0x00, 0x50, 0x30, 0x00, 0x00, // ,
+    0x08, 0x08, 0x08, 0x08, 0x08, // -
+    0x00, 0x60, 0x60, 0x00, 0x00, // .
+    0x20, 0x10, 0x08, 0x04, 0x02, // /
+    0x3E, 0x51, 0x49, 0x45, 0x3E, // 0
+    0x00, 0x42, 0x7F, 0x40, 0x00, // 1
+    0x42, 0x61, 0x51, 0x49, 0x46, // 2
+    0x21, 0x41, 0x45, 0x4B, 0x31, // 3
+    0x18, 0x14, 0x12, 0x7F, 0x10, // 4
+    0x27, 0x45, 0x45, 0x45, 0x39, // 5
+    0x3C, 0x4A, 0x49, 0x49, 0x30, // 6
+    0x01, 0x71, 0x09, 0x05, 0x03, // 7
+    0x36, 0x49, 0x49, 0x49, 0x36, // 8
+    0x06, 0x49, 0x49, 0x29, 0x1E, // 9
+    0x00, 0x36, 0x36, 0x00, 0x00, // :
+    0x00, 0x56, 0x36, 0x00, 0x00, // ;
+    0x08, 0x14, 0x22, 0x41, 0x00, // <
+    0x14, 0x14, 0x14, 0x14, 0x14, // =
+    0x00, 0x41, 0x22, 0x14, 0x08, // >
+    0x02, 0x01, 0x51, 0x09, 0x06, // ?
+    0x32, 0x49, 0x79, 0x41, 0x3E, // @
+    0x7E, 0x11, 0x11, 0x11, 0x7E, // A
+    0x7F, 0x49, 0x49, 0x49, 0x36, // B
+    0x3E, 0x41, 0x41, 0x41, 0x22, // C
+    0x7F, 0x41, 0x41, 0x22, 0x1C, // D
+    0x7F, 0x49, 0x49, 0x49, 0x41, // E
+    0x7F, 0x09, 0x09, 0x09, 0x01, // F
+    0x3E, 0x41, 0x49, 0x49, 0x7A, // G
+    0x7F, 0x08, 0x08, 0x08, 0x7F, // H
+    0x00, 0x41, 0x7F, 0x41, 0x00, // I
+    0x20, 0x40, 0x41, 0x3F, 0x01, // J
+    0x7F, 0x08, 0x14, 0x22, 0x41, // K
+    0x7F, 0x40, 0x40, 0x40, 0x40, // L
+    0x7F, 0x02, 0x0C, 0x02, 0x7F, // M
+    0x7F, 0x04, 0x08, 0x10, 0x7F, // N
+    0x3E, 0x41, 0x41, 0x41, 0x3E, // O
+    0x7F, 0x09, 0x09, 0x09, 0x06, // P
+    0x3E, 0x41, 0x51, 0x21, 0x5E, // Q
+    0x7F, 0x09, 0x19, 0x29, 0x46, // R
+    0x46, 0x49, 0x49, 0x49, 0x31, // S
+    0x01, 0x01, 0x7F, 0x01, 0x01, // T
+    0x3F, 0x40, 0x40, 0x40, 0x3F, // U
+    0x1F, 0x20, 0x40, 0x20, 0x1F, // V
+    0x3F, 0x40, 0x38, 0x40, 0x3F, // W
+    0x63, 0x14, 0x08, 0x14, 0x63, // X
+    0x07, 0x08, 0x70, 0x08, 0x07, // Y
+    0x61, 0x51, 0x49, 0x45, 0x43, // Z
+    0x00, 0x7F, 0x41, 0x41, 0x00, // [
+    0x02, 0x04, 0x08, 0x10, 0x20, // backslash
+    0x00, 0x41, 0x41, 0x7F, 0x00, // ]
+    0x04, 0x02, 0x01, 0x02, 0x04, // ^
+    0x40, 0x40, 0x40, 0x40, 0x40, // _
+    0x00, 0x01, 0x02, 0x04, 0x00, // `
+    0x20, 0x54, 0x54, 0x54, 0x78, // a
+    0x7F, 0x48, 0x44, 0x44, 0x38, // b
+    0x38, 0x44, 0x44, 0x44, 0x20, // c
+    0x38, 0x44, 0x44, 0x48, 0x7F, // d
+    0x38, 0x54, 0x54, 0x54, 0x18, // e
+    0x08, 0x7E, 0x09, 0x01, 0x02, // f
+    0x0C, 0x52, 0x52, 0x52, 0x3E, // g
+    0x7F, 0x08, 0x04, 0x04, 0x78, // h
+    0x00, 0x44, 0x7D, 0x40, 0x00, // i
+    0x20, 0x40, 0x44, 0x3D, 0x00, // j
+    0x7F, 0x10, 0x28, 0x44, 0x00, // k
+    0x00, 0x41, 0x7F, 0x40, 0x00, // l
+    0x7C, 0x04, 0x18, 0x04, 0x78, // m
+    0x7C, 0x08, 0x04, 0x04, 0x78, // n
+    0x38, 0x44, 0x44, 0x44, 0x38, // o
+    0x7C, 0x14, 0x14, 0x14, 0x08, // p
+    0x08, 0x14, 0x14, 0x18, 0x7C, // q
+    0x7C, 0x08, 0x04, 0x04, 0x08, // r
+    0x48, 0x54, 0x54, 0x54, 0x20, // s
+    0x04, 0x3F, 0x44, 0x40, 0x20, // t
+    0x3C, 0x40, 0x40, 0x20, 0x7C, // u
+    0x1C, 0x20, 0x40, 0x20, 0x1C, // v
+    0x3C, 0x40, 0x30, 0x40, 0x3C, // w
+    0x44, 0x28, 0x10, 0x28, 0x44, // x
+    0x0C, 0x50, 0x50, 0x50, 0x3C, // y
+    0x44, 0x64, 0x54, 0x4C, 0x44, // z
+    0x00, 0x08, 0x36, 0x41, 0x00, // {
+    0x00, 0x00, 0x7F, 0x00, 0x00, // |
+    0x00, 0x41, 0x36, 0x08, 0x00, // }
+    0x08, 0x04, 0x08, 0x10, 0x08  // ~
+};
+
+Overlay::Overlay():
+    layers()
+{}
+
+void Overlay::setText(Layer layer, const char *text, uint16_t x, uint16_t y) {
+    TextLayer &l = this->layers[layer];
+
+    l.length = 0;
+    while ( (text[l.length]) && (l.length < OVERLAY_TEXT_LEN) ) {
+        l.text[l.length] = text[l.length];
+        l.length++;
+    }
+
+    l.x = x;
+    l.y = y;
+}
+
+void Overlay::hide(Layer layer) {
+    this->layers[layer].length = 0;
+}
+
+void Overlay::hideAll() {
+    for (uint8_t i = 0; i < LAYERS_N; i++) { this->hide((Layer)i); }
+}
+
+bool Overlay::isEmpty() {
+    for (uint8_t i = 0; i < LAYERS_N; i++) {
+        if (this->layers[i].length) { return false; }
+    }
+
+    return true;
+}
+
+uint16_t Overlay::textWidth(uint8_t length) {
+    return length * GLYPH_ADVANCE - GLYPH_SCALE + 2 * OVERLAY_MARGIN;
+}
+
+uint16_t Overlay::textHeight() {
+    return GLYPH_HEIGHT * GLYPH_SCALE + 2 * OVERLAY_MARGIN;
+}
+
+void Overlay::compose(uint16_t *pixels, uint16_t n, uint16_t x, uint16_t y) {
+    for (uint8_t i = 0; i < LAYERS_N; i++) {
+        if (this->layers[i].length) {
+            this->composeLayer(this->layers[i], pixels, n, x, y);
+        }
+    }
+}
+
+void Overlay::composeLayer(const TextLayer &layer, uint16_t *pixels, uint16_t n, uint16_t x, uint16_t y) {
+    // Work is limited to part of row covered by text box
+    if ( (y < layer.y) || (y >= layer.y + textHeight()) ) { return; }
+
+    uint16_t boxEnd = layer.x + textWidth(layer.length);
+    uint16_t from = max(x, layer.x);
+    uint16_t to = min((uint16_t)(x + n), boxEnd);
+    if (from >= to) { return; }
+
+    // Display rows grow upwards, glyph rows grow downwards
+    int16_t glyphRow = (int16_t)(layer.y + textHeight() - 1 - OVERLAY_MARGIN - y) / GLYPH_SCALE;
+    bool textRow = (y >= layer.y + OVERLAY_MARGIN) && (glyphRow < GLYPH_HEIGHT);
+
+    for (uint16_t px = from; px < to; px++) {
+        uint16_t &p = pixels[px - x];
+
+        if ( (textRow) && (px >= layer.x + OVERLAY_MARGIN) ) {
+            uint16_t gx = (px - layer.x - OVERLAY_MARGIN) / GLYPH_SCALE;
+            uint8_t c = gx / (GLYPH_WIDTH + 1);
+            uint8_t column = gx % (GLYPH_WIDTH + 1);
+
+            if ( (c < layer.length) && (column < GLYPH_WIDTH) ) {
+                char ch = layer.text[c];
+                if ( (ch < FIRST_GLYPH) || (ch > LAST_GLYPH) ) { ch = '?'; }
+
+                uint8_t bits = pgm_read_byte(&glyphs[(ch - FIRST_GLYPH) * GLYPH_WIDTH + column]);
+                if (bits & (1 << glyphRow)) {
+                    p = OVERLAY_COLOR;
+                    continue;
+                }
+            }
+        }
+
+        // Halve every color channel to darken background
+        p = (p >> 1) & 0x7BEF;
+    }
+}
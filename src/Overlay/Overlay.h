@@ -0,0 +1,65 @@
+/*
+Overlay.h
+
+Overlay draws text layers (caption, status) into image pixels while they are streamed,
+before they are written into display, so every pixel is written only once.
+Text is drawn with 5x7 glyphs from PROGMEM on darkened background box.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define GLYPH_WIDTH 5
+#define GLYPH_HEIGHT 7
+#define GLYPH_SCALE 2 // Every glyph pixel is drawn as GLYPH_SCALE x GLYPH_SCALE square
+#define GLYPH_ADVANCE ((GLYPH_WIDTH + 1) * GLYPH_SCALE) // Character width with spacing [px]
+#define OVERLAY_MARGIN 4 // Background box margin around text [px]
+#define OVERLAY_TEXT_LEN 25 // Max characters of single layer
+#define OVERLAY_COLOR 0xFFFF // Text color (RGB565)
+
+class Overlay {
+public:
+    enum Layer {
+        CAPTION,
+        STATUS,
+        LAYERS_N
+    };
+
+    Overlay();
+
+    void setText(Layer layer, const char *text, uint16_t x, uint16_t y); // Show text with left bottom corner of box at x, y
+    void hide(Layer layer);
+    void hideAll();
+    bool isEmpty(); // True if no layer is visible
+
+    void compose(uint16_t *pixels, uint16_t n, uint16_t x, uint16_t y); // Draw layers into n pixels of row y starting at column x
+
+    static uint16_t textWidth(uint8_t length); // Width of box with text [px]
+    static uint16_t textHeight(); // Height of box with text [px]
+
+private:
+    struct TextLayer {
+        char text[OVERLAY_TEXT_LEN];
+        uint8_t length; // 0 if layer is hidden
+        uint16_t x; // Box left border
+        uint16_t y; // Box bottom border
+    };
+
+    TextLayer layers[LAYERS_N];
+
+    void composeLayer(const TextLayer &layer, uint16_t *pixels, uint16_t n, uint16_t x, uint16_t y);
+};
@@ -0,0 +1,240 @@
+/*
+Pipeline.h
+
+Pipeline moves image pixels from source through transform into sink, portion by portion.
+Stages are template parameters, so calls between them are resolved at compile time
+and fused into single loop without virtual calls per pixel or portion.
+This header does not depend on Arduino, so it is shared with tools running on PC.
+
+Stage interfaces:
+- Source: uint16_t readSolidSpan(uint16_t &color, uint16_t maxSize) - skip up to maxSize pixels of single color,
+  return their number (0 if next pixel does not start solid span)
+  void readImagePortion(uint16_t *buffer, uint16_t size) - decode next size pixels, buffer has PORTION_BUFFER(size) words
+- Transform: bool isEmpty() - true if transform would not change any pixel
+  void compose(uint16_t *pixels, uint16_t n, uint16_t x, uint16_t y) - change n pixels of row y starting at column x
+- Sink: void open(uint16_t x, uint16_t y, uint16_t width, uint16_t height) - pixels are written into rectangle row by row
+  void begin(), void end() - bracket around consecutive writes
+  void write(const uint16_t *pixels, uint16_t n)
+Transform must not be changed while rectangle is written.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../SDStorage/ImageFormat.h"
+
+#define SOLID_SPAN_MAX 640 // Max pixels of solid span pushed at once, touch is checked between spans
+
+// Transform leaving pixels unchanged
+struct NoTransform {
+    bool isEmpty() { return true; }
+    void compose(uint16_t * /* pixels */, uint16_t /* n */, uint16_t /* x */, uint16_t /* y */) {}
+};
+
+// Transform applying First and then Second
+template <class First, class Second>
+struct Chain {
+    First first;
+    Second second;
+
+    bool isEmpty() { return first.isEmpty() && second.isEmpty(); }
+
+    void compose(uint16_t *pixels, uint16_t n, uint16_t x, uint16_t y) {
+        first.compose(pixels, n, x, y);
+        second.compose(pixels, n, x, y);
+    }
+};
+
+// Sink storing pixels in memory, used by tools on PC
+template <uint16_t WIDTH, uint16_t HEIGHT>
+class FramebufferSink {
+public:
+    uint16_t pixels[(uint32_t)WIDTH * HEIGHT]; // Rows in display order, row 0 is bottom row
+
+    void open(uint16_t x, uint16_t y, uint16_t width, uint16_t /* height */) {
+        this->x1 = x;
+        this->x2 = x + width;
+        this->x = x;
+        this->y = y;
+    }
+
+    void begin() {}
+    void end() {}
+
+    void write(const uint16_t *data, uint16_t n) {
+        while (n > 0) {
+            uint16_t k = (n < this->x2 - this->x) ? n : this->x2 - this->x;
+            memcpy(&this->pixels[(uint32_t)this->y * WIDTH + this->x], data, k * 2);
+
+            data += k;
+            n -= k;
+            this->x += k;
+            if (this->x >= this->x2) {
+                this->x = this->x1;
+                this->y++;
+            }
+        }
+    }
+
+private:
+    uint16_t x1, x2; // Rectangle borders, x2 exclusive
+    uint16_t x, y; // Position of next pixel
+};
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+class Pipeline {
+public:
+    static_assert(BUFFER <= 255, "Portion loops count pixels in 8 bits");
+    static_assert(SOLID_SPAN_MAX >= BUFFER, "Solid span must not be shorter than buffer");
+
+    Pipeline(Source *source, const Sink &sink, uint16_t *buffer); // buffer has PORTION_BUFFER(BUFFER) words, it is used only during calls
+
+    void open(uint16_t x, uint16_t y, uint16_t width, uint16_t height); // Start rectangle, following pushes fill it row by row
+    uint16_t push(uint32_t maxPixels); // Move up to BUFFER pixels (or solid span) into sink, return number of moved pixels
+    void pushRow(uint16_t x, uint16_t y, uint8_t n, uint8_t rows); // Move n pixels into row y and repeat them in rows above
+
+    Transform &getTransform();
+    Sink &getSink();
+
+private:
+    Source *source;
+    Transform transform;
+    Sink sink;
+    uint16_t *buffer; // Portion of pixels, shared by pushes
+    uint16_t windowX; // Left border of opened rectangle
+    uint16_t windowEnd; // Right border (exclusive) of opened rectangle
+    uint16_t cursorX; // Position of next pixel in opened rectangle
+    uint16_t cursorY;
+
+    void pushSolid(uint16_t color, uint16_t n);
+    void compose(uint16_t *pixels, uint16_t n); // Transform next n pixels of opened rectangle
+};
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+Pipeline<Source, Transform, Sink, BUFFER>::Pipeline(Source *source, const Sink &sink, uint16_t *buffer):
+    source(source),
+    transform(),
+    sink(sink),
+    buffer(buffer),
+    windowX(0),
+    windowEnd(0),
+    cursorX(0),
+    cursorY(0)
+{}
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+void Pipeline<Source, Transform, Sink, BUFFER>::open(uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+    this->sink.open(x, y, width, height);
+
+    this->windowX = x;
+    this->windowEnd = x + width;
+    this->cursorX = x;
+    this->cursorY = y;
+}
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+uint16_t Pipeline<Source, Transform, Sink, BUFFER>::push(uint32_t maxPixels) {
+    uint16_t *buffer = this->buffer;
+    uint16_t color;
+
+    // Solid span is written without decoding its pixels
+    uint16_t n = this->source->readSolidSpan(color, (maxPixels < SOLID_SPAN_MAX) ? maxPixels : SOLID_SPAN_MAX);
+    if (n) {
+        this->pushSolid(color, n);
+        return n;
+    }
+
+    n = (maxPixels < BUFFER) ? maxPixels : BUFFER;
+    this->source->readImagePortion(buffer, n);
+    this->compose(buffer, n);
+
+    this->sink.begin();
+    this->sink.write(buffer, n);
+    this->sink.end();
+
+    return n;
+}
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+void Pipeline<Source, Transform, Sink, BUFFER>::pushRow(uint16_t x, uint16_t y, uint8_t n, uint8_t rows) {
+    uint16_t *buffer = this->buffer;
+    this->source->readImagePortion(buffer, n);
+
+    // Transform is applied to row y only, copies are expected to be replaced later
+    this->transform.compose(buffer, n, x, y);
+
+    this->open(x, y, n, rows);
+    this->sink.begin();
+    for (uint8_t i = 0; i < rows; i++) { this->sink.write(buffer, n); }
+    this->sink.end();
+}
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+Transform &Pipeline<Source, Transform, Sink, BUFFER>::getTransform() {
+    return this->transform;
+}
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+Sink &Pipeline<Source, Transform, Sink, BUFFER>::getSink() {
+    return this->sink;
+}
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+void Pipeline<Source, Transform, Sink, BUFFER>::pushSolid(uint16_t color, uint16_t n) {
+    uint16_t *buffer = this->buffer;
+    bool plain = this->transform.isEmpty();
+
+    // Span needs no room for decoding, so whole buffer is written at once, sink selects device fewer times
+    const uint16_t burst = PORTION_BUFFER(BUFFER);
+    for (uint16_t i = 0; i < burst; i++) { buffer[i] = color; }
+
+    // Sinks have no fill command, keep streaming into opened rectangle
+    this->sink.begin();
+    while (n > 0) {
+        uint16_t k = (n < burst) ? n : burst;
+
+        // Transform changes buffer, so it is filled again for every portion
+        if (!plain) {
+            for (uint16_t i = 0; i < k; i++) { buffer[i] = color; }
+            this->compose(buffer, k);
+        }
+
+        this->sink.write(buffer, k);
+        n -= k;
+    }
+    this->sink.end();
+}
+
+template <class Source, class Transform, class Sink, uint16_t BUFFER>
+void Pipeline<Source, Transform, Sink, BUFFER>::compose(uint16_t *pixels, uint16_t n) {
+    if (this->transform.isEmpty()) { return; }
+
+    // Split pixels into rows of opened rectangle
+    while (n > 0) {
+        uint16_t k = (n < this->windowEnd - this->cursorX) ? n : this->windowEnd - this->cursorX;
+        this->transform.compose(pixels, k, this->cursorX, this->cursorY);
+
+        pixels += k;
+        n -= k;
+        this->cursorX += k;
+        if (this->cursorX >= this->windowEnd) {
+            this->cursorX = this->windowX;
+            this->cursorY++;
+        }
+    }
+}
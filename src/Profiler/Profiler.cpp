@@ -0,0 +1,60 @@
+/*
+Profiler.cpp
+
+Profiler class implementation.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "Profiler.h"
+
+uint32_t Profiler::counters[Profiler::COUNTERS_N] = {};
+
+// Counter names, order must match Profiler::Counter
+static const char name0[] PROGMEM = "panel px";
+static const char name1[] PROGMEM = "solid px";
+static const char name2[] PROGMEM = "sd bytes";
+static const char name3[] PROGMEM = "sd raw bytes";
+static const char name4[] PROGMEM = "bus selects";
+static const char name5[] PROGMEM = "bus idle us";
+static const char name6[] PROGMEM = "coarse ms";
+static const char name7[] PROGMEM = "full ms";
+static const char name8[] PROGMEM = "frame ms";
+static const char name9[] PROGMEM = "cache hits";
+static const char name10[] PROGMEM = "cache misses";
+static const char name11[] PROGMEM = "cache ms";
+static const char name12[] PROGMEM = "switch ms";
+static const char *const names[Profiler::COUNTERS_N] PROGMEM = {name0, name1, name2, name3, name4, name5, name6, name7, name8, name9, name10, name11, name12};
+
+void Profiler::add(Counter counter, uint32_t value) {
+    counters[counter] += value;
+}
+
+uint32_t Profiler::get(Counter counter) {
+    return counters[counter];
+}
+
+void Profiler::report(const char *label) {
+    if (!Serial) { return; }
+
+    Serial.print(label);
+    for (uint8_t i = 0; i < COUNTERS_N; i++) {
+        Serial.print(F(" | "));
+        Serial.print((const __FlashStringHelper*)pgm_read_ptr(&names[i]));
+        Serial.print(F(": "));
+        Serial.print(counters[i]);
+        counters[i] = 0;
+    }
+    Serial.println();
+}
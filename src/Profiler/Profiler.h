@@ -0,0 +1,63 @@
+/*
+Profiler.h
+
+Profiler collects performance counters (written pixels, transferred bytes, times)
+and prints them over Serial.
+Counters are compiled out unless PROFILING is defined.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// #define PROFILING // Uncomment to print performance counters over Serial
+#define PROFILING_BAUD 115200
+
+class Profiler {
+public:
+    enum Counter {
+        PANEL_PIXELS, // Pixels written into display
+        SOLID_PIXELS, // Pixels written from solid spans, without reading them from SD card
+        SD_BYTES, // Image bytes read from SD card
+        SD_RAW_BYTES, // Image bytes streamed from contiguous files, without FAT lookups
+        BUS_SELECTS, // Chip select assertions of devices on SPI bus
+        BUS_IDLE_US, // Time when SPI bus was not used [us]
+        COARSE_MS, // Time until whole image was visible in low resolution [ms]
+        FULL_MS, // Time until whole image was loaded [ms]
+        FRAME_MS, // Time of drawing animation frame [ms]
+        CACHE_HITS, // BMP24 images read from their RGB565 copies
+        CACHE_MISSES, // BMP24 images without valid copy
+        CACHE_MS, // Time of writing copies while sd card was idle [ms]
+        SWITCH_MS, // Time from old image starting to disappear until new image is complete and fully lit [ms]
+        COUNTERS_N
+    };
+
+    static void add(Counter counter, uint32_t value);
+    static uint32_t get(Counter counter);
+    static void report(const char *label); // Print all counters over Serial and reset them
+
+private:
+    static uint32_t counters[COUNTERS_N];
+};
+
+#ifdef PROFILING
+#define PROFILE_ADD(counter, value) Profiler::add(Profiler::counter, (value))
+#define PROFILE_REPORT(label) Profiler::report(label)
+#else
+// Value is not evaluated, variables kept only for profiling are still used, so they do not cause warnings
+#define PROFILE_ADD(counter, value) ((void)sizeof(value))
+#define PROFILE_REPORT(label)
+#endif
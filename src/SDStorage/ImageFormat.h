@@ -0,0 +1,171 @@
+/*
+ImageFormat.h
+
+Definitions of image files understood by SDStorage.
+This header does not depend on Arduino, so it is shared with tools running on PC.
+
+All images are bmp files with resolution that exactly matches display:
+- BMP24 - standard 24 bit bmp without compression
+- RGB565 - standard 16 bit bmp with RGB565 bit fields
+- RLE16 - 16 bit (RGB565) bmp compressed with frame specific run length encoding
+
+RLE16 pixel data is a sequence of packets, each starting with 16 bit little endian header:
+- RLE16_RUN_FLAG set - run, (header & RLE16_COUNT_MASK) + 1 pixels of single color, color follows header
+- RLE16_RUN_FLAG clear - literal, header + 1 pixels follow header
+Colors are 16 bit little endian RGB565 values, pixel order is the same as in BMP24.
+
+Images prepared for frame have BMP_FRAME_SIGNATURE in first reserved field of bmp header
+and BMP_FLAG_* flags in second one.
+BMP_FLAG_INTERLACED - rows are stored in order of interlace passes (see interlaceStart),
+so image can be displayed progressively while reading file sequentially.
+BMP_FLAG_ANIMATION - first frame is followed by animation:
+- header: ANIMATION_MAGIC, number of frames, frame interval [ms] (16 bit little endian each)
+- frames: number of rectangles, then each rectangle: x, y, width, height (16 bit little endian each)
+  followed by width * height RGB565 pixels, rectangles cover only pixels changed since previous frame.
+  Last frame goes back to first frame, so animation can loop.
+BMP_FLAG_CAPTION - caption text follows bmp header (at BMP_HEADER_SIZE): length byte and up to
+CAPTION_MAX_LEN characters, pixel data offset in header points behind it.
+
+Thumbnails file holds THUMB_WIDTH x THUMB_HEIGHT RGB565 thumbnail of every image:
+- header: THUMBS_MAGIC, thumbnail width, thumbnail height, number of thumbnails (16 bit little endian each)
+- thumbnail of image i starts at THUMBS_HEADER_SIZE + i * THUMB_SIZE, rows are stored bottom up as in bmp,
+  so thumbnails of consecutive images are read sequentially.
+
+Weights file holds alias table for picking images with probability proportional to their weight:
+- header: WEIGHTS_MAGIC, number of images (16 bit little endian each)
+- entry of every image: threshold, alias (16 bit little endian each), see aliasPick.
+
+Order file holds images linked in list from least to most recently shown, displayed image is moved to its end:
+- header: ORDER_MAGIC, number of images, least recently shown image (head), most recently shown image (tail),
+  16 bit little endian each
+- entry of image i at ORDER_HEADER_SIZE + i * ORDER_ENTRY_SIZE: previous (shown earlier) and next (shown later)
+  image, 16 bit little endian each, ORDER_NONE at ends of list.
+
+Playlist file holds images in chosen order, entries have fixed size, so any of them is read directly:
+- header: PLAYLIST_MAGIC, number of entries (16 bit little endian each), name (PLAYLIST_NAME_LEN bytes, zero padded)
+- entry: image number (16 bit), format (8 bit, IMAGE_FORMAT_*), bmp flags (8 bit), pixel data offset (16 bit),
+  pixel data size (32 bit), file size (32 bit), reserved (16 bit), all little endian.
+  Image with different file size was changed after playlist was compiled, its header is read again.
+
+Index file maps 32 bit image ids to images in nested album directories inside images directory:
+- header: INDEX_MAGIC, number of albums (16 bit), number of images (32 bit), all little endian
+- album: parent album (16 bit, INDEX_NO_PARENT for album 0, which is images directory itself), reserved (16 bit),
+  first image id (32 bit), number of images including subalbums (32 bit), directory name (INDEX_NAME_LEN bytes, zero padded).
+  Images of album and all its subalbums have consecutive ids.
+- entry of every image in id order: album (16 bit), format (8 bit), bmp flags (8 bit), pixel data offset (16 bit),
+  reserved (16 bit), pixel data size (32 bit), file size (32 bit), file name (INDEX_NAME_LEN bytes, zero padded).
+  Entry is read directly (see indexEntryOffset) and path is built from parents of its album, so no directory is listed.
+  Numbered images of flat images directory keep their numbers as ids.
+
+Cache files are RGB565 copies of BMP24 images written by frame, so they are read without conversion:
+- RGB565 bmp header with BMP_FLAG_CACHED and bit field masks, then source file size, source stamp
+  (32 bit each, see RawStream::getStamp) and ring slot (16 bit) at CACHE_STAMP_OFFSET, pixel data at CACHE_DATA_OFFSET.
+  BMP_MAGIC is written last, so copy interrupted by image change or card removal is not valid.
+- ring file: CACHE_MAGIC, number of slots, clock hand (16 bit little endian each), then image id of every slot
+  (32 bit, CACHE_FREE if empty, CACHE_REFERENCED set when copy was read since hand passed it).
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define BMP_MAGIC 0x4D42 // "BM"
+#define BMP_HEADER_SIZE 54 // File header + BITMAPINFOHEADER
+#define BMP_INFO_HEADER_SIZE 40
+
+#define BMP_COMPRESSION_NONE 0
+#define BMP_COMPRESSION_BITFIELDS 3
+#define BMP_COMPRESSION_RLE16 0x36314C52 // "RL16", not a standard bmp compression
+
+#define RLE16_RUN_FLAG 0x8000
+#define RLE16_COUNT_MASK 0x7FFF
+#define RLE16_MAX_PACKET 0x8000 // Maximal number of pixels in single packet
+#define RLE16_MIN_RUN 4 // Shorter runs are stored as literals by encoder
+
+#define BMP_FRAME_SIGNATURE 0x4650 // "PF"
+#define BMP_FLAG_INTERLACED 0x0001
+#define BMP_FLAG_ANIMATION 0x0002
+#define BMP_FLAG_CAPTION 0x0004
+#define BMP_FLAG_CACHED 0x0008
+
+#define CAPTION_MAX_LEN 255
+
+#define ANIMATION_MAGIC 0x4E41 // "AN"
+
+#define THUMBS_MAGIC 0x4854 // "TH"
+#define THUMBS_HEADER_SIZE 8
+#define THUMB_WIDTH 80
+#define THUMB_HEIGHT 120
+#define THUMB_SIZE ((uint32_t)THUMB_WIDTH * THUMB_HEIGHT * 2)
+
+#define WEIGHTS_MAGIC 0x5457 // "WT"
+#define WEIGHTS_HEADER_SIZE 4
+#define WEIGHTS_ENTRY_SIZE 4
+
+#define ORDER_MAGIC 0x4C4F // "OL"
+#define ORDER_HEADER_SIZE 8
+#define ORDER_ENTRY_SIZE 4
+#define ORDER_NONE 0xFFFF
+
+#define PLAYLIST_MAGIC 0x4C50 // "PL"
+#define PLAYLIST_NAME_LEN 20
+#define PLAYLIST_HEADER_SIZE (4 + PLAYLIST_NAME_LEN)
+#define PLAYLIST_ENTRY_SIZE 16
+
+#define INDEX_MAGIC 0x5849 // "IX"
+#define INDEX_HEADER_SIZE 8
+#define INDEX_ALBUM_SIZE 24
+#define INDEX_ENTRY_SIZE 28
+#define INDEX_NAME_LEN 12 // 8.3 names, sd library does not read long names
+#define INDEX_NO_PARENT 0xFFFF
+#define INDEX_MAX_DEPTH 8 // Deeper albums are not indexed, path must fit in RAM
+
+#define CACHE_MAGIC 0x4343 // "CC"
+#define CACHE_HEADER_SIZE 6
+#define CACHE_ENTRY_SIZE 4
+#define CACHE_FREE 0xFFFFFFFF
+#define CACHE_REFERENCED 0x80000000
+#define CACHE_STAMP_OFFSET 66 // Behind bmp header and bit field masks
+#define CACHE_DATA_OFFSET 80
+
+#define IMAGE_FORMAT_BMP24 0
+#define IMAGE_FORMAT_RGB565 1
+#define IMAGE_FORMAT_RLE16 2
+
+// Interlace pass p covers rows interlaceStart[p] + k * interlaceStep[p],
+// until next pass each of them is shown stretched over interlaceHeight[p] rows
+#define INTERLACE_PASSES 4
+constexpr uint8_t interlaceStart[INTERLACE_PASSES] = {0, 4, 2, 1};
+constexpr uint8_t interlaceStep[INTERLACE_PASSES] = {8, 8, 4, 2};
+constexpr uint8_t interlaceHeight[INTERLACE_PASSES] = {8, 4, 2, 1};
+
+// Size of buffer (in 16 bit words) needed to decode size pixels of any format,
+// BMP24 pixels are read into the same buffer and converted in place
+#define PORTION_BUFFER(size) (((size) * 3 + 1) / 2)
+
+// Image picked from alias table with uniformly random slot and coin,
+// slot keeps threshold / 65536 of its probability, rest goes to alias
+inline uint16_t aliasPick(uint16_t slot, uint16_t coin, uint16_t threshold, uint16_t alias) {
+    return (coin < threshold) ? slot : alias;
+}
+
+inline uint32_t indexEntryOffset(uint16_t albums, uint32_t id) {
+    return INDEX_HEADER_SIZE + (uint32_t)albums * INDEX_ALBUM_SIZE + id * INDEX_ENTRY_SIZE;
+}
+
+inline uint16_t RGB24ToRGB16(uint8_t r, uint8_t g, uint8_t b) {
+    return (( (r) >> 3 ) << 11 ) | (( (g) >> 2 ) << 5) | ( (b) >> 3);
+}
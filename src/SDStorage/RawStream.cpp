@@ -0,0 +1,299 @@
+/*
+RawStream.cpp
+
+RawStream class implementation.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "RawStream.h"
+
+RawStream::RawStream(uint8_t csPin):
+    csPin(csPin),
+    ready(false),
+    reading(false),
+    crcPending(false),
+    held(false),
+    firstBlock(0),
+    fileSize(0),
+    stamp(0),
+    block(0),
+    pos(0),
+    left(0),
+    blockLeft(0),
+    skip(0)
+{}
+
+bool RawStream::begin() {
+    this->close();
+    this->root.close();
+
+    // Card which fails at full speed is still used for directory entries (stamps of files)
+    this->ready = ( (this->card.init(SPI_FULL_SPEED, this->csPin)) || (this->card.init(SPI_HALF_SPEED, this->csPin)) )
+        && this->volume.init(&this->card)
+        && this->root.openRoot(&this->volume);
+
+    return this->ready;
+}
+
+bool RawStream::probe() {
+    // Opened stream continues from the same place after status command
+    bool streaming = this->left > 0;
+    this->stop();
+
+    this->select();
+
+    // Removed or reinserted (not initialized) card does not answer, R1 stays 0xFF
+    uint8_t r1 = this->command(SD_CMD_SEND_STATUS, 0);
+    SPI.transfer(0xFF); // Second byte of R2 response
+
+    this->deselect();
+
+    if (streaming) { this->seek(this->pos); }
+    return r1 == 0;
+}
+
+bool RawStream::open(const char *path, uint32_t offset) {
+    this->close();
+
+    // Stamp is read from directory entry of fragmented file too, only its streaming is refused
+    if (!this->fileRange(path, this->firstBlock, this->fileSize, this->stamp)) {
+        this->fileSize = 0;
+        return false;
+    }
+
+    return this->seek(offset);
+}
+
+bool RawStream::open(uint32_t firstBlock, uint32_t fileSize, uint32_t offset) {
+    this->close();
+    if (!this->ready) { return false; }
+
+    this->firstBlock = firstBlock;
+    this->fileSize = fileSize;
+    return this->seek(offset);
+}
+
+bool RawStream::seek(uint32_t offset) {
+    this->stop();
+    if (offset >= this->fileSize) { return false; }
+
+    // File is contiguous, so block is computed instead of looked up in FAT
+    this->block = this->firstBlock + offset / SD_BLOCK_SIZE;
+    this->skip = offset % SD_BLOCK_SIZE;
+    this->pos = offset;
+    this->left = this->fileSize - offset;
+    this->blockLeft = 0;
+    return true;
+}
+
+bool RawStream::read(void *buffer, uint16_t n) {
+    if (n > this->left) { return false; }
+
+    uint8_t *dst = (uint8_t*)buffer;
+    bool ok = true;
+
+    if (!this->held) { select(); }
+
+    if (!this->reading) {
+        // SDHC cards are addressed by block, older cards by byte
+        uint32_t address = (this->card.type() == SD_CARD_TYPE_SDHC) ? this->block : this->block * SD_BLOCK_SIZE;
+        ok = this->command(SD_CMD_READ_MULTIPLE_BLOCK, address) == 0;
+        this->reading = ok;
+        this->crcPending = false;
+    }
+
+    while ( (ok) && (n > 0) ) {
+        if (this->blockLeft == 0) {
+            ok = this->startBlock();
+            if (!ok) { break; }
+
+            // First block may start before requested offset
+            for (; this->skip > 0; this->skip--, this->blockLeft--) { SPI.transfer(0xFF); }
+        }
+
+        uint16_t k = min(n, this->blockLeft);
+        memset(dst, 0xFF, k);
+        SPI.transfer(dst, k);
+
+        dst += k;
+        n -= k;
+        this->blockLeft -= k;
+        this->left -= k;
+        this->pos += k;
+        this->crcPending = (this->blockLeft == 0);
+    }
+
+    if (!this->held) { deselect(); }
+
+    if (!ok) { this->stop(); }
+    return ok;
+}
+
+void RawStream::beginBurst() {
+    if ( (this->held) || (this->left == 0) ) { return; }
+
+    select();
+    this->held = true;
+}
+
+void RawStream::endBurst() {
+    if (!this->held) { return; }
+
+    this->held = false;
+    deselect();
+}
+
+void RawStream::stop() {
+    this->left = 0;
+
+    if (this->reading) {
+        if (!this->held) { select(); }
+
+        this->command(SD_CMD_STOP_TRANSMISSION, 0);
+
+        // Wait until card is not busy
+        uint32_t start = millis();
+        while ( (SPI.transfer(0xFF) != 0xFF) && (millis() - start < SD_READ_TIMEOUT) ) {}
+
+        if (!this->held) { deselect(); }
+        this->reading = false;
+    }
+
+    // SD library selects card on its own
+    this->endBurst();
+}
+
+void RawStream::close() {
+    this->stop();
+    this->fileSize = 0;
+    this->stamp = 0;
+}
+
+bool RawStream::isOpen() {
+    return this->left > 0;
+}
+
+uint32_t RawStream::position() {
+    return this->pos;
+}
+
+uint32_t RawStream::getFirstBlock() {
+    return this->firstBlock;
+}
+
+uint32_t RawStream::getFileSize() {
+    return this->fileSize;
+}
+
+uint32_t RawStream::getStamp() {
+    return this->stamp;
+}
+
+bool RawStream::isContiguous(const char *path) {
+    uint32_t first, size, stamp;
+    return this->fileRange(path, first, size, stamp);
+}
+
+bool RawStream::openFile(const char *path, SdFile &file) {
+    SdFile dirs[2];
+    SdFile *parent = &this->root;
+    uint8_t current = 0;
+    char name[13];
+
+    while (true) {
+        // Copy next path component
+        while (*path == '/') { path++; }
+        uint8_t len = 0;
+        while ( (*path) && (*path != '/') && (len < sizeof(name) - 1) ) { name[len++] = *path++; }
+        name[len] = '\0';
+
+        while (*path == '/') { path++; }
+        if (!*path) { break; }
+
+        // Open directory, parent is always the other one of dirs (or root)
+        dirs[current].close();
+        if (!dirs[current].open(parent, name, O_READ)) { return false; }
+        parent = &dirs[current];
+        current ^= 1;
+    }
+
+    return file.open(parent, name, O_READ);
+}
+
+bool RawStream::fileRange(const char *path, uint32_t &first, uint32_t &size, uint32_t &stamp) {
+    if (!this->ready) { return false; }
+
+    SdFile file;
+    if (!this->openFile(path, file)) { return false; }
+
+    // Copied or replaced file gets new clusters or write time, size is compared by caller
+    stamp = 0;
+    dir_t entry;
+    if (file.dirEntry(&entry)) {
+        stamp = file.firstCluster() ^ (((uint32_t)entry.lastWriteDate << 16) | entry.lastWriteTime);
+    }
+
+    uint32_t last;
+    bool contiguous = file.contiguousRange(&first, &last);
+    size = file.fileSize();
+    file.close();
+
+    return contiguous;
+}
+
+bool RawStream::startBlock() {
+    if (this->crcPending) {
+        SPI.transfer(0xFF);
+        SPI.transfer(0xFF);
+        this->crcPending = false;
+    }
+
+    uint32_t start = millis();
+    uint8_t token;
+    while ( (token = SPI.transfer(0xFF)) == 0xFF ) {
+        if (millis() - start > SD_READ_TIMEOUT) { return false; }
+    }
+
+    if (token != SD_DATA_START_TOKEN) { return false; }
+
+    this->blockLeft = SD_BLOCK_SIZE;
+    return true;
+}
+
+uint8_t RawStream::command(uint8_t cmd, uint32_t arg) {
+    SPI.transfer(0x40 | cmd);
+    for (int8_t s = 24; s >= 0; s -= 8) { SPI.transfer(arg >> s); }
+    SPI.transfer(0xFF); // CRC is not checked in SPI mode
+
+    // Stop command is followed by stuff byte
+    if (cmd == SD_CMD_STOP_TRANSMISSION) { SPI.transfer(0xFF); }
+
+    uint8_t r1 = 0xFF;
+    for (uint8_t i = 0; (i < 10) && (r1 & 0x80); i++) { r1 = SPI.transfer(0xFF); }
+    return r1;
+}
+
+void RawStream::select() {
+    SPIBus::acquire(SPIBus::SD_CARD);
+    SPI.beginTransaction(SPIBus::settings(SPIBus::SD_CARD));
+    digitalWrite(this->csPin, LOW);
+}
+
+void RawStream::deselect() {
+    digitalWrite(this->csPin, HIGH);
+    SPI.transfer(0xFF); // Card releases MISO after next clock
+    SPI.endTransaction();
+    SPIBus::release();
+}
@@ -0,0 +1,85 @@
+/*
+RawStream.h
+
+RawStream reads contiguous files with single multi block read command (CMD18),
+without FAT lookups and without copying data through SD library block cache.
+Fragmented files are refused, SDStorage reads them with SD library.
+Chip select is released between reads, so display and touch can use SPI bus, reads of one portion
+of image can be joined into burst with single chip select assertion (beginBurst(), endBurst()).
+
+RawStream keeps its own card, volume and root objects of SD library utility classes,
+volume block cache is static in SD library, so it is shared with SD object.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <SD.h>
+
+#include "../SPIBus/SPIBus.h"
+
+#define SD_BLOCK_SIZE 512
+#define SD_CMD_READ_MULTIPLE_BLOCK 18
+#define SD_CMD_STOP_TRANSMISSION 12
+#define SD_CMD_SEND_STATUS 13
+#define SD_DATA_START_TOKEN 0xFE
+#define SD_READ_TIMEOUT 300 // Time to wait for data block [ms]
+
+class RawStream {
+public:
+    RawStream(uint8_t csPin);
+
+    bool begin(); // Must be called after SD.begin(), again after card was mounted again
+    bool probe(); // True if card answers status command, false after card removal
+    bool open(const char *path, uint32_t offset); // Prepare streaming of file from offset, return false if file is fragmented (its stamp is still read)
+    bool open(uint32_t firstBlock, uint32_t fileSize, uint32_t offset); // Prepare streaming of file opened before, no directory lookup needed
+    bool seek(uint32_t offset); // Continue streaming of opened file from offset, no FAT lookups needed
+    bool read(void *buffer, uint16_t n); // Read next n bytes of file, stream is stopped on error
+    void beginBurst(); // Keep card selected for following reads until endBurst() or stop(), no other device may use bus meanwhile
+    void endBurst(); // Release card selected by beginBurst()
+    void stop(); // End multi block read and burst, must be called before SD library accesses card
+    void close(); // Stop and forget opened file and its stamp
+    bool isOpen();
+    uint32_t position(); // Offset in file of next byte to read
+    bool isContiguous(const char *path);
+    uint32_t getFirstBlock(); // First block of opened file
+    uint32_t getFileSize(); // Size of opened file, 0 if no file opened
+    uint32_t getStamp(); // First cluster and write time from directory entry of file opened by path (also fragmented), changes when file is replaced, 0 if card was not initialized
+
+private:
+    Sd2Card card;
+    SdVolume volume;
+    SdFile root;
+    uint8_t csPin;
+    bool ready; // True if card and volume were initialized
+    bool reading; // True if multi block read command was sent
+    bool crcPending; // True if CRC of previous block was not read yet
+    bool held; // True if card stays selected between reads (burst)
+    uint32_t firstBlock; // First block of opened file
+    uint32_t fileSize; // Size of opened file, 0 if no file opened
+    uint32_t stamp; // Stamp of file opened by path, 0 after close
+    uint32_t block; // First block of multi block read
+    uint32_t pos; // Offset in file of next byte to read
+    uint32_t left; // Bytes left in file
+    uint16_t blockLeft; // Bytes left in current block
+    uint16_t skip; // Bytes to skip at the beginning of first block
+
+    bool openFile(const char *path, SdFile &file); // Open file walking through path directories
+    bool fileRange(const char *path, uint32_t &first, uint32_t &size, uint32_t &stamp); // Get first block, size and stamp of file, return false if it is fragmented
+    bool startBlock(); // Wait for data token of next block
+    uint8_t command(uint8_t cmd, uint32_t arg); // Send command, return R1 response
+    void select();
+    void deselect();
+};
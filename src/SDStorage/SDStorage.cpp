@@ -19,12 +19,70 @@ along with this program.  If not, see https://www.gnu.org/licenses/.
 
 #include "SDStorage.h"
 
-SDStorage::SDStorage(uint8_t SD_CS_PIN, uint16_t disWidth, uint16_t disHeight, String imageDir):
+// Paths are built in arena path region, which fits path of image in deepest album
+
+// Append s to path ending at end, return new end
+static char *appendPath(char *end, const char *s) {
+    char *last = Arena::path() + Arena::pathSize - 1;
+    while ( (*s) && (end < last) ) { *end++ = *s++; }
+    *end = '\0';
+    return end;
+}
+
+// Write dir/name into arena
+static char *buildPath(const char *dir, const char *name) {
+    char *end = appendPath(Arena::path(), dir);
+    end = appendPath(end, "/");
+    appendPath(end, name);
+    return Arena::path();
+}
+
+// Write dir/number followed by extension into arena
+static char *buildPath(const char *dir, uint32_t number, const char *extension) {
+    char digits[11];
+    uint8_t i = sizeof(digits) - 1;
+    digits[i] = '\0';
+    do {
+        digits[--i] = '0' + number % 10;
+        number /= 10;
+    } while (number);
+
+    char *end = appendPath(Arena::path(), dir);
+    end = appendPath(end, "/");
+    end = appendPath(end, &digits[i]);
+    appendPath(end, extension);
+    return Arena::path();
+}
+
+SDStorage::SDStorage(uint8_t SD_CS_PIN, uint16_t disWidth, uint16_t disHeight, const char *imageDir):
+    csPin(SD_CS_PIN),
+    imageDirPath(imageDir),
+    imagesInDirN(0),
+    indexAlbums(0),
     err(false),
-    imageNumber(UINT16_MAX),
+    imageNumber(UINT32_MAX),
     disWidth(disWidth),
-    disHeight(disHeight)
+    disHeight(disHeight),
+    format(BMP24),
+    packetLeft(0),
+    runColor(0),
+    inRun(false),
+    dataOffset(0),
+    dataSize(0),
+    flags(0),
+    framesOffset(0),
+    framesN(0),
+    frame(0),
+    raw(SD_CS_PIN),
+    cacheLeft(0),
+    cacheSourceSize(0),
+    cacheSourceStamp(0),
+    cacheMiss(false),
+    cached(false),
+    orderKept(false)
 {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+
     // Initialize SD card
     pinMode(SD_CS_PIN, OUTPUT);
     digitalWrite(SD_CS_PIN, 1);
@@ -33,7 +91,14 @@ SDStorage::SDStorage(uint8_t SD_CS_PIN, uint16_t disWidth, uint16_t disHeight, S
     // Do not open directories if not initialized (SD card not inserted?)
     if (err) {return; }
 
+    // Images can still be read with SD library if raw streaming is not available
+    this->raw.begin();
+
     this->imageDir = SD.open(imageDir);
+
+    // Indexed images are counted by index, album directories are never listed
+    if (this->openIndex()) { return; }
+
     this->nextImage();
 
     this->countImages();
@@ -43,7 +108,7 @@ File SDStorage::getCurrentImage() {
     return this->currentImage;
 }
 
-uint16_t SDStorage::getImageNumber() {
+uint32_t SDStorage::getImageNumber() {
     return this->imageNumber;
 }
 
@@ -51,15 +116,59 @@ uint32_t SDStorage::imagesInDir() {
     return this->imagesInDirN;
 }
 
+bool SDStorage::isIndexed() {
+    return this->indexAlbums > 0;
+}
+
 void SDStorage::countImages() {
 	this->imagesInDirN = 0;
 
 	// Count images until same image occurred after directory rewind
-	String name = this->getCurrentImage().name();
+	char name[INDEX_NAME_LEN + 1] = {};
+	strncpy(name, this->getCurrentImage().name(), INDEX_NAME_LEN);
 	do {
 		imagesInDirN++;
 		this->nextImage();
-	} while (name != this->getCurrentImage().name());
+	} while (strcmp(name, this->getCurrentImage().name()) != 0);
+}
+
+bool SDStorage::cardPresent() {
+    return this->raw.probe();
+}
+
+bool SDStorage::remount() {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->closeImage();
+    this->imageDir.close();
+    SD.end();
+
+    this->err = !SD.begin(this->csPin);
+    if (this->err) { return false; }
+
+    this->raw.begin();
+    this->orderKept = false;
+    this->imageDir = SD.open(this->imageDirPath);
+    if (!this->imageDir) {
+        this->err = true;
+        return false;
+    }
+
+    if (this->openIndex()) {
+        // Index of new card holds number of images
+        this->imageNumber = 0;
+    } else if (this->imagesInDirN == 0) {
+        // Card was not mounted before, all images are counted
+        this->nextImage();
+        if (this->err) { return false; }
+        this->countImages();
+    } else {
+        // Only images added or removed while card was out are looked up
+        this->imagesInDirN = rescanImages(this->imagesInDirN, [&](uint32_t n) { return SD.exists(buildPath(this->imageDirPath, n, ".bmp")); });
+        this->imageNumber = 0;
+    }
+
+    this->err = (this->imagesInDirN == 0);
+    return !this->err;
 }
 
 bool SDStorage::error() {
@@ -67,8 +176,23 @@ bool SDStorage::error() {
 }
 
 uint16_t SDStorage::nextImage() {
+    SPIBus::Use bus(SPIBus::SD_CARD);
     uint16_t skipped = 0;
 
+    // Indexed images follow id order
+    if (this->indexAlbums > 0) {
+        for (uint32_t i = 0; i < this->imagesInDirN; i++) {
+            uint32_t id = (this->imageNumber + 1 < this->imagesInDirN) ? this->imageNumber + 1 : 0;
+            if (this->toImage(id)) { return skipped; }
+            skipped++;
+        }
+
+        this->err = true;
+        return skipped;
+    }
+
+    this->closeImage();
+
     while (true) {
         this->currentImage.close();
         this->currentImage = this->imageDir.openNextFile();
@@ -81,9 +205,9 @@ uint16_t SDStorage::nextImage() {
             this->imageNumber = 0;
         }
 
-        if (this->currentImage == NULL) {
+        if (!this->currentImage) {
             this->err = true;
-            return;
+            return skipped;
         }
 
         if (this->validateImage(this->currentImage)) { break; }
@@ -91,43 +215,453 @@ uint16_t SDStorage::nextImage() {
     }
 
     this->imageNumber++;
+    this->streamImage(buildPath(this->imageDir.name(), this->currentImage.name()));
     return skipped;
 }
 
-bool SDStorage::toImage(String image) {
-    this->currentImage.close();
+bool SDStorage::toImage(const char *image) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->closeImage();
     this->currentImage = SD.open(image);
     
-    if (this->currentImage == NULL) {
+    if (!this->currentImage) {
         this->err = true;
     }
     
-    return this->validateImage(this->currentImage);
+    if (!this->validateImage(this->currentImage)) { return false; }
+
+    this->streamImage(image);
+    return true;
 }
 
-bool SDStorage::toImage(uint16_t imagePos) {
-    this->imageNumber = imagePos;
+void SDStorage::closeImage() {
+    this->stopCaching();
+    this->cacheMiss = false;
+    this->cached = false;
 
-    String name = this->imageDir.name();
-    name += String('/') + String(imagePos) + ".bmp";
-    return this->toImage(name);
+    this->raw.close();
+    this->currentImage.close();
 }
 
-uint16_t SDStorage::RGB24ToRGB16(uint8_t r, uint8_t g, uint8_t b) {
-    return (( (r) >> 3 ) << 11 ) | (( (g) >> 2 ) << 5) | ( (b) >> 3);
+void SDStorage::streamImage(const char *path) {
+    // Fragmented image is read with SD library
+    this->raw.open(path, this->dataOffset);
 }
 
-void SDStorage::readImagePortion(uint16_t *buffer, uint16_t size) {
-    uint8_t pixels[size*3];
-    int err = this->currentImage.read(pixels, size*3);
+bool SDStorage::toImage(uint32_t id) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->imageNumber = id;
+
+    bool opened = (this->indexAlbums > 0) ? this->toIndexEntry(id) : this->toImage(this->imagePath(id));
+    if (opened) { this->toCachedCopy(); }
+    return opened;
+}
+
+bool SDStorage::openImage(const char *path, uint8_t format, uint8_t flags, uint16_t dataOffset, uint32_t dataSize, uint32_t fileSize) {
+    this->closeImage();
+    this->currentImage = SD.open(path);
+
+    // Image replaced after index or playlist was built is validated again
+    if ( (!this->currentImage) || (this->currentImage.size() != fileSize) || (format > RLE16) ) {
+        return this->toImage(path);
+    }
 
-    if (err == -1) {
+    this->format = (Format)format;
+    this->flags = flags;
+    this->dataOffset = dataOffset;
+    this->dataSize = dataSize;
+    this->packetLeft = 0;
+    this->inRun = false;
+
+    this->currentImage.seek(dataOffset);
+    this->streamImage(path);
+    return true;
+}
+
+bool SDStorage::openIndex() {
+    this->raw.stop();
+    this->indexAlbums = 0;
+
+    File index = SD.open(INDEX_FILE);
+    if (!index) { return false; }
+
+    if (this->readLittleIndian16(index) == INDEX_MAGIC) {
+        uint16_t albums = this->readLittleIndian16(index);
+        uint32_t images = this->readLittleIndian32(index);
+
+        // Empty index is ignored, images directory is listed instead
+        if ( (albums > 0) && (images > 0) ) {
+            this->indexAlbums = albums;
+            this->imagesInDirN = images;
+        }
+    }
+
+    index.close();
+    return this->indexAlbums > 0;
+}
+
+bool SDStorage::toIndexEntry(uint32_t id) {
+    this->raw.stop();
+    if (id >= this->imagesInDirN) { return false; }
+
+    File index = SD.open(INDEX_FILE);
+
+    // Entries have fixed size, image is found without searching
+    if ( (!index) || (!index.seek(indexEntryOffset(this->indexAlbums, id))) ) {
+        index.close();
         this->err = true;
+        return false;
+    }
+
+    uint16_t album = this->readLittleIndian16(index);
+    uint8_t format = index.read();
+    uint8_t flags = index.read();
+    uint16_t dataOffset = this->readLittleIndian16(index);
+    this->readLittleIndian16(index); // Reserved
+    uint32_t dataSize = this->readLittleIndian32(index);
+    uint32_t fileSize = this->readLittleIndian32(index);
+
+    char name[INDEX_NAME_LEN + 1] = {};
+    if (index.read(name, INDEX_NAME_LEN) != INDEX_NAME_LEN) {
+        index.close();
+        this->err = true;
+        return false;
+    }
+
+    appendPath(this->albumPath(index, album), name);
+    index.close();
+
+    return this->openImage(Arena::path(), format, flags, dataOffset, dataSize, fileSize);
+}
+
+char *SDStorage::albumPath(File &index, uint16_t album) {
+    char *path = Arena::path();
+    uint8_t len = 0;
+    char name[INDEX_NAME_LEN + 1] = {};
+    path[0] = '\0';
+
+    // Names are collected from album up to images directory (album 0), its name is not stored
+    for (uint8_t depth = 0; (album < this->indexAlbums) && (depth <= INDEX_MAX_DEPTH); depth++) {
+        index.seek(INDEX_HEADER_SIZE + (uint32_t)album * INDEX_ALBUM_SIZE);
+        album = this->readLittleIndian16(index);
+
+        index.seek(index.position() + INDEX_ALBUM_SIZE - INDEX_NAME_LEN - 2);
+        index.read(name, INDEX_NAME_LEN);
+        if (name[0] != '\0') { len = this->prependAlbum(name, len); }
+    }
+
+    len = this->prependAlbum(this->imageDir.name(), len);
+    return path + len;
+}
+
+uint8_t SDStorage::prependAlbum(const char *name, uint8_t len) {
+    char *path = Arena::path();
+    uint8_t n = strlen(name);
+    if (len + n + 1 >= Arena::pathSize) { return len; }
+
+    memmove(path + n + 1, path, len + 1);
+    memcpy(path, name, n);
+    path[n] = '/';
+    return len + n + 1;
+}
+
+char *SDStorage::imagePath(uint32_t id) {
+    if (this->indexAlbums == 0) { return buildPath(this->imageDir.name(), id, ".bmp"); }
+
+    File index = SD.open(INDEX_FILE);
+    uint32_t offset = indexEntryOffset(this->indexAlbums, id);
+    char name[INDEX_NAME_LEN + 1] = {};
+
+    // Index was valid when card was mounted, if it cannot be read now image is looked up by number as in plain directory
+    if ( (!index) || (!index.seek(offset + INDEX_ENTRY_SIZE - INDEX_NAME_LEN)) || (index.read(name, INDEX_NAME_LEN) != INDEX_NAME_LEN) ) {
+        index.close();
+        this->err = true;
+        return buildPath(this->imageDir.name(), id, ".bmp");
+    }
+
+    index.seek(offset);
+    uint16_t album = this->readLittleIndian16(index);
+    appendPath(this->albumPath(index, album), name);
+    index.close();
+    return Arena::path();
+}
+
+SDStorage::ImageInfo SDStorage::getImageInfo() {
+    ImageInfo info;
+    info.number = this->imageNumber;
+    info.format = this->format;
+    info.flags = this->flags;
+    info.dataOffset = this->dataOffset;
+    info.dataSize = this->dataSize;
+
+    // Only streamed images can be opened again without directory lookup, copy may be evicted later
+    info.firstBlock = this->raw.getFirstBlock();
+    info.fileSize = this->cached ? 0 : this->raw.getFileSize();
+    return info;
+}
+
+bool SDStorage::toImage(const ImageInfo &info) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    if (info.fileSize == 0) { return this->toImage(info.number); }
+
+    this->closeImage();
+
+    // Header was validated when image was opened first time
+    this->imageNumber = info.number;
+    this->format = (Format)info.format;
+    this->flags = info.flags;
+    this->dataOffset = info.dataOffset;
+    this->dataSize = info.dataSize;
+    this->packetLeft = 0;
+    this->inRun = false;
+
+    if (this->raw.open(info.firstBlock, info.fileSize, info.dataOffset)) { return true; }
+    return this->toImage(info.number);
+}
+
+bool SDStorage::toThumbnail(uint32_t imagePos) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->closeImage();
+    this->currentImage = SD.open(THUMBS_FILE);
+
+    // Missing thumbnails are not sd card error
+    if (!this->currentImage) { return false; }
+
+    if ( (this->readLittleIndian16(this->currentImage) != THUMBS_MAGIC)
+        || (this->readLittleIndian16(this->currentImage) != THUMB_WIDTH)
+        || (this->readLittleIndian16(this->currentImage) != THUMB_HEIGHT)
+        || (this->readLittleIndian16(this->currentImage) <= imagePos) )
+    {
+        return false;
+    }
+
+    this->format = RGB565;
+    this->flags = 0;
+    this->packetLeft = 0;
+    this->inRun = false;
+    this->dataOffset = THUMBS_HEADER_SIZE + imagePos * THUMB_SIZE;
+    this->dataSize = THUMB_SIZE;
+
+    this->currentImage.seek(this->dataOffset);
+    this->streamImage(THUMBS_FILE);
+    return true;
+}
+
+void SDStorage::readImagePortion(uint16_t *buffer, uint16_t size) {
+    // Packets and pixels of portion are read with single chip select assertion of streamed card
+    this->raw.beginBurst();
+    this->readPortion(buffer, size);
+    this->raw.endBurst();
+}
+
+void SDStorage::readPortion(uint16_t *buffer, uint16_t size) {
+    if (this->format == RLE16) {
+        this->readRLE16Portion(buffer, size);
+        return;
+    }
+
+    // Stored as little endian RGB565, same as buffer in memory
+    if (this->format == RGB565) {
+        this->readImageData(buffer, size*2);
         return;
     }
+
+    // Pixel i is converted into bytes 2i and 2i+1, which were already read as pixels <= i
+    uint8_t *pixels = (uint8_t*)buffer;
+    if (!this->readImageData(pixels, size*3)) { return; }
     
     for (uint16_t i  = 0; i < size; i++) {
-        buffer[i] = this->RGB24ToRGB16(pixels[i*3 + 2], pixels[i*3 + 1], pixels[i*3 + 0]);
+        buffer[i] = RGB24ToRGB16(pixels[i*3 + 2], pixels[i*3 + 1], pixels[i*3 + 0]);
+    }
+}
+
+bool SDStorage::isInterlaced() {
+    return this->flags & BMP_FLAG_INTERLACED;
+}
+
+bool SDStorage::canSeekRows() {
+    // Compressed rows have variable size
+    return this->format != RLE16;
+}
+
+void SDStorage::seekRow(uint16_t row) {
+    uint8_t bytesPerPixel = (this->format == BMP24) ? 3 : 2;
+    uint32_t rowBytes = ((uint32_t)this->disWidth * bytesPerPixel + 3) & ~3UL;
+    this->seekData(this->dataOffset + row * rowBytes);
+}
+
+void SDStorage::seekData(uint32_t offset) {
+    // Raw seek fails if current image is not streamed
+    if (this->raw.seek(offset)) { return; }
+
+    SPIBus::acquire(SPIBus::SD_CARD);
+    this->currentImage.seek(offset);
+    SPIBus::release();
+}
+
+uint8_t SDStorage::readCaption(char *text, uint8_t size) {
+    text[0] = '\0';
+    if (!(this->flags & BMP_FLAG_CAPTION)) { return 0; }
+
+    // Caption is placed between header and pixel data
+    uint8_t length = 0;
+    this->seekData(BMP_HEADER_SIZE);
+    if (this->readImageData(&length, 1)) {
+        length = min(length, (uint8_t)(size - 1));
+        if (!this->readImageData(text, length)) { length = 0; }
+    }
+
+    text[length] = '\0';
+    this->seekData(this->dataOffset);
+
+    return length;
+}
+
+bool SDStorage::isAnimated() {
+    return this->flags & BMP_FLAG_ANIMATION;
+}
+
+uint16_t SDStorage::startAnimation() {
+    // Animation header follows first frame
+    this->seekData(this->dataOffset + this->dataSize);
+
+    uint16_t header[3];
+    if ( (!this->readImageData(header, sizeof(header))) || (header[0] != ANIMATION_MAGIC) || (header[1] == 0) ) {
+        return 0;
+    }
+
+    this->framesN = header[1];
+    this->framesOffset = this->dataOffset + this->dataSize + sizeof(header);
+    this->frame = 0;
+
+    // Frames pixels are not compressed
+    this->format = RGB565;
+    return header[2];
+}
+
+uint16_t SDStorage::nextFrame() {
+    // Last frame goes back to first one, start again
+    if (this->frame >= this->framesN) {
+        this->seekData(this->framesOffset);
+        this->frame = 0;
+    }
+
+    this->frame++;
+
+    uint16_t rects = 0;
+    this->readImageData(&rects, 2);
+    return rects;
+}
+
+bool SDStorage::readFrameRect(uint16_t &x, uint16_t &y, uint16_t &width, uint16_t &height) {
+    uint16_t rect[4];
+    if (!this->readImageData(rect, sizeof(rect))) { return false; }
+
+    x = rect[0];
+    y = rect[1];
+    width = rect[2];
+    height = rect[3];
+
+    // Rectangle outside of display would break display window
+    return (x + width <= this->disWidth) && (y + height <= this->disHeight);
+}
+
+bool SDStorage::readImageData(void *buffer, uint16_t n) {
+    if (this->raw.isOpen()) {
+        uint32_t start = this->raw.position();
+        if (this->raw.read(buffer, n)) {
+            PROFILE_ADD(SD_BYTES, n);
+            PROFILE_ADD(SD_RAW_BYTES, n);
+            return true;
+        }
+
+        // Card refused raw read, part of buffer may be filled, rest of image is read with SD library from start of read
+        SPIBus::Use bus(SPIBus::SD_CARD);
+        this->raw.close();
+        if (!this->currentImage) { this->currentImage = SD.open(this->imagePath(this->imageNumber)); }
+        this->currentImage.seek(start);
+    }
+
+    // Card is accessed only when read does not fit in already cached block
+    uint32_t pos = this->currentImage.position();
+    bool access = (pos % SD_BLOCK_SIZE == 0) || (pos / SD_BLOCK_SIZE != (pos + n - 1) / SD_BLOCK_SIZE);
+    if (access) { SPIBus::acquire(SPIBus::SD_CARD); }
+
+    int read = this->currentImage.read(buffer, n);
+    if (access) { SPIBus::release(); }
+
+    if (read == -1) {
+        this->err = true;
+        return false;
+    }
+
+    PROFILE_ADD(SD_BYTES, n);
+    return true;
+}
+
+uint32_t SDStorage::dataPosition() {
+    // File of SD library is not read (nor always opened) while image is streamed
+    return this->raw.isOpen() ? this->raw.position() : this->currentImage.position();
+}
+
+uint16_t SDStorage::readSolidSpan(uint16_t &color, uint16_t maxSize) {
+    // Only compressed images know about solid spans without reading pixels
+    if (this->format != RLE16) { return 0; }
+
+    if (this->packetLeft == 0) {
+        this->raw.beginBurst();
+        this->readRLE16Packet();
+        this->raw.endBurst();
+    }
+
+    if (!this->inRun) { return 0; }
+
+    uint16_t n = min(this->packetLeft, maxSize);
+    this->packetLeft -= n;
+    color = this->runColor;
+
+    PROFILE_ADD(SOLID_PIXELS, n);
+    return n;
+}
+
+void SDStorage::readRLE16Portion(uint16_t *buffer, uint16_t size) {
+    uint16_t i = 0;
+
+    while (i < size) {
+        if (this->packetLeft == 0) {
+            this->readRLE16Packet();
+            if (this->err) { return; }
+        }
+
+        uint16_t n = min(this->packetLeft, (uint16_t)(size - i));
+
+        if (this->inRun) {
+            for (uint16_t j = 0; j < n; j++) { buffer[i + j] = this->runColor; }
+        } else {
+            // Literal pixels are stored as little endian RGB565, same as buffer in memory
+            if (!this->readImageData(&buffer[i], n*2)) { return; }
+        }
+
+        i += n;
+        this->packetLeft -= n;
+    }
+}
+
+void SDStorage::readRLE16Packet() {
+    // Image data ended before all pixels were read
+    if (this->dataPosition() >= this->dataOffset + this->dataSize) {
+        this->err = true;
+        return;
+    }
+
+    uint16_t header;
+    if (!this->readImageData(&header, 2)) { return; }
+
+    this->inRun = header & RLE16_RUN_FLAG;
+    this->packetLeft = (header & RLE16_COUNT_MASK) + 1;
+
+    if (this->inRun) {
+        this->readImageData(&this->runColor, 2);
     }
 }
 
@@ -141,8 +675,10 @@ bool SDStorage::validateImage(File &image) {
     // Read and ignore size
     this->readLittleIndian32(image);
 
-    // Read and ignore creator bytes
-    this->readLittleIndian32(image);
+    // Reserved bytes hold flags of images prepared for frame
+    uint16_t signature = this->readLittleIndian16(image);
+    uint16_t flags = this->readLittleIndian16(image);
+    this->flags = (signature == BMP_FRAME_SIGNATURE) ? flags : 0;
 
     // Offset between file head and image
     uint32_t offset = this->readLittleIndian32(image);
@@ -164,14 +700,31 @@ bool SDStorage::validateImage(File &image) {
         return false;
     }
 
-    this->readLittleIndian16(image);
-    
-    if (this->readLittleIndian32(image) != 0) {
+    uint16_t bitsPerPixel = this->readLittleIndian16(image);
+    uint32_t compression = this->readLittleIndian32(image);
+
+    if ( (bitsPerPixel == 24) && (compression == BMP_COMPRESSION_NONE) ) {
+        this->format = BMP24;
+    } else if ( (bitsPerPixel == 16) && (compression == BMP_COMPRESSION_BITFIELDS) ) {
+        this->format = RGB565;
+    } else if ( (bitsPerPixel == 16) && (compression == BMP_COMPRESSION_RLE16) ) {
+        this->format = RLE16;
+    } else {
         return false;
     }
 
+    // Size may be 0 for uncompressed images
+    this->dataSize = this->readLittleIndian32(image);
+    if (this->dataSize == 0) {
+        this->dataSize = (uint32_t)disWidth * disHeight * bitsPerPixel / 8;
+    }
+
+    this->packetLeft = 0;
+    this->inRun = false;
+
     // Move to data
     image.seek(offset);
+    this->dataOffset = offset;
 
     return true;
 }
@@ -197,7 +750,214 @@ uint32_t SDStorage::readLittleIndian32(File f) {
     return d;
 }
 
+void SDStorage::writeLittleIndian16(File f, uint16_t d) {
+    f.write(d & 0xFF);
+    f.write(d >> 8);
+}
+
+void SDStorage::writeLittleIndian32(File f, uint32_t d) {
+    this->writeLittleIndian16(f, d & 0xFFFF);
+    this->writeLittleIndian16(f, d >> 16);
+}
+
+int32_t SDStorage::pickWeighted(uint16_t slot, uint16_t coin) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->raw.stop();
+    File file = SD.open(WEIGHTS_FILE);
+    if (!file) { return -1; }
+
+    int32_t image = -1;
+
+    // Table is valid only for number of images it was built for
+    if ( (this->readLittleIndian16(file) == WEIGHTS_MAGIC) && (this->readLittleIndian16(file) == this->imagesInDirN) && (slot < this->imagesInDirN) ) {
+        file.seek(WEIGHTS_HEADER_SIZE + (uint32_t)slot * WEIGHTS_ENTRY_SIZE);
+        uint16_t threshold = this->readLittleIndian16(file);
+        uint16_t alias = this->readLittleIndian16(file);
+
+        if (alias < this->imagesInDirN) { image = aliasPick(slot, coin, threshold, alias); }
+    }
+
+    file.close();
+    return image;
+}
+
+int32_t SDStorage::pickLeastRecent() {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->raw.stop();
+    if ( (this->imagesInDirN == 0) || (this->imagesInDirN >= ORDER_NONE) ) { return -1; }
+
+    File file = SD.open(ORDER_FILE, O_READ | O_WRITE | O_CREAT);
+    this->orderKept = file;
+    if (!file) { return -1; }
+
+    // List starts again when images were added or removed
+    uint16_t n = this->imagesInDirN;
+    if ( (this->readLittleIndian16(file) != ORDER_MAGIC) || (this->readLittleIndian16(file) != n) ) {
+        if (!this->createOrder(file)) {
+            file.close();
+            return -1;
+        }
+    }
+
+    // Picked image stays at head until markShown moves it, so nothing is written
+    file.seek(4);
+    uint16_t head = this->readLittleIndian16(file);
+
+    file.close();
+    return (head < n) ? head : -1;
+}
+
+void SDStorage::markShown(uint32_t id) {
+    // Order is kept only after least recent pick opened the file, cards without it are not opened
+    if ( (!this->orderKept) || (id >= this->imagesInDirN) || (this->imagesInDirN >= ORDER_NONE) ) { return; }
+
+    SPIBus::Use bus(SPIBus::SD_CARD);
+
+    bool streaming = this->raw.isOpen();
+    this->raw.stop();
+
+    File file = SD.open(ORDER_FILE, O_READ | O_WRITE);
+    this->orderKept = file;
+    if (file) {
+        uint16_t n = this->imagesInDirN;
+        if ( (this->readLittleIndian16(file) == ORDER_MAGIC) && (this->readLittleIndian16(file) == n) ) {
+            uint16_t head = this->readLittleIndian16(file);
+            uint16_t tail = this->readLittleIndian16(file);
+
+            // Image shown again needs no write
+            if (tail != id) {
+                file.seek(ORDER_HEADER_SIZE + id * ORDER_ENTRY_SIZE);
+                uint16_t prev = this->readLittleIndian16(file);
+                uint16_t next = this->readLittleIndian16(file);
+
+                if ( (head >= n) || (tail >= n) || (next >= n) || ( (prev != ORDER_NONE) && (prev >= n) ) ) {
+                    this->createOrder(file);
+                } else {
+                    this->moveToTail(file, id, prev, next, head, tail);
+                }
+            }
+        }
+
+        file.close();
+    }
+
+    // Stream stopped for sd library continues from the same place
+    if (streaming) { this->raw.seek(this->raw.position()); }
+}
+
+void SDStorage::forgetOrder() {
+    this->orderKept = false;
+}
+
+void SDStorage::moveToTail(File &file, uint16_t id, uint16_t prev, uint16_t next, uint16_t head, uint16_t tail) {
+    // Unlink image, it is not tail so next exists
+    if (prev != ORDER_NONE) {
+        file.seek(ORDER_HEADER_SIZE + (uint32_t)prev * ORDER_ENTRY_SIZE + 2);
+        this->writeLittleIndian16(file, next);
+    } else {
+        head = next;
+    }
+
+    file.seek(ORDER_HEADER_SIZE + (uint32_t)next * ORDER_ENTRY_SIZE);
+    this->writeLittleIndian16(file, prev);
+
+    // Link it after tail
+    file.seek(ORDER_HEADER_SIZE + (uint32_t)tail * ORDER_ENTRY_SIZE + 2);
+    this->writeLittleIndian16(file, id);
+
+    file.seek(ORDER_HEADER_SIZE + (uint32_t)id * ORDER_ENTRY_SIZE);
+    this->writeLittleIndian16(file, tail);
+    this->writeLittleIndian16(file, ORDER_NONE);
+
+    file.seek(4);
+    this->writeLittleIndian16(file, head);
+    this->writeLittleIndian16(file, id);
+}
+
+bool SDStorage::createOrder(File &file) {
+    uint16_t n = this->imagesInDirN;
+    uint8_t buffer[32];
+
+    file.seek(0);
+    this->writeLittleIndian16(file, ORDER_MAGIC);
+    this->writeLittleIndian16(file, n);
+    this->writeLittleIndian16(file, 0);
+    this->writeLittleIndian16(file, n - 1);
+
+    // Images never shown are equally old, directory order is used
+    for (uint32_t i = 0; i < n; i += sizeof(buffer) / ORDER_ENTRY_SIZE) {
+        uint16_t len = 0;
+        for (uint32_t j = i; (j < n) && (len < sizeof(buffer)); j++) {
+            uint16_t prev = (j > 0) ? j - 1 : ORDER_NONE;
+            uint16_t next = (j + 1 < n) ? j + 1 : ORDER_NONE;
+            buffer[len++] = prev & 0xFF;
+            buffer[len++] = prev >> 8;
+            buffer[len++] = next & 0xFF;
+            buffer[len++] = next >> 8;
+        }
+
+        if (file.write(buffer, len) != len) { return false; }
+    }
+
+    return true;
+}
+
+File SDStorage::openPlaylistFile(uint8_t list, uint16_t &entries) {
+    this->raw.stop();
+    File file = SD.open(buildPath(PLAYLISTS_DIR, list, ".bin"));
+
+    entries = 0;
+    if ( (file) && (this->readLittleIndian16(file) == PLAYLIST_MAGIC) ) {
+        entries = this->readLittleIndian16(file);
+    }
+
+    return file;
+}
+
+uint16_t SDStorage::openPlaylist(uint8_t list, char *name) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    uint16_t entries;
+    File file = this->openPlaylistFile(list, entries);
+    if (!file) { return 0; }
+
+    file.read(name, PLAYLIST_NAME_LEN);
+    name[PLAYLIST_NAME_LEN] = '\0';
+
+    file.close();
+    return entries;
+}
+
+bool SDStorage::toPlaylistEntry(uint8_t list, uint16_t entry) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    uint16_t entries;
+    File file = this->openPlaylistFile(list, entries);
+    if (!file) { return false; }
+
+    if (entry >= entries) {
+        file.close();
+        return false;
+    }
+
+    file.seek(PLAYLIST_HEADER_SIZE + (uint32_t)entry * PLAYLIST_ENTRY_SIZE);
+    uint16_t number = this->readLittleIndian16(file);
+    uint8_t format = file.read();
+    uint8_t flags = file.read();
+    uint16_t dataOffset = this->readLittleIndian16(file);
+    uint32_t dataSize = this->readLittleIndian32(file);
+    uint32_t fileSize = this->readLittleIndian32(file);
+    file.close();
+
+    // Playlist numbers are ids when images are indexed
+    this->imageNumber = number;
+    if (!this->openImage(this->imagePath(number), format, flags, dataOffset, dataSize, fileSize)) { return false; }
+
+    this->toCachedCopy();
+    return true;
+}
+
 void SDStorage::saveSettings(uint8_t *settings, uint16_t nBytes) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->raw.stop();
     File file = SD.open(SETTINGS_FILE, O_READ | O_WRITE | O_CREAT);
     file.seek(0);
 
@@ -208,7 +968,27 @@ void SDStorage::saveSettings(uint8_t *settings, uint16_t nBytes) {
     file.close();
 }
 
+bool SDStorage::writeFile(const char *path, void (*write)(Print &out)) {
+    bool streaming = this->raw.isOpen();
+    this->raw.stop();
+
+    SPIBus::acquire(SPIBus::SD_CARD);
+    File file = SD.open(path, O_WRITE | O_CREAT | O_TRUNC);
+    bool opened = file;
+    if (opened) {
+        write(file);
+        file.close();
+    }
+    SPIBus::release();
+
+    // Stream stopped for sd library continues from the same place
+    if (streaming) { this->raw.seek(this->raw.position()); }
+    return opened;
+}
+
 void SDStorage::loadSettings(uint8_t *settings, uint16_t nBytes) {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->raw.stop();
     if (!SD.exists(SETTINGS_FILE)) {
         for (uint16_t i = 0; i < nBytes; i++) {
             settings[i] = 0;
@@ -223,3 +1003,259 @@ void SDStorage::loadSettings(uint8_t *settings, uint16_t nBytes) {
 
     file.close();
 }
+
+uint16_t SDStorage::checkFragmentation() {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->raw.stop();
+
+    uint16_t fragmented = 0;
+
+    for (uint32_t i = 0; i < this->imagesInDirN; i++) {
+        char *path = this->imagePath(i);
+        if (this->raw.isContiguous(path)) { continue; }
+
+        fragmented++;
+        if (Serial) {
+            Serial.print(F("Fragmented image: "));
+            Serial.println(path);
+        }
+    }
+
+    // Current image stream was stopped, continue with SD library
+    this->currentImage.seek(this->dataOffset);
+    return fragmented;
+}
+
+bool SDStorage::isCached() {
+    return this->cached;
+}
+
+char *SDStorage::cachePath(uint32_t id) {
+    return buildPath(CACHE_DIR, id, ".bmp");
+}
+
+bool SDStorage::toCachedCopy() {
+    // Other formats are read without conversion, frame specific images keep their features
+    if ( (!CACHE_IMAGES) || (this->format != BMP24) || (this->flags != 0) || (this->imageNumber > CACHE_MAX_ID) || (this->raw.getStamp() == 0) ) {
+        return false;
+    }
+
+    this->cacheSourceSize = this->currentImage.size();
+    this->cacheSourceStamp = this->raw.getStamp();
+    this->raw.stop();
+
+    char *path = this->cachePath(this->imageNumber);
+    uint32_t dataSize = (uint32_t)this->disWidth * this->disHeight * 2;
+    File copy = SD.open(path);
+
+    bool valid = (copy) && (copy.size() == CACHE_DATA_OFFSET + dataSize) && (this->readLittleIndian16(copy) == BMP_MAGIC);
+    if (valid) {
+        copy.seek(CACHE_STAMP_OFFSET);
+        valid = (this->readLittleIndian32(copy) == this->cacheSourceSize)
+            && (this->readLittleIndian32(copy) == this->cacheSourceStamp)
+            && (this->markCacheSlot(this->readLittleIndian16(copy), this->imageNumber));
+    }
+
+    if (!valid) {
+        copy.close();
+        this->cacheMiss = true;
+        this->seekData(this->dataOffset);
+        PROFILE_ADD(CACHE_MISSES, 1);
+        return false;
+    }
+
+    this->closeImage();
+    this->currentImage = copy;
+    this->cached = true;
+    this->format = RGB565;
+    this->dataOffset = CACHE_DATA_OFFSET;
+    this->dataSize = dataSize;
+
+    this->currentImage.seek(CACHE_DATA_OFFSET);
+    this->streamImage(path);
+    PROFILE_ADD(CACHE_HITS, 1);
+    return true;
+}
+
+void SDStorage::cacheStep() {
+    if (!this->cacheFile) {
+        // Copying starts after current image was displayed
+        if (!this->cacheMiss) { return; }
+        this->cacheMiss = false;
+
+        if (!this->startCaching()) {
+            this->stopCaching();
+            return;
+        }
+    }
+
+    uint32_t start = millis();
+    uint16_t *buffer = Arena::stream();
+
+    while ( (this->cacheLeft > 0) && (millis() - start < CACHE_STEP_MS) ) {
+        uint16_t n = min(this->cacheLeft, (uint32_t)CACHE_CHUNK);
+
+        // Stream stopped for sd library write continues from the same place
+        if ( (!this->raw.isOpen()) && (this->raw.getFileSize() > 0) ) { this->raw.seek(this->raw.position()); }
+
+        this->readImagePortion(buffer, n);
+        if (this->err) {
+            this->stopCaching();
+            return;
+        }
+
+        // Card is written only when write does not fit in cached block
+        uint32_t pos = this->cacheFile.position();
+        bool access = (pos % SD_BLOCK_SIZE == 0) || (pos / SD_BLOCK_SIZE != (pos + n*2 - 1) / SD_BLOCK_SIZE);
+        if (access) {
+            this->raw.stop();
+            SPIBus::acquire(SPIBus::SD_CARD);
+        }
+
+        size_t written = this->cacheFile.write((uint8_t*)buffer, n*2);
+        if (access) { SPIBus::release(); }
+
+        if (written != n*2) {
+            this->stopCaching();
+            return;
+        }
+
+        this->cacheLeft -= n;
+    }
+
+    PROFILE_ADD(CACHE_MS, millis() - start);
+    if (this->cacheLeft > 0) { return; }
+
+    // Copy becomes valid when all pixels are written
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->raw.stop();
+    this->cacheFile.seek(0);
+    this->writeLittleIndian16(this->cacheFile, BMP_MAGIC);
+    this->cacheFile.close();
+}
+
+bool SDStorage::startCaching() {
+    SPIBus::Use bus(SPIBus::SD_CARD);
+    this->raw.stop();
+    if (!SD.exists(CACHE_DIR)) { SD.mkdir(CACHE_DIR); }
+
+    int32_t slot = this->takeCacheSlot(this->imageNumber);
+    if (slot < 0) { return false; }
+
+    // Outdated or interrupted copy is overwritten
+    this->cacheFile = SD.open(this->cachePath(this->imageNumber), O_READ | O_WRITE | O_CREAT | O_TRUNC);
+    if (!this->cacheFile) { return false; }
+
+    uint32_t pixels = (uint32_t)this->disWidth * this->disHeight;
+    File f = this->cacheFile;
+
+    // BMP_MAGIC is written when copy is complete
+    this->writeLittleIndian16(f, 0);
+    this->writeLittleIndian32(f, CACHE_DATA_OFFSET + pixels * 2);
+    this->writeLittleIndian16(f, BMP_FRAME_SIGNATURE);
+    this->writeLittleIndian16(f, BMP_FLAG_CACHED);
+    this->writeLittleIndian32(f, CACHE_DATA_OFFSET);
+    this->writeLittleIndian32(f, BMP_INFO_HEADER_SIZE);
+    this->writeLittleIndian32(f, this->disWidth);
+    this->writeLittleIndian32(f, this->disHeight);
+    this->writeLittleIndian16(f, 1);
+    this->writeLittleIndian16(f, 16);
+    this->writeLittleIndian32(f, BMP_COMPRESSION_BITFIELDS);
+    this->writeLittleIndian32(f, pixels * 2);
+    for (uint8_t i = 0; i < 4; i++) { this->writeLittleIndian32(f, 0); }
+
+    // RGB565 bit fields masks
+    this->writeLittleIndian32(f, 0xF800);
+    this->writeLittleIndian32(f, 0x07E0);
+    this->writeLittleIndian32(f, 0x001F);
+
+    this->writeLittleIndian32(f, this->cacheSourceSize);
+    this->writeLittleIndian32(f, this->cacheSourceStamp);
+    this->writeLittleIndian16(f, slot);
+    this->writeLittleIndian16(f, 0);
+    this->writeLittleIndian16(f, 0);
+
+    this->cacheLeft = pixels;
+    this->seekData(this->dataOffset);
+    return true;
+}
+
+void SDStorage::stopCaching() {
+    // Copy without BMP_MAGIC is not read, it is overwritten when image is copied again
+    if (this->cacheFile) {
+        SPIBus::Use bus(SPIBus::SD_CARD);
+        this->cacheFile.close();
+    }
+
+    this->cacheLeft = 0;
+}
+
+int32_t SDStorage::takeCacheSlot(uint32_t id) {
+    File ring = SD.open(CACHE_RING, O_READ | O_WRITE | O_CREAT);
+    if (!ring) { return -1; }
+
+    // Ring is created again when missing or changed, copies missing in it are not read
+    if ( (this->readLittleIndian16(ring) != CACHE_MAGIC) || (this->readLittleIndian16(ring) != CACHE_MAX_IMAGES) ) {
+        ring.seek(0);
+        this->writeLittleIndian16(ring, CACHE_MAGIC);
+        this->writeLittleIndian16(ring, CACHE_MAX_IMAGES);
+        this->writeLittleIndian16(ring, 0);
+        for (uint16_t i = 0; i < CACHE_MAX_IMAGES; i++) { this->writeLittleIndian32(ring, CACHE_FREE); }
+    }
+
+    ring.seek(4);
+    uint16_t hand = this->readLittleIndian16(ring);
+    if (hand >= CACHE_MAX_IMAGES) { hand = 0; }
+
+    // Outdated or interrupted copy keeps its slot
+    int32_t slot = -1;
+    for (uint16_t i = 0; (i < CACHE_MAX_IMAGES) && (slot < 0); i++) {
+        uint32_t entry = this->readLittleIndian32(ring);
+        if ( (entry != CACHE_FREE) && ((entry & ~CACHE_REFERENCED) == id) ) { slot = i; }
+    }
+
+    // Clock hand clears referenced flags and evicts first copy without it, so copies read often stay
+    while (slot < 0) {
+        uint32_t offset = CACHE_HEADER_SIZE + (uint32_t)hand * CACHE_ENTRY_SIZE;
+        ring.seek(offset);
+        uint32_t entry = this->readLittleIndian32(ring);
+        ring.seek(offset);
+
+        if ( (entry != CACHE_FREE) && (entry & CACHE_REFERENCED) ) {
+            this->writeLittleIndian32(ring, entry & ~CACHE_REFERENCED);
+        } else {
+            if (entry != CACHE_FREE) { SD.remove(this->cachePath(entry)); }
+            this->writeLittleIndian32(ring, id);
+            slot = hand;
+        }
+
+        hand = (hand + 1) % CACHE_MAX_IMAGES;
+    }
+
+    ring.seek(4);
+    this->writeLittleIndian16(ring, hand);
+    ring.close();
+    return slot;
+}
+
+bool SDStorage::markCacheSlot(uint16_t slot, uint32_t id) {
+    File ring = SD.open(CACHE_RING, O_READ | O_WRITE);
+    if (!ring) { return false; }
+
+    bool valid = (this->readLittleIndian16(ring) == CACHE_MAGIC) && (slot < this->readLittleIndian16(ring));
+    if (valid) {
+        uint32_t offset = CACHE_HEADER_SIZE + (uint32_t)slot * CACHE_ENTRY_SIZE;
+        ring.seek(offset);
+        uint32_t entry = this->readLittleIndian32(ring);
+        valid = (entry != CACHE_FREE) && ((entry & ~CACHE_REFERENCED) == id);
+
+        // Flag is written only once per pass of clock hand, not on every read
+        if ( (valid) && (!(entry & CACHE_REFERENCED)) ) {
+            ring.seek(offset);
+            this->writeLittleIndian32(ring, entry | CACHE_REFERENCED);
+        }
+    }
+
+    ring.close();
+    return valid;
+}
@@ -3,7 +3,8 @@ SDStorage.h
 
 SDStorage class contains all SD related functions.
 This class is suited for digital picture display.
-All images should be 24bit bmp with resolution that exactly matches display.
+All images should be bmp with resolution that exactly matches display,
+supported formats are described in ImageFormat.h.
 
 Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
 
@@ -23,39 +24,152 @@ along with this program.  If not, see https://www.gnu.org/licenses/.
 
 #include <SD.h>
 
+#include "ImageFormat.h"
+#include "RawStream.h"
+#include "../Arena/Arena.h"
+#include "../HotPlug/HotPlug.h"
+#include "../Profiler/Profiler.h"
+#include "../SPIBus/SPIBus.h"
+
 #define SETTINGS_FILE "settings.txt"
+#define THUMBS_FILE "thumbs.bin"
+#define WEIGHTS_FILE "weights.bin"
+#define ORDER_FILE "order.bin"
+#define INDEX_FILE "index.bin" // Images in album directories are found through it, without it images directory is flat
+#define CACHE_DIR "cache" // RGB565 copies of BMP24 images named by image number (or id), folder can be deleted any time
+#define CACHE_RING "cache/ring.bin"
+
+#define CACHE_IMAGES true // Copy displayed BMP24 images into CACHE_DIR while sd card is idle and read copies next time
+#define CACHE_MAX_IMAGES 256 // Copy of 320x480 image takes 300 KB of sd card
+#define CACHE_MAX_ID 99999999UL // Copies are named by id in 8.3 format
+#define CACHE_CHUNK 32 // Pixels copied at once, buffer is in arena
+#define CACHE_STEP_MS 20 // Longest time of single cacheStep()
+#define PLAYLISTS_DIR "lists" // Playlists are named by their number starting from 1 (1.bin, 2.bin, ...)
 
 class SDStorage {
 public:
+    enum Format {
+        BMP24 = IMAGE_FORMAT_BMP24,
+        RGB565 = IMAGE_FORMAT_RGB565,
+        RLE16 = IMAGE_FORMAT_RLE16
+    };
+
+    // Metadata of opened image, enough to open it again without directory lookup and header validation
+    struct ImageInfo {
+        uint32_t number;
+        uint8_t format;
+        uint8_t flags;
+        uint16_t dataOffset;
+        uint32_t dataSize;
+        uint32_t firstBlock; // First block of contiguous file
+        uint32_t fileSize; // 0 if file is fragmented, such image is opened by number
+    };
 
-    SDStorage(uint8_t SD_CS_PIN, uint16_t disWidth, uint16_t disHeight, String imageDir);
+    SDStorage(uint8_t SD_CS_PIN, uint16_t disWidth, uint16_t disHeight, const char *imageDir); // imageDir must stay valid, it is opened again after remount
 
     uint16_t nextImage(); // Switch to next image available in imageDir, return number of invalid images
-    bool toImage(String imageFile); // Go to specific image
-    bool toImage(uint16_t imagePos);
+    bool toImage(const char *imageFile); // Go to specific image
+    bool toImage(uint32_t id); // Go to image with number (or id of indexed image)
+    bool toImage(const ImageInfo &info); // Open image again from its metadata
+    ImageInfo getImageInfo(); // Metadata of current image
+    bool toThumbnail(uint32_t imagePos); // Read thumbnail of image like image, following thumbnails are read sequentially
 
-    void readImagePortion(uint16_t *buffer, uint16_t size); // Load portion of image into buffer
+    void readImagePortion(uint16_t *buffer, uint16_t size); // Load portion of image into buffer, buffer must have PORTION_BUFFER(size) words
+    uint16_t readSolidSpan(uint16_t &color, uint16_t maxSize); // If next pixels have single color skip up to maxSize of them, return number of skipped pixels
+    bool isInterlaced(); // True if rows of current image are stored in interlace passes order
+    bool canSeekRows(); // True if current image rows can be read in any order
+    void seekRow(uint16_t row); // Move to beginning of row (in file order), only if canSeekRows()
+
+    uint8_t readCaption(char *text, uint8_t size); // Copy caption of current image into text, return its length, call before reading pixels
+    bool isAnimated(); // True if current image is followed by animation frames
+    uint16_t startAnimation(); // Call after first frame was read, return frame interval [ms] or 0 if animation is invalid
+    uint16_t nextFrame(); // Move to next animation frame, return number of its rectangles
+    bool readFrameRect(uint16_t &x, uint16_t &y, uint16_t &width, uint16_t &height); // Read next rectangle header, its pixels follow
 
     File getCurrentImage(); // Get current image object
-    uint16_t getImageNumber();
-    uint32_t imagesInDir(); // Get number of images in directory with images
+    uint32_t getImageNumber();
+    uint32_t imagesInDir(); // Get number of images in directory with images (or in index)
+    bool isIndexed(); // True if images are read through INDEX_FILE
+
+    int32_t pickWeighted(uint16_t slot, uint16_t coin); // Pick image from weights file with random slot < imagesInDir() and coin, -1 if file is missing or outdated
+    int32_t pickLeastRecent(); // Get least recently shown image from order file (created when missing or outdated), -1 on error
+    void markShown(uint32_t id); // Move displayed image to end of order file, if least recent pick opened it
+    void forgetOrder(); // Stop moving displayed images until next least recent pick
+
+    uint16_t openPlaylist(uint8_t list, char *name); // Return number of entries of playlist and copy its name (PLAYLIST_NAME_LEN + 1 bytes), 0 if missing or invalid
+    bool toPlaylistEntry(uint8_t list, uint16_t entry); // Open image of playlist entry
 
     void saveSettings(uint8_t *settings, uint16_t nBytes);
+    bool writeFile(const char *path, void (*write)(Print &out)); // Create or overwrite file with output of write, current image can still be read
     void loadSettings(uint8_t *settings, uint16_t nBytes); 
 
+    uint16_t checkFragmentation(); // Print names of fragmented images over Serial, return their number
+
+    bool cardPresent(); // Check if card still answers, call between images
+    bool remount(); // Mount card again after removal or error and update number of images, return false if card is not usable yet
+
+    void cacheStep(); // Copy part of current image into cache if it has no valid copy, call while sd card is idle
+    bool isCached(); // True if current image is read from its cached copy
+
     bool error();
 private:
+    uint8_t csPin; // Chip select pin of sd card
+    const char *imageDirPath; // Directory with images is opened again after remount
     File imageDir; // Directory with images
     File currentImage;
     uint32_t imagesInDirN; // Number of images in directory
+    uint16_t indexAlbums; // Number of albums in INDEX_FILE, 0 if there is no valid index
     bool err; // True if SD card was not initialized or could not open file
-    uint16_t imageNumber;
+    uint32_t imageNumber;
     uint16_t disWidth; // Display width [px]
     uint16_t disHeight; // Display height [px]
+    Format format; // Format of current image
+    uint16_t packetLeft; // Pixels left in current RLE16 packet
+    uint16_t runColor; // Color of current RLE16 run
+    bool inRun; // True if current RLE16 packet is run, false if literal
+    uint32_t dataOffset; // Offset of pixel data in current image
+    uint32_t dataSize; // Size of pixel data (first frame of animation) in current image
+    uint16_t flags; // BMP_FLAG_* flags of current image
+    uint32_t framesOffset; // Offset of first animation frame
+    uint16_t framesN; // Number of animation frames
+    uint16_t frame; // Next animation frame
+    RawStream raw; // Streams current image if it is contiguous on card
+    File cacheFile; // Copy of current image being written
+    uint32_t cacheLeft; // Pixels left to copy
+    uint32_t cacheSourceSize; // Size and stamp of current image, its copy is valid while they match
+    uint32_t cacheSourceStamp;
+    bool cacheMiss; // Current image has no valid copy, it will be copied by cacheStep()
+    bool cached; // Current image is read from its copy
+    bool orderKept; // ORDER_FILE was opened by least recent pick, displayed images are moved to its end
+
+    void closeImage(); // Close current image and abort its copying
+    void readPortion(uint16_t *buffer, uint16_t size); // readImagePortion() inside burst of streamed card
+    void streamImage(const char *path); // Stream current image with RawStream if possible
+    bool openImage(const char *path, uint8_t format, uint8_t flags, uint16_t dataOffset, uint32_t dataSize, uint32_t fileSize); // Open image with header read from index or playlist, validate it if file size differs
+    bool openIndex(); // Read number of albums and images from INDEX_FILE, return false if it is missing or invalid
+    bool toIndexEntry(uint32_t id); // Open image through its index entry
+    char *albumPath(File &index, uint16_t album); // Write path of album directory ending with '/' into arena, built from its parents, return end of path
+    uint8_t prependAlbum(const char *name, uint8_t len); // Put name and '/' before len characters of path in arena, return new length
+    char *imagePath(uint32_t id); // Write path of image with number or id into arena, path by number with error set if index cannot be read
+    bool toCachedCopy(); // Switch current BMP24 image to its copy if copy is valid
+    bool startCaching(); // Take ring slot for current image and create its copy with incomplete header
+    void stopCaching();
+    int32_t takeCacheSlot(uint32_t id); // Slot already holding id or slot freed by clock eviction, -1 on error
+    bool markCacheSlot(uint16_t slot, uint32_t id); // Set referenced flag of slot, return false if slot does not hold id
+    char *cachePath(uint32_t id); // Write path of copy into arena
+    void seekData(uint32_t offset); // Move to offset in current image
 
-    uint16_t RGB24ToRGB16(uint8_t r, uint8_t g, uint8_t b); // Convert RGB24 format to RGB 16
+    bool readImageData(void *buffer, uint16_t n); // Read n bytes of current image, return false on error
+    uint32_t dataPosition(); // Offset of next byte read by readImageData()
+    void readRLE16Portion(uint16_t *buffer, uint16_t size);
+    void readRLE16Packet(); // Read header of next RLE16 packet
     bool validateImage(File &image);
     void countImages();
+    bool createOrder(File &file); // Write order file with images in directory order
+    void moveToTail(File &file, uint16_t id, uint16_t prev, uint16_t next, uint16_t head, uint16_t tail); // Relink image as most recently shown
+    File openPlaylistFile(uint8_t list, uint16_t &entries); // Open playlist file and validate header, entries is 0 if invalid
     uint32_t readLittleIndian32(File f); // Read data and convert to big indian format
     uint16_t readLittleIndian16(File f); // Read data and convert to big indian format
+    void writeLittleIndian16(File f, uint16_t d);
+    void writeLittleIndian32(File f, uint32_t d);
 };
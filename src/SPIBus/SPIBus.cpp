@@ -0,0 +1,67 @@
+/*
+SPIBus.cpp
+
+SPIBus class implementation.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "SPIBus.h"
+
+SPIBus::Device SPIBus::device = SPIBus::NO_DEVICE;
+uint8_t SPIBus::depth = 0;
+uint32_t SPIBus::idleSince = 0;
+uint32_t SPIBus::activeSince = 0;
+
+// Created once, index is SPIBus::Device
+static const SPISettings deviceSettings[SPIBus::DEVICES_N] = {
+    SPISettings(),
+    SPISettings(SD_SPI_CLOCK, MSBFIRST, SPI_MODE0),
+    SPISettings(PANEL_SPI_CLOCK, MSBFIRST, SPI_MODE0),
+    SPISettings(TOUCH_SPI_CLOCK, MSBFIRST, SPI_MODE0)
+};
+
+void SPIBus::acquire(Device device) {
+    // Chip select of device goes low for transfer, chip selects of other devices are high since their release
+    PROFILE_ADD(BUS_SELECTS, 1);
+
+    // Transfer inside reported library call keeps time of outer one
+    if (depth++ > 0) { return; }
+    SPIBus::device = device;
+
+#ifdef PROFILING
+    if (idleSince) {
+        PROFILE_ADD(BUS_IDLE_US, micros() - idleSince);
+        idleSince = 0;
+    }
+#endif
+
+#ifdef ENERGY_ACCOUNTING
+    activeSince = micros();
+#endif
+}
+
+void SPIBus::release() {
+    if (--depth > 0) { return; }
+
+#ifdef PROFILING
+    idleSince = micros();
+#endif
+
+    ENERGY_BUS(device, micros() - activeSince);
+}
+
+const SPISettings &SPIBus::settings(Device device) {
+    return deviceSettings[device];
+}
@@ -0,0 +1,67 @@
+/*
+SPIBus.h
+
+SPIBus tracks which device (SD card, display, touch controller) uses shared SPI bus.
+Device libraries drive their own chip selects, SPIBus is informed around every transfer which selects
+a device (acquire() before, release() after), so chip select assertions and time when bus is idle can be counted.
+Every access of frame code is reported: image streaming, cache writes, touch reads, ui drawing and
+SD library calls (opens, directory and FAT lookups), so idle time is time when no device is selected.
+Library call which selects its device more than once (SD library reading directory blocks) is reported
+as one assertion, so the count is a lower bound there, while its time is exact.
+SPIBus does not reorder transfers of libraries, bursts are made long by their callers: RawStream keeps
+card selected for whole portion of image and solid spans are written into display in whole buffers.
+Settings of every device are created once and reused for raw transfers.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "../Profiler/Profiler.h"
+#include "../Energy/Energy.h"
+
+#define SD_SPI_CLOCK 8000000 // Max clock of Pro Mini (F_CPU / 2)
+#define PANEL_SPI_CLOCK 8000000
+#define TOUCH_SPI_CLOCK 2000000 // XPT2046 max clock
+
+class SPIBus {
+public:
+    enum Device : uint8_t {
+        NO_DEVICE,
+        SD_CARD,
+        PANEL,
+        TOUCH,
+        DEVICES_N
+    };
+
+    static void acquire(Device device); // Called before transfer selecting device, counts chip select assertion, calls may nest
+    static void release(); // Called after transfer, must follow acquire(), bus is idle after outermost release
+    static const SPISettings &settings(Device device); // Cached SPI settings of device
+
+    // Device is reported as using bus for lifetime of object, for library calls with many transfers
+    class Use {
+    public:
+        explicit Use(Device device) { SPIBus::acquire(device); }
+        ~Use() { SPIBus::release(); }
+    };
+
+private:
+    static Device device; // Device which uses bus (or used it last)
+    static uint8_t depth; // Nested acquires not released yet
+    static uint32_t idleSince; // Time of last release [us]
+    static uint32_t activeSince; // Time of acquire [us]
+};
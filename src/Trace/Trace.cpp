@@ -0,0 +1,44 @@
+/*
+Trace.cpp
+
+Trace class implementation.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "Trace.h"
+
+void Trace::record(Event event, uint32_t value) {
+    if (!Serial) { return; }
+
+    Serial.print(F("T "));
+    Serial.print(millis());
+    Serial.print(' ');
+    Serial.print((char)event);
+    Serial.print(' ');
+    Serial.println(value);
+}
+
+void Trace::record(Event event, uint32_t value1, uint32_t value2) {
+    if (!Serial) { return; }
+
+    Serial.print(F("T "));
+    Serial.print(millis());
+    Serial.print(' ');
+    Serial.print((char)event);
+    Serial.print(' ');
+    Serial.print(value1);
+    Serial.print(' ');
+    Serial.println(value2);
+}
@@ -0,0 +1,50 @@
+/*
+Trace.h
+
+Trace records inputs of frame (random seed, touches) and its reactions (state changes, picked images)
+with time of every record and prints them over Serial, one record per line:
+T <millis> <event> <values>
+Event S - random seed, P - touch at raw controller coordinates (x y), C - state change (DigitalFrame::State),
+I - image picked for display (number or id).
+Captured trace is replayed on PC with tools/replay.cpp, which compares records of simulated frame with device.
+Records are compiled out unless TRACING is defined.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// #define TRACING // Uncomment to print trace over Serial
+#define TRACING_BAUD 115200
+
+class Trace {
+public:
+    enum Event : char {
+        SEED = 'S',
+        TOUCH = 'P',
+        STATE = 'C',
+        IMAGE = 'I'
+    };
+
+    static void record(Event event, uint32_t value); // Print record with current time
+    static void record(Event event, uint32_t value1, uint32_t value2);
+};
+
+#ifdef TRACING
+#define TRACE(event, ...) Trace::record(Trace::event, __VA_ARGS__)
+#else
+#define TRACE(event, ...)
+#endif
@@ -0,0 +1,238 @@
+/*
+Widget.cpp
+
+Widgets implementation.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "Widget.h"
+
+#define NOT_DRAWN 0xFF // Marks level / selection that is not visible on screen
+
+#define SEGMENT_WIDTH 16
+#define SEGMENT_PITCH 20
+
+bool Rect::contains(uint16_t x, uint16_t y) const {
+    return (x >= x1) && (x <= x2) && (y >= y1) && (y <= y2);
+}
+
+uint32_t Rect::area() const {
+    return (uint32_t)(x2 - x1 + 1) * (uint32_t)(y2 - y1 + 1);
+}
+
+uint32_t Rect::fill(ILI9486 *display, ILI9486_COLOR color) const {
+    SPIBus::Use bus(SPIBus::PANEL);
+    display->fill(x1, y1, x2, y2, color);
+    return this->area();
+}
+
+uint8_t hitTest(const TouchZone *zones, uint8_t n, uint16_t x, uint16_t y) {
+    for (uint8_t i = 0; i < n; i++) {
+        TouchZone zone;
+        memcpy_P(&zone, &zones[i], sizeof(TouchZone));
+
+        if (zone.rect.contains(x, y)) { return zone.id; }
+    }
+
+    return NO_ZONE;
+}
+
+
+LevelBar::LevelBar(uint16_t x, uint16_t y1, uint16_t y2, uint8_t segments):
+    x(x),
+    y1(y1),
+    y2(y2),
+    segments(segments),
+    level(0),
+    drawnLevel(NOT_DRAWN)
+{}
+
+void LevelBar::setLevel(uint8_t level) {
+    this->level = level;
+}
+
+void LevelBar::invalidate() {
+    this->drawnLevel = NOT_DRAWN;
+}
+
+uint32_t LevelBar::render(ILI9486 *display) {
+    if (this->level == this->drawnLevel) { return 0; }
+
+    // Only segments between old and new level changed color
+    uint8_t from = 0;
+    uint8_t to = this->segments;
+    if (this->drawnLevel != NOT_DRAWN) {
+        from = min(this->level, this->drawnLevel);
+        to = max(this->level, this->drawnLevel);
+    }
+
+    uint32_t written = 0;
+    for (uint8_t i = from; i < to; i++) {
+        ILI9486_COLOR c = (i < this->level) ? ILI9486_WHITE : ILI9486_BLACK;
+        written += this->segment(i).fill(display, c);
+    }
+
+    this->drawnLevel = this->level;
+    return written;
+}
+
+Rect LevelBar::segment(uint8_t i) {
+    uint16_t left = this->x + i * SEGMENT_PITCH;
+    return Rect{left, this->y1, (uint16_t)(left + SEGMENT_WIDTH - 1), this->y2};
+}
+
+
+RadioGroup::RadioGroup(uint16_t x, uint16_t yFirst, int16_t step, uint8_t radius, uint8_t options):
+    x(x),
+    yFirst(yFirst),
+    step(step),
+    radius(radius),
+    options(options),
+    selected(0),
+    drawnSelected(NOT_DRAWN)
+{}
+
+void RadioGroup::setSelected(uint8_t selected) {
+    this->selected = selected;
+}
+
+void RadioGroup::invalidate() {
+    this->drawnSelected = NOT_DRAWN;
+}
+
+uint32_t RadioGroup::render(ILI9486 *display) {
+    if (this->selected == this->drawnSelected) { return 0; }
+
+    uint32_t written = 0;
+
+    if (this->drawnSelected == NOT_DRAWN) {
+        // Nothing known about screen, draw all circles
+        for (uint8_t i = 0; i < this->options; i++) {
+            written += this->drawOption(display, i, (i == this->selected) ? ILI9486_WHITE : ILI9486_BLACK);
+        }
+    } else {
+        written += this->drawOption(display, this->drawnSelected, ILI9486_BLACK);
+        written += this->drawOption(display, this->selected, ILI9486_WHITE);
+    }
+
+    this->drawnSelected = this->selected;
+    return written;
+}
+
+uint32_t RadioGroup::drawOption(ILI9486 *display, uint8_t i, ILI9486_COLOR c) {
+    SPIBus::Use bus(SPIBus::PANEL);
+    display->drawCircle(this->x, this->yFirst + i * this->step, this->radius, c, true);
+
+    uint32_t side = 2 * this->radius + 1;
+    return side * side;
+}
+
+
+TimeLabel::TimeLabel(Rect area, uint16_t textX, uint16_t textY):
+    area(area),
+    textX(textX),
+    textY(textY),
+    time(0),
+    drawnTime(0),
+    drawn(false)
+{}
+
+void TimeLabel::setTime(uint32_t time) {
+    this->time = time;
+}
+
+void TimeLabel::invalidate() {
+    this->drawn = false;
+}
+
+uint32_t TimeLabel::render(ILI9486 *display) {
+    if ( (this->drawn) && (this->time == this->drawnTime) ) { return 0; }
+
+    char *text = Arena::text();
+    format(this->time, text);
+
+    // Text is drawn inside cleared area, so area covers all written pixels
+    SPIBus::Use bus(SPIBus::PANEL);
+    uint32_t written = this->area.fill(display, ILI9486_BLACK);
+    display->drawString(this->textX, this->textY, (uint8_t*)text, ILI9486::L, ILI9486_WHITE);
+
+    this->drawnTime = this->time;
+    this->drawn = true;
+    return written;
+}
+
+void TimeLabel::format(uint32_t time, char *text) {
+    bool seconds = true;
+
+    if (time >= 60000) {
+        time /= 60000;
+        seconds = false;
+    } else {
+        time /= 1000;
+    }
+
+    uint8_t digitCount = 0;
+
+    uint32_t tmp = time;
+    do {
+        digitCount++;
+        tmp /= 10;
+    } while (tmp);
+
+    uint8_t i = digitCount;
+    while(i) {
+        text[i-1] = (time % 10) + '0';
+        time /= 10;
+        i--;
+    }
+
+    text[digitCount] = ' ';
+    memcpy(&text[digitCount + 1], seconds ? "second" : "minute", 6);
+
+    text[digitCount+7] = (text[0] != '1' || digitCount != 1) ? 's' : ' ';
+    text[digitCount+8] = '\0';
+}
+
+
+TextLabel::TextLabel(Rect area, uint16_t textX, uint16_t textY):
+    area(area),
+    textX(textX),
+    textY(textY),
+    text(""),
+    drawn(false)
+{}
+
+void TextLabel::setText(const char *text) {
+    if (strncmp(this->text, text, TEXT_LABEL_LEN) == 0) { return; }
+
+    strncpy(this->text, text, TEXT_LABEL_LEN);
+    this->text[TEXT_LABEL_LEN] = '\0';
+    this->drawn = false;
+}
+
+void TextLabel::invalidate() {
+    this->drawn = false;
+}
+
+uint32_t TextLabel::render(ILI9486 *display) {
+    if (this->drawn) { return 0; }
+
+    SPIBus::Use bus(SPIBus::PANEL);
+    uint32_t written = this->area.fill(display, ILI9486_BLACK);
+    display->drawString(this->textX, this->textY, (uint8_t*)this->text, ILI9486::L, ILI9486_WHITE);
+
+    this->drawn = true;
+    return written;
+}
@@ -0,0 +1,131 @@
+/*
+Widget.h
+
+Retained widgets drawn over settings screens.
+Each widget remembers what is currently visible on the screen and pushes only
+the changed part (dirty rectangle) to the display on render().
+Touch zones map screen areas to actions, so handlers do not compare raw coordinates.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <ILI9486.h>
+
+#include "../Arena/Arena.h"
+#include "../SPIBus/SPIBus.h"
+
+#define NO_ZONE 0xFF // Returned by hitTest() when no zone was touched
+#define TEXT_LABEL_LEN 20 // Longest text of TextLabel (playlist name)
+#define TIME_TEXT_SIZE 20 // Characters written by TimeLabel::format
+
+// Screen area, all borders are included
+struct Rect {
+    uint16_t x1;
+    uint16_t y1;
+    uint16_t x2;
+    uint16_t y2;
+
+    bool contains(uint16_t x, uint16_t y) const;
+    uint32_t area() const; // Number of pixels inside rectangle
+    uint32_t fill(ILI9486 *display, ILI9486_COLOR color) const; // Fill rectangle, return number of pixels written
+};
+
+// Touchable screen area, tables of zones should be stored in PROGMEM
+struct TouchZone {
+    Rect rect;
+    uint8_t id;
+};
+
+uint8_t hitTest(const TouchZone *zones, uint8_t n, uint16_t x, uint16_t y); // Return id of first zone containing point or NO_ZONE
+
+// Row of vertical segments, segments below level are lit
+class LevelBar {
+public:
+    LevelBar(uint16_t x, uint16_t y1, uint16_t y2, uint8_t segments);
+
+    void setLevel(uint8_t level);
+    void invalidate(); // Screen under widget was overwritten, redraw everything on next render
+    uint32_t render(ILI9486 *display); // Draw only changed segments, return number of pixels written
+
+private:
+    uint16_t x; // Left border of first segment
+    uint16_t y1;
+    uint16_t y2;
+    uint8_t segments; // Number of segments
+    uint8_t level; // Requested level
+    uint8_t drawnLevel; // Level currently visible on screen
+
+    Rect segment(uint8_t i);
+};
+
+// Column of circles with only one selected
+class RadioGroup {
+public:
+    RadioGroup(uint16_t x, uint16_t yFirst, int16_t step, uint8_t radius, uint8_t options);
+
+    void setSelected(uint8_t selected);
+    void invalidate(); // Screen under widget was overwritten, redraw everything on next render
+    uint32_t render(ILI9486 *display); // Redraw only previously and newly selected circles, return number of pixels written
+
+private:
+    uint16_t x; // Circles center x
+    uint16_t yFirst; // First circle center y
+    int16_t step; // Distance between circle centers
+    uint8_t radius;
+    uint8_t options; // Number of circles
+    uint8_t selected; // Requested selection
+    uint8_t drawnSelected; // Selection currently visible on screen
+
+    uint32_t drawOption(ILI9486 *display, uint8_t i, ILI9486_COLOR c);
+};
+
+// Time value printed as "N seconds" / "N minutes"
+class TimeLabel {
+public:
+    TimeLabel(Rect area, uint16_t textX, uint16_t textY);
+
+    void setTime(uint32_t time); // Time in miliseconds
+    void invalidate(); // Screen under widget was overwritten, redraw everything on next render
+    uint32_t render(ILI9486 *display); // Redraw label only if time changed, return number of pixels written
+
+    static void format(uint32_t time, char *text); // text must hold TIME_TEXT_SIZE characters
+
+private:
+    Rect area; // Area cleared before text is drawn
+    uint16_t textX;
+    uint16_t textY;
+    uint32_t time; // Requested time
+    uint32_t drawnTime; // Time currently visible on screen
+    bool drawn; // False if drawnTime is not visible on screen
+};
+
+// Single line of text, longer text is cut
+class TextLabel {
+public:
+    TextLabel(Rect area, uint16_t textX, uint16_t textY);
+
+    void setText(const char *text);
+    void invalidate(); // Screen under widget was overwritten, redraw everything on next render
+    uint32_t render(ILI9486 *display); // Redraw label only if text changed, return number of pixels written
+
+private:
+    Rect area; // Area cleared before text is drawn
+    uint16_t textX;
+    uint16_t textY;
+    char text[TEXT_LABEL_LEN + 1];
+    bool drawn; // False if text is not visible on screen
+};
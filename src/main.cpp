@@ -20,6 +20,9 @@ along with this program.  If not, see https://www.gnu.org/licenses/.
 #include "SDStorage/SDStorage.h"
 #include "Calibration/Calibration.h"
 #include "DigitalFrame/DigitalFrame.h"
+#include "Profiler/Profiler.h"
+#include "Trace/Trace.h"
+#include "Energy/Energy.h"
 
 #define IMAGE_DIR "/images"
 
@@ -44,11 +47,24 @@ SDStorage *storage;
 DigitalFrame *frame;
 
 void setup() {
+#ifdef PROFILING
+	Serial.begin(PROFILING_BAUD);
+#elif defined(TRACING)
+	Serial.begin(TRACING_BAUD);
+#elif defined(ENERGY_ACCOUNTING)
+	Serial.begin(ENERGY_BAUD);
+#endif
+
 	display = new ILI9486(ILI9486_CS, ILI9486_BL, ILI9486_RST, ILI9486_DC, ILI9486::R2L_U2D, 0, ILI9486_BLACK);
 
 	digitalWrite(ILI9486_CS, 1);
 	digitalWrite(4, 1);
-	storage = new SDStorage(5, display->getWidth(), display->getHeight(), IMAGE_DIR);
+	storage = new SDStorage(5, PANEL_WIDTH, PANEL_HEIGHT, IMAGE_DIR);
+
+#ifdef PROFILING
+	// Fragmented images are loaded slower, through FAT lookups
+	storage->checkFragmentation();
+#endif
 	
 	touch = new XPT2046_Touchscreen(XPT2046_CS, XPT2046_IRQ);
 	touch->begin();
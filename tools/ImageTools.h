@@ -0,0 +1,545 @@
+/*
+ImageTools.h
+
+Image reading and encoding and sd card files building shared by PC tools.
+Formats are described in src/SDStorage/ImageFormat.h.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "../src/SDStorage/ImageFormat.h"
+
+struct Image {
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint16_t> pixels; // RGB565 in bmp order (bottom row first)
+};
+
+inline uint32_t get32(const std::vector<uint8_t> &d, size_t pos) {
+    return d[pos] | (d[pos+1] << 8) | (d[pos+2] << 16) | ((uint32_t)d[pos+3] << 24);
+}
+
+inline uint16_t get16(const std::vector<uint8_t> &d, size_t pos) {
+    return d[pos] | (d[pos+1] << 8);
+}
+
+inline void put16(std::vector<uint8_t> &d, uint16_t v) {
+    d.push_back(v & 0xFF);
+    d.push_back(v >> 8);
+}
+
+inline void put32(std::vector<uint8_t> &d, uint32_t v) {
+    put16(d, v & 0xFFFF);
+    put16(d, v >> 16);
+}
+
+inline bool readFile(const char *path, std::vector<uint8_t> &d) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { return false; }
+
+    uint8_t chunk[4096];
+    size_t n;
+    while ( (n = fread(chunk, 1, sizeof(chunk), f)) > 0 ) { d.insert(d.end(), chunk, chunk + n); }
+    fclose(f);
+    return true;
+}
+
+inline bool writeFile(const char *path, const std::vector<uint8_t> &d) {
+    FILE *f = fopen(path, "wb");
+    if (!f) { return false; }
+    bool ok = fwrite(d.data(), 1, d.size(), f) == d.size();
+    fclose(f);
+    return ok;
+}
+
+// Images are named by their number, return highest number + 1 or -1 if directory could not be opened
+inline int32_t countImages(const char *dirPath) {
+    DIR *dir = opendir(dirPath);
+    if (!dir) { return -1; }
+
+    int32_t count = 0;
+    while (dirent *entry = readdir(dir)) {
+        char *end;
+        unsigned long n = strtoul(entry->d_name, &end, 10);
+        if ( (end != entry->d_name) && (strcasecmp(end, ".bmp") == 0) ) { count = std::max<int32_t>(count, n + 1); }
+    }
+
+    closedir(dir);
+    return count;
+}
+
+// Header fields frame reads when it opens image, as in SDStorage::validateImage
+struct ImageHeader {
+    uint8_t format;
+    uint8_t flags;
+    uint16_t dataOffset;
+    uint32_t dataSize;
+    uint32_t fileSize;
+};
+
+inline bool readHeader(const char *path, ImageHeader &header) {
+    std::vector<uint8_t> d;
+    if ( (!readFile(path, d)) || (d.size() < BMP_HEADER_SIZE) || (get16(d, 0) != BMP_MAGIC) ) { return false; }
+
+    uint32_t width = get32(d, 18);
+    uint32_t height = get32(d, 22);
+    uint16_t bitsPerPixel = get16(d, 28);
+    uint32_t compression = get32(d, 30);
+    uint32_t offset = get32(d, 10);
+
+    if ( (std::min(width, height) != 320) || (std::max(width, height) != 480) || (offset > UINT16_MAX) ) { return false; }
+
+    if ( (bitsPerPixel == 24) && (compression == BMP_COMPRESSION_NONE) ) {
+        header.format = IMAGE_FORMAT_BMP24;
+    } else if ( (bitsPerPixel == 16) && (compression == BMP_COMPRESSION_BITFIELDS) ) {
+        header.format = IMAGE_FORMAT_RGB565;
+    } else if ( (bitsPerPixel == 16) && (compression == BMP_COMPRESSION_RLE16) ) {
+        header.format = IMAGE_FORMAT_RLE16;
+    } else {
+        return false;
+    }
+
+    header.flags = (get16(d, 6) == BMP_FRAME_SIGNATURE) ? get16(d, 8) : 0;
+    header.dataOffset = offset;
+    header.dataSize = get32(d, 34);
+    if (header.dataSize == 0) { header.dataSize = width * height * bitsPerPixel / 8; }
+    header.fileSize = d.size();
+    return true;
+}
+
+struct Album {
+    uint16_t parent;
+    uint32_t first; // Id of first image
+    uint32_t count; // Images including subalbums
+    std::string name;
+};
+
+// Index of images directory (see index file in ImageFormat.h)
+struct Index {
+    std::vector<Album> albums;
+    std::vector<uint8_t> entries;
+    uint32_t images = 0;
+    uint32_t skipped = 0;
+};
+
+// 8 characters name and up to 3 characters extension
+inline bool isShortName(const std::string &name) {
+    size_t dot = name.find('.');
+    if (dot == std::string::npos) { return (name.size() >= 1) && (name.size() <= 8); }
+    return (dot >= 1) && (dot <= 8) && (name.size() - dot - 1 <= 3) && (name.find('.', dot + 1) == std::string::npos);
+}
+
+// Numbered images are ordered by number, so flat directory keeps numbers as ids
+inline bool imageBefore(const std::string &a, const std::string &b) {
+    char *endA, *endB;
+    unsigned long na = strtoul(a.c_str(), &endA, 10);
+    unsigned long nb = strtoul(b.c_str(), &endB, 10);
+    bool numA = (endA != a.c_str()) && (strcasecmp(endA, ".bmp") == 0);
+    bool numB = (endB != b.c_str()) && (strcasecmp(endB, ".bmp") == 0);
+
+    if (numA != numB) { return numA; }
+    if ( (numA) && (na != nb) ) { return na < nb; }
+    return a < b;
+}
+
+// Add album directory with its images and subalbums to index, images get consecutive ids
+inline void indexAlbum(Index &index, const std::string &path, const std::string &name, uint16_t parent, uint8_t depth) {
+    DIR *dir = opendir(path.c_str());
+    if (!dir) {
+        fprintf(stderr, "%s: could not open directory\n", path.c_str());
+        return;
+    }
+
+    std::vector<std::string> files, subdirs;
+    while (dirent *entry = readdir(dir)) {
+        std::string entryName = entry->d_name;
+        if (entryName[0] == '.') { continue; }
+
+        struct stat st;
+        if (stat((path + "/" + entryName).c_str(), &st) != 0) { continue; }
+
+        if (!isShortName(entryName)) {
+            fprintf(stderr, "%s/%s: not 8.3 name, skipped\n", path.c_str(), entryName.c_str());
+            index.skipped++;
+        } else if (S_ISDIR(st.st_mode)) {
+            subdirs.push_back(entryName);
+        } else if ( (entryName.size() > 4) && (strcasecmp(entryName.c_str() + entryName.size() - 4, ".bmp") == 0) ) {
+            files.push_back(entryName);
+        }
+    }
+
+    closedir(dir);
+    std::sort(files.begin(), files.end(), imageBefore);
+    std::sort(subdirs.begin(), subdirs.end());
+
+    uint16_t album = index.albums.size();
+    index.albums.push_back({parent, index.images, 0, name});
+
+    for (const std::string &file : files) {
+        ImageHeader header;
+        if (!readHeader((path + "/" + file).c_str(), header)) {
+            fprintf(stderr, "%s/%s: no valid image, skipped\n", path.c_str(), file.c_str());
+            index.skipped++;
+            continue;
+        }
+
+        put16(index.entries, album);
+        index.entries.push_back(header.format);
+        index.entries.push_back(header.flags);
+        put16(index.entries, header.dataOffset);
+        put16(index.entries, 0);
+        put32(index.entries, header.dataSize);
+        put32(index.entries, header.fileSize);
+        index.entries.insert(index.entries.end(), file.begin(), file.end());
+        index.entries.resize(index.entries.size() + INDEX_NAME_LEN - file.size(), 0);
+        index.images++;
+    }
+
+    for (const std::string &subdir : subdirs) {
+        if ( (depth >= INDEX_MAX_DEPTH) || (index.albums.size() >= INDEX_NO_PARENT) ) {
+            fprintf(stderr, "%s/%s: too deep or too many albums, skipped\n", path.c_str(), subdir.c_str());
+            index.skipped++;
+            continue;
+        }
+
+        indexAlbum(index, path + "/" + subdir, subdir, album, depth + 1);
+    }
+
+    index.albums[album].count = index.images - index.albums[album].first;
+}
+
+inline void putIndex(std::vector<uint8_t> &d, const Index &index) {
+    put16(d, INDEX_MAGIC);
+    put16(d, index.albums.size());
+    put32(d, index.images);
+
+    for (const Album &album : index.albums) {
+        put16(d, album.parent);
+        put16(d, 0);
+        put32(d, album.first);
+        put32(d, album.count);
+        d.insert(d.end(), album.name.begin(), album.name.end());
+        d.resize(d.size() + INDEX_NAME_LEN - album.name.size(), 0);
+    }
+
+    d.insert(d.end(), index.entries.begin(), index.entries.end());
+}
+
+// Append thumbnail of image, every thumbnail pixel averages source pixels it covers
+inline void putThumbnail(std::vector<uint8_t> &out, const Image &image) {
+    for (uint32_t ty = 0; ty < THUMB_HEIGHT; ty++) {
+        uint32_t y1 = ty * image.height / THUMB_HEIGHT;
+        uint32_t y2 = std::max(y1 + 1, (ty + 1) * image.height / THUMB_HEIGHT);
+
+        for (uint32_t tx = 0; tx < THUMB_WIDTH; tx++) {
+            uint32_t x1 = tx * image.width / THUMB_WIDTH;
+            uint32_t x2 = std::max(x1 + 1, (tx + 1) * image.width / THUMB_WIDTH);
+            uint32_t r = 0, g = 0, b = 0, n = 0;
+
+            for (uint32_t y = y1; y < y2; y++) {
+                for (uint32_t x = x1; x < x2; x++, n++) {
+                    uint16_t p = image.pixels[y * image.width + x];
+                    r += (p >> 11) & 0x1F;
+                    g += (p >> 5) & 0x3F;
+                    b += p & 0x1F;
+                }
+            }
+
+            put16(out, (((r + n / 2) / n) << 11) | (((g + n / 2) / n) << 5) | ((b + n / 2) / n));
+        }
+    }
+}
+
+// Vose alias table for picking slot i with probability weights[i] / sum of weights (see aliasPick)
+inline void buildAliasTable(const std::vector<double> &weights, std::vector<uint16_t> &threshold, std::vector<uint16_t> &alias) {
+    size_t n = weights.size();
+    double total = 0;
+    for (double w : weights) { total += w; }
+
+    // Slots are filled to average probability 1, small ones are topped up from large ones
+    std::vector<double> p(n);
+    std::vector<size_t> small, large;
+    for (size_t i = 0; i < n; i++) {
+        p[i] = weights[i] * n / total;
+        if (p[i] < 1) { small.push_back(i); } else { large.push_back(i); }
+    }
+
+    threshold.assign(n, UINT16_MAX);
+    alias.resize(n);
+    for (size_t i = 0; i < n; i++) { alias[i] = i; }
+
+    while ( (!small.empty()) && (!large.empty()) ) {
+        size_t s = small.back();
+        size_t l = large.back();
+        small.pop_back();
+
+        threshold[s] = std::min(65535.0, std::floor(p[s] * 65536 + 0.5));
+        alias[s] = l;
+
+        p[l] -= 1 - p[s];
+        if (p[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // Slots left in either list are full up to rounding errors and alias themselves
+}
+
+inline bool readBMP24(const char *path, Image &image) {
+    std::vector<uint8_t> d;
+    if (!readFile(path, d)) { return false; }
+
+    if ( (d.size() < BMP_HEADER_SIZE) || (get16(d, 0) != BMP_MAGIC) ) { return false; }
+    if ( (get16(d, 28) != 24) || (get32(d, 30) != BMP_COMPRESSION_NONE) ) { return false; }
+
+    uint32_t offset = get32(d, 10);
+    int32_t height = (int32_t)get32(d, 22);
+    image.width = get32(d, 18);
+    image.height = (height < 0) ? -height : height;
+
+    uint32_t rowSize = (image.width * 3 + 3) & ~3u;
+    if (d.size() < offset + rowSize * image.height) { return false; }
+
+    image.pixels.resize(image.width * image.height);
+    for (uint32_t y = 0; y < image.height; y++) {
+        // Frame streams rows bottom-up, flip top-down bitmaps
+        uint32_t srcRow = (height < 0) ? image.height - 1 - y : y;
+        const uint8_t *row = &d[offset + srcRow * rowSize];
+
+        for (uint32_t x = 0; x < image.width; x++) {
+            image.pixels[y * image.width + x] = RGB24ToRGB16(row[x*3 + 2], row[x*3 + 1], row[x*3]);
+        }
+    }
+
+    return true;
+}
+
+// Read image in any format understood by frame (first frame of animation), rows are returned in display order
+inline bool readImage(const char *path, Image &image) {
+    if (readBMP24(path, image)) { return true; }
+
+    std::vector<uint8_t> d;
+    if ( (!readFile(path, d)) || (d.size() < BMP_HEADER_SIZE) || (get16(d, 0) != BMP_MAGIC) || (get16(d, 28) != 16) ) {
+        return false;
+    }
+
+    uint32_t offset = get32(d, 10);
+    uint32_t compression = get32(d, 30);
+    uint16_t flags = (get16(d, 6) == BMP_FRAME_SIGNATURE) ? get16(d, 8) : 0;
+    image.width = get32(d, 18);
+    image.height = get32(d, 22);
+    uint32_t size = image.width * image.height;
+    image.pixels.resize(size);
+
+    if (compression == BMP_COMPRESSION_BITFIELDS) {
+        uint32_t rowSize = (image.width * 2 + 3) & ~3u;
+        if (d.size() < offset + rowSize * image.height) { return false; }
+
+        for (uint32_t y = 0; y < image.height; y++) {
+            for (uint32_t x = 0; x < image.width; x++) { image.pixels[y * image.width + x] = get16(d, offset + y * rowSize + x * 2); }
+        }
+    } else if (compression == BMP_COMPRESSION_RLE16) {
+        for (uint32_t i = 0, pos = offset; i < size; ) {
+            if (pos + 2 > d.size()) { return false; }
+            uint16_t header = get16(d, pos);
+            uint32_t n = std::min<uint32_t>((header & RLE16_COUNT_MASK) + 1, size - i);
+            pos += 2;
+
+            for (uint32_t j = 0; j < n; j++, i++) {
+                uint32_t at = (header & RLE16_RUN_FLAG) ? pos : pos + j * 2;
+                if (at + 2 > d.size()) { return false; }
+                image.pixels[i] = get16(d, at);
+            }
+
+            pos += (header & RLE16_RUN_FLAG) ? 2 : n * 2;
+        }
+    } else {
+        return false;
+    }
+
+    // Put interlaced rows back in place
+    if (flags & BMP_FLAG_INTERLACED) {
+        std::vector<uint16_t> pixels(size);
+        uint32_t src = 0;
+
+        for (uint8_t p = 0; p < INTERLACE_PASSES; p++) {
+            for (uint32_t row = interlaceStart[p]; row < image.height; row += interlaceStep[p], src++) {
+                std::copy(&image.pixels[src * image.width], &image.pixels[(src + 1) * image.width], &pixels[row * image.width]);
+            }
+        }
+
+        image.pixels.swap(pixels);
+    }
+
+    return true;
+}
+
+// Encode pixels into RLE16 packets, return number of pixels stored in runs
+inline uint32_t encodeRLE16(const std::vector<uint16_t> &pixels, std::vector<uint8_t> &out) {
+    uint32_t solid = 0;
+    size_t i = 0;
+
+    while (i < pixels.size()) {
+        size_t run = 1;
+        while ( (i + run < pixels.size()) && (pixels[i + run] == pixels[i]) && (run < RLE16_MAX_PACKET) ) { run++; }
+
+        if (run >= RLE16_MIN_RUN) {
+            put16(out, RLE16_RUN_FLAG | (run - 1));
+            put16(out, pixels[i]);
+            solid += run;
+            i += run;
+            continue;
+        }
+
+        // Collect literal pixels until next run long enough to be encoded
+        size_t literal = 0;
+        while ( (i + literal < pixels.size()) && (literal < RLE16_MAX_PACKET) ) {
+            size_t j = i + literal;
+            size_t next = 1;
+            while ( (j + next < pixels.size()) && (pixels[j + next] == pixels[j]) && (next < RLE16_MIN_RUN) ) { next++; }
+
+            if (next >= RLE16_MIN_RUN) { break; }
+            literal++;
+        }
+
+        put16(out, literal - 1);
+        for (size_t j = 0; j < literal; j++) { put16(out, pixels[i + j]); }
+        i += literal;
+    }
+
+    return solid;
+}
+
+// Reorder rows into interlace passes order
+inline void interlace(Image &image) {
+    std::vector<uint16_t> pixels;
+    pixels.reserve(image.pixels.size());
+
+    for (uint8_t p = 0; p < INTERLACE_PASSES; p++) {
+        for (uint32_t row = interlaceStart[p]; row < image.height; row += interlaceStep[p]) {
+            auto begin = image.pixels.begin() + row * image.width;
+            pixels.insert(pixels.end(), begin, begin + image.width);
+        }
+    }
+
+    image.pixels.swap(pixels);
+}
+
+// Append header of RLE16 bmp with optional caption, data of dataSize bytes must follow,
+// fileSize is size of whole file without caption
+inline void putRLE16Header(std::vector<uint8_t> &d, const Image &image, uint32_t dataSize, uint32_t fileSize, uint16_t flags,
+    const std::string &caption = "")
+{
+    std::string text = caption.substr(0, CAPTION_MAX_LEN);
+    uint32_t captionSize = text.empty() ? 0 : text.size() + 1;
+    if (captionSize) { flags |= BMP_FLAG_CAPTION; }
+
+    // File header
+    put16(d, BMP_MAGIC);
+    put32(d, fileSize + captionSize);
+    put16(d, BMP_FRAME_SIGNATURE);
+    put16(d, flags);
+    put32(d, BMP_HEADER_SIZE + captionSize);
+
+    // BITMAPINFOHEADER
+    put32(d, BMP_INFO_HEADER_SIZE);
+    put32(d, image.width);
+    put32(d, image.height);
+    put16(d, 1);
+    put16(d, 16);
+    put32(d, BMP_COMPRESSION_RLE16);
+    put32(d, dataSize);
+    put32(d, 2835);
+    put32(d, 2835);
+    put32(d, 0);
+    put32(d, 0);
+
+    // Caption is placed between header and pixel data
+    if (captionSize) {
+        d.push_back(text.size());
+        d.insert(d.end(), text.begin(), text.end());
+    }
+}
+
+// Pipeline source decoding RLE16 data from memory, same way as SDStorage decodes it from card
+class MemoryRLE16Source {
+public:
+    MemoryRLE16Source(const std::vector<uint8_t> &data): data(data), pos(0), packetLeft(0), runColor(0), inRun(false) {}
+
+    void rewind() {
+        this->pos = 0;
+        this->packetLeft = 0;
+    }
+
+    uint16_t readSolidSpan(uint16_t &color, uint16_t maxSize) {
+        if (this->packetLeft == 0) { this->readPacket(); }
+        if (!this->inRun) { return 0; }
+
+        uint16_t n = (this->packetLeft < maxSize) ? this->packetLeft : maxSize;
+        this->packetLeft -= n;
+        color = this->runColor;
+        return n;
+    }
+
+    void readImagePortion(uint16_t *buffer, uint16_t size) {
+        for (uint16_t i = 0; i < size; ) {
+            if (this->packetLeft == 0) { this->readPacket(); }
+
+            uint16_t n = (this->packetLeft < size - i) ? this->packetLeft : size - i;
+            if (this->inRun) {
+                for (uint16_t j = 0; j < n; j++) { buffer[i + j] = this->runColor; }
+            } else {
+                memcpy(&buffer[i], &this->data[this->pos], n * 2);
+                this->pos += n * 2;
+            }
+
+            i += n;
+            this->packetLeft -= n;
+        }
+    }
+
+private:
+    const std::vector<uint8_t> &data;
+    size_t pos; // Offset of next byte to read
+    uint16_t packetLeft; // Pixels left in current packet
+    uint16_t runColor;
+    bool inRun;
+
+    void readPacket() {
+        uint16_t header = get16(this->data, this->pos);
+        this->pos += 2;
+        this->inRun = header & RLE16_RUN_FLAG;
+        this->packetLeft = (header & RLE16_COUNT_MASK) + 1;
+
+        if (this->inRun) {
+            this->runColor = get16(this->data, this->pos);
+            this->pos += 2;
+        }
+    }
+};
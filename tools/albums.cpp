@@ -0,0 +1,62 @@
+/*
+albums.cpp
+
+PC tool generating index of images in nested album directories (see src/SDStorage/ImageFormat.h).
+Images directory of sd card and all its subdirectories (albums) are walked, every valid image
+gets 32 bit id: images of album first (numbered ones by number, then others by name), then its
+subalbums by name, so album with all subalbums covers consecutive ids.
+Frame opens any image directly through index, directories are not listed on frame.
+Images in flat directory named 0.bmp, 1.bmp, ... keep their numbers as ids, so thumbnails,
+weights and playlists built for them stay valid.
+Names must be 8.3 (sd library does not read long names), other files are skipped.
+Generate index again after images are added or changed.
+
+Build: g++ -O2 -std=c++11 -o albums albums.cpp
+Usage: albums <images directory> <index.bin>
+Put output into root directory of sd card.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cstdio>
+#include <string>
+
+#include "ImageTools.h"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: albums <images directory> <index.bin>\n");
+        return 1;
+    }
+
+    // Images directory itself is album 0, its name is not stored
+    Index index;
+    indexAlbum(index, argv[1], "", INDEX_NO_PARENT, 0);
+
+    if (index.images == 0) {
+        fprintf(stderr, "%s: no images\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> file;
+    putIndex(file, index);
+
+    if (!writeFile(argv[2], file)) {
+        fprintf(stderr, "%s: could not write\n", argv[2]);
+        return 1;
+    }
+
+    printf("%u images in %zu albums (%u skipped), %zu bytes\n", index.images, index.albums.size(), index.skipped, file.size());
+    return 0;
+}
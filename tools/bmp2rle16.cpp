@@ -0,0 +1,85 @@
+/*
+bmp2rle16.cpp
+
+PC tool converting 24 bit bmp images into RLE16 format (see src/SDStorage/ImageFormat.h)
+and reporting how many bytes single frame costs on SD card and display bus.
+
+Build: g++ -O2 -std=c++11 -o bmp2rle16 bmp2rle16.cpp
+Usage: bmp2rle16 [-i] [-c caption] <input.bmp> [output.bmp]
+Without output only statistics are printed.
+-i stores rows in interlace passes order, frame displays such image progressively.
+-c stores caption, frame draws it over image.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cstdio>
+#include <cstring>
+
+#include "ImageTools.h"
+
+int main(int argc, char **argv) {
+    uint16_t flags = 0;
+    std::string caption;
+
+    while (argc > 1) {
+        if (strcmp(argv[1], "-i") == 0) {
+            flags |= BMP_FLAG_INTERLACED;
+        } else if ( (strcmp(argv[1], "-c") == 0) && (argc > 2) ) {
+            caption = argv[2];
+            argv++;
+            argc--;
+        } else {
+            break;
+        }
+
+        argv++;
+        argc--;
+    }
+
+    if ( (argc < 2) || (argc > 3) ) {
+        fprintf(stderr, "Usage: bmp2rle16 [-i] [-c caption] <input.bmp> [output.bmp]\n");
+        return 1;
+    }
+
+    Image image;
+    if (!readBMP24(argv[1], image)) {
+        fprintf(stderr, "%s: not a 24 bit uncompressed bmp\n", argv[1]);
+        return 1;
+    }
+
+    if (flags & BMP_FLAG_INTERLACED) { interlace(image); }
+
+    std::vector<uint8_t> data;
+    uint32_t solid = encodeRLE16(image.pixels, data);
+    uint32_t size = image.width * image.height;
+
+    // Display receives every pixel (2 bytes) regardless of format, SD card traffic differs
+    printf("%s: %ux%u\n", argv[1], image.width, image.height);
+    printf("  panel bytes:      %u\n", size * 2);
+    printf("  sd bytes BMP24:   %u\n", size * 3);
+    printf("  sd bytes RLE16:   %zu (%.1f%%)\n", data.size(), 100.0 * data.size() / (size * 3));
+    printf("  solid span px:    %u (%.1f%%)\n", solid, 100.0 * solid / size);
+
+    std::vector<uint8_t> file;
+    putRLE16Header(file, image, data.size(), BMP_HEADER_SIZE + data.size(), flags, caption);
+    file.insert(file.end(), data.begin(), data.end());
+
+    if ( (argc == 3) && (!writeFile(argv[2], file)) ) {
+        fprintf(stderr, "%s: could not write\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,585 @@
+/*
+cardprep.cpp
+
+PC tool preparing sd card contents from folder of photos (JPEG, PNG or 24/32 bit BMP).
+Every photo is turned by its EXIF orientation, rotated to panel orientation, scaled to cover
+PANEL_WIDTH x PANEL_HEIGHT (middle is kept, with -k whole photo is kept with black borders),
+dithered into RGB565 and encoded into RLE16 (see src/SDStorage/ImageFormat.h).
+Photos are written into images directory numbered 0.bmp, 1.bmp, ..., subfolders of photos folder
+become albums with 8.3 names (nested folders too), then index and thumbnails files are written.
+Photos are processed in parallel by all cores, throughput is printed at the end.
+
+Build: g++ -O2 -std=c++11 -pthread -o cardprep cardprep.cpp -ljpeg -lpng
+Usage: cardprep [-j threads] [-k] [-i] [-n] <photos directory> <sd card directory>
+-j number of threads, all cores by default
+-k keep whole photo instead of cropping it to panel
+-i store rows interlaced, frame displays images progressively
+-n do not dither
+Images directory on card must be empty or missing, ui images are not copied.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include "ImageTools.h"
+
+#define PANEL_WIDTH 320 // Must match src/DigitalFrame/DigitalFrame.h
+#define PANEL_HEIGHT 480
+#define IMAGES_DIR "images" // Names must match src/SDStorage/SDStorage.h
+#define INDEX_FILE_NAME "index.bin"
+#define THUMBS_FILE_NAME "thumbs.bin"
+
+// Decoded photo, 8 bit RGB rows from top
+struct Photo {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> rgb;
+};
+
+struct Options {
+    bool keep = false;
+    bool interlaced = false;
+    bool dither = true;
+};
+
+// Photo and image file it becomes, jobs are ordered by image ids
+struct Job {
+    std::string source;
+    std::string output;
+    bool ok = false;
+};
+
+static bool hasExtension(const std::string &name, const char *ext) {
+    size_t n = strlen(ext);
+    return (name.size() > n) && (strcasecmp(name.c_str() + name.size() - n, ext) == 0);
+}
+
+static bool isPhoto(const std::string &name) {
+    return hasExtension(name, ".jpg") || hasExtension(name, ".jpeg") || hasExtension(name, ".png") || hasExtension(name, ".bmp");
+}
+
+// EXIF orientation (1 - 8) from APP1 marker, 1 if missing
+static uint8_t exifOrientation(const uint8_t *d, size_t size) {
+    if ( (size < 14) || (memcmp(d, "Exif\0\0", 6) != 0) ) { return 1; }
+
+    const uint8_t *tiff = d + 6;
+    size -= 6;
+    bool little = tiff[0] == 'I';
+    auto get16 = [&](size_t pos) -> uint32_t { return little ? tiff[pos] | (tiff[pos+1] << 8) : (tiff[pos] << 8) | tiff[pos+1]; };
+    auto get32 = [&](size_t pos) -> uint32_t { return little ? get16(pos) | (get16(pos+2) << 16) : (get16(pos) << 16) | get16(pos+2); };
+
+    uint32_t ifd = get32(4);
+    if (ifd + 2 > size) { return 1; }
+
+    uint32_t entries = get16(ifd);
+    for (uint32_t i = 0; i < entries; i++) {
+        size_t entry = ifd + 2 + i * 12;
+        if (entry + 12 > size) { break; }
+        if (get16(entry) == 0x0112) {
+            uint32_t value = get16(entry + 8);
+            return ( (value >= 1) && (value <= 8) ) ? value : 1;
+        }
+    }
+
+    return 1;
+}
+
+struct JpegError {
+    jpeg_error_mgr mgr;
+    jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo) {
+    longjmp(((JpegError*)cinfo->err)->jump, 1);
+}
+
+// DCT scaling skips most of work on large photos, result is still larger than panel
+static bool readJPEG(const char *path, Photo &photo, uint8_t &orientation) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { return false; }
+
+    jpeg_decompress_struct cinfo;
+    JpegError error;
+    cinfo.err = jpeg_std_error(&error.mgr);
+    error.mgr.error_exit = jpegErrorExit;
+
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(f);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, f);
+    jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+    jpeg_read_header(&cinfo, TRUE);
+
+    orientation = 1;
+    for (jpeg_saved_marker_ptr m = cinfo.marker_list; m; m = m->next) {
+        if (m->marker == JPEG_APP0 + 1) { orientation = exifOrientation(m->data, m->data_length); }
+    }
+
+    uint32_t shortSide = std::min(cinfo.image_width, cinfo.image_height);
+    uint32_t longSide = std::max(cinfo.image_width, cinfo.image_height);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 1;
+    for (uint32_t denom = 8; denom > 1; denom /= 2) {
+        if ( (shortSide / denom >= PANEL_WIDTH) && (longSide / denom >= PANEL_HEIGHT) ) {
+            cinfo.scale_denom = denom;
+            break;
+        }
+    }
+
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    photo.width = cinfo.output_width;
+    photo.height = cinfo.output_height;
+    photo.rgb.resize((size_t)photo.width * photo.height * 3);
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = &photo.rgb[(size_t)cinfo.output_scanline * photo.width * 3];
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    fclose(f);
+    return true;
+}
+
+static bool readPNG(const char *path, Photo &photo) {
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_file(&png, path)) { return false; }
+
+    // Transparent pixels are composed onto black buffer
+    png.format = PNG_FORMAT_RGB;
+    photo.width = png.width;
+    photo.height = png.height;
+    photo.rgb.assign(PNG_IMAGE_SIZE(png), 0);
+
+    if (!png_image_finish_read(&png, nullptr, photo.rgb.data(), 0, nullptr)) {
+        png_image_free(&png);
+        return false;
+    }
+
+    return true;
+}
+
+static bool readBMP(const char *path, Photo &photo) {
+    std::vector<uint8_t> d;
+    if ( (!readFile(path, d)) || (d.size() < BMP_HEADER_SIZE) || (get16(d, 0) != BMP_MAGIC) ) { return false; }
+
+    uint16_t bitsPerPixel = get16(d, 28);
+    uint32_t compression = get32(d, 30);
+    if ( ((bitsPerPixel != 24) && (bitsPerPixel != 32)) || ((compression != BMP_COMPRESSION_NONE) && (compression != BMP_COMPRESSION_BITFIELDS)) ) {
+        return false;
+    }
+
+    uint32_t offset = get32(d, 10);
+    int32_t height = (int32_t)get32(d, 22);
+    photo.width = get32(d, 18);
+    photo.height = (height < 0) ? -height : height;
+
+    uint32_t bytesPerPixel = bitsPerPixel / 8;
+    uint32_t rowSize = (photo.width * bytesPerPixel + 3) & ~3u;
+    if (d.size() < offset + (size_t)rowSize * photo.height) { return false; }
+
+    photo.rgb.resize((size_t)photo.width * photo.height * 3);
+    for (uint32_t y = 0; y < photo.height; y++) {
+        // Bottom-up bitmaps are flipped
+        uint32_t srcRow = (height < 0) ? y : photo.height - 1 - y;
+        const uint8_t *src = &d[offset + (size_t)srcRow * rowSize];
+        uint8_t *dst = &photo.rgb[(size_t)y * photo.width * 3];
+
+        for (uint32_t x = 0; x < photo.width; x++, src += bytesPerPixel, dst += 3) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+        }
+    }
+
+    return true;
+}
+
+// Apply EXIF orientation and rotate landscape photo to portrait panel
+static void orient(Photo &photo, uint8_t orientation) {
+    bool transpose = (orientation >= 5);
+    bool flipX = (orientation == 2) || (orientation == 3) || (orientation == 6) || (orientation == 7);
+    bool flipY = (orientation == 3) || (orientation == 4) || (orientation == 7) || (orientation == 8);
+
+    uint32_t width = transpose ? photo.height : photo.width;
+    uint32_t height = transpose ? photo.width : photo.height;
+
+    // Landscape photo is turned clockwise after orientation is applied
+    bool turn = (width > height) != (PANEL_WIDTH > PANEL_HEIGHT);
+    if ( (!transpose) && (!flipX) && (!flipY) && (!turn) ) { return; }
+
+    uint32_t outWidth = turn ? height : width;
+    uint32_t outHeight = turn ? width : height;
+    std::vector<uint8_t> rgb((size_t)outWidth * outHeight * 3);
+
+    for (uint32_t y = 0; y < outHeight; y++) {
+        for (uint32_t x = 0; x < outWidth; x++) {
+            // Position in oriented photo
+            uint32_t ox = turn ? y : x;
+            uint32_t oy = turn ? height - 1 - x : y;
+
+            // Position in stored photo
+            uint32_t sx = flipX ? width - 1 - ox : ox;
+            uint32_t sy = flipY ? height - 1 - oy : oy;
+            if (transpose) { std::swap(sx, sy); }
+
+            memcpy(&rgb[((size_t)y * outWidth + x) * 3], &photo.rgb[((size_t)sy * photo.width + sx) * 3], 3);
+        }
+    }
+
+    photo.width = outWidth;
+    photo.height = outHeight;
+    photo.rgb.swap(rgb);
+}
+
+// Scale photo to panel size, every panel pixel averages photo pixels it covers
+static void fitToPanel(const Photo &photo, Photo &out, bool keep) {
+    double scaleX = (double)PANEL_WIDTH / photo.width;
+    double scaleY = (double)PANEL_HEIGHT / photo.height;
+    double scale = keep ? std::min(scaleX, scaleY) : std::max(scaleX, scaleY);
+
+    // Area of panel covered by photo, rest stays black
+    double width = photo.width * scale, height = photo.height * scale;
+    double left = (PANEL_WIDTH - width) / 2, top = (PANEL_HEIGHT - height) / 2;
+
+    out.width = PANEL_WIDTH;
+    out.height = PANEL_HEIGHT;
+    out.rgb.assign(PANEL_WIDTH * PANEL_HEIGHT * 3, 0);
+
+    for (uint32_t y = 0; y < PANEL_HEIGHT; y++) {
+        double fy1 = (y - top) / scale, fy2 = (y + 1 - top) / scale;
+        if ( (fy2 <= 0) || (fy1 >= photo.height) ) { continue; }
+        uint32_t y1 = std::max(0.0, fy1), y2 = std::min<double>(photo.height, std::max(fy2, (double)y1 + 1));
+
+        for (uint32_t x = 0; x < PANEL_WIDTH; x++) {
+            double fx1 = (x - left) / scale, fx2 = (x + 1 - left) / scale;
+            if ( (fx2 <= 0) || (fx1 >= photo.width) ) { continue; }
+            uint32_t x1 = std::max(0.0, fx1), x2 = std::min<double>(photo.width, std::max(fx2, (double)x1 + 1));
+
+            uint32_t sum[3] = {0, 0, 0}, n = 0;
+            for (uint32_t sy = y1; sy < y2; sy++) {
+                const uint8_t *p = &photo.rgb[((size_t)sy * photo.width + x1) * 3];
+                for (uint32_t sx = x1; sx < x2; sx++, n++, p += 3) {
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                }
+            }
+
+            uint8_t *dst = &out.rgb[((size_t)y * PANEL_WIDTH + x) * 3];
+            for (uint8_t c = 0; c < 3; c++) { dst[c] = (sum[c] + n / 2) / n; }
+        }
+    }
+}
+
+// Quantize into RGB565 in bmp row order, Floyd-Steinberg error diffusion hides banding of gradients
+static void toRGB565(const Photo &photo, Image &image, bool dither) {
+    image.width = photo.width;
+    image.height = photo.height;
+    image.pixels.resize(image.width * image.height);
+
+    const int levels[3] = {31, 63, 31};
+    std::vector<int> error((photo.width + 2) * 3 * 2, 0);
+    int *current = &error[0], *next = &error[(photo.width + 2) * 3];
+
+    for (uint32_t y = 0; y < photo.height; y++) {
+        std::fill(next, next + (photo.width + 2) * 3, 0);
+
+        for (uint32_t x = 0; x < photo.width; x++) {
+            const uint8_t *p = &photo.rgb[((size_t)y * photo.width + x) * 3];
+            int q[3];
+
+            for (uint8_t c = 0; c < 3; c++) {
+                int v = p[c] + (dither ? current[(x + 1) * 3 + c] / 16 : 0);
+                v = std::max(0, std::min(255, v));
+                q[c] = (v * levels[c] + 127) / 255;
+
+                int e = v - q[c] * 255 / levels[c];
+                current[(x + 2) * 3 + c] += e * 7;
+                next[x * 3 + c] += e * 3;
+                next[(x + 1) * 3 + c] += e * 5;
+                next[(x + 2) * 3 + c] += e;
+            }
+
+            image.pixels[(photo.height - 1 - y) * photo.width + x] = (q[0] << 11) | (q[1] << 5) | q[2];
+        }
+
+        std::swap(current, next);
+    }
+}
+
+static bool convert(const Job &job, const Options &options, std::vector<uint8_t> &thumb) {
+    Photo photo;
+    uint8_t orientation = 1;
+    bool read = (hasExtension(job.source, ".png")) ? readPNG(job.source.c_str(), photo)
+        : (hasExtension(job.source, ".bmp")) ? readBMP(job.source.c_str(), photo)
+        : readJPEG(job.source.c_str(), photo, orientation);
+
+    if ( (!read) || (photo.width == 0) || (photo.height == 0) ) { return false; }
+
+    orient(photo, orientation);
+
+    Photo panel;
+    fitToPanel(photo, panel, options.keep);
+
+    Image image;
+    toRGB565(panel, image, options.dither);
+    putThumbnail(thumb, image);
+
+    uint16_t flags = 0;
+    if (options.interlaced) {
+        interlace(image);
+        flags |= BMP_FLAG_INTERLACED;
+    }
+
+    std::vector<uint8_t> data;
+    encodeRLE16(image.pixels, data);
+
+    std::vector<uint8_t> file;
+    putRLE16Header(file, image, data.size(), BMP_HEADER_SIZE + data.size(), flags);
+    file.insert(file.end(), data.begin(), data.end());
+    return writeFile(job.output.c_str(), file);
+}
+
+// Missing directory is empty too
+static bool isEmptyDirectory(const std::string &path) {
+    DIR *dir = opendir(path.c_str());
+    if (!dir) { return true; }
+
+    bool empty = true;
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') { empty = false; }
+    }
+
+    closedir(dir);
+    return empty;
+}
+
+// Album name made of up to 8 letters and digits of folder name, unique in its parent
+static std::string albumName(const std::string &folder, const std::vector<std::string> &taken) {
+    std::string base;
+    for (char c : folder) {
+        if ( (isalnum((unsigned char)c)) && (base.size() < 8) ) { base += toupper((unsigned char)c); }
+    }
+    if (base.empty()) { base = "ALBUM"; }
+
+    std::string name = base;
+    for (uint32_t i = 1; std::find(taken.begin(), taken.end(), name) != taken.end(); i++) {
+        std::string suffix = "~" + std::to_string(i);
+        name = base.substr(0, 8 - suffix.size()) + suffix;
+    }
+
+    return name;
+}
+
+// Photos of folder become images of album in name order, then subfolders become subalbums,
+// same order as ids are assigned by indexAlbum
+static bool planAlbum(const std::string &source, const std::string &output, uint8_t depth, std::vector<Job> &jobs) {
+    DIR *dir = opendir(source.c_str());
+    if (!dir) {
+        fprintf(stderr, "%s: could not open directory\n", source.c_str());
+        return false;
+    }
+
+    std::vector<std::string> photos, folders;
+    while (dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name[0] == '.') { continue; }
+
+        struct stat st;
+        if (stat((source + "/" + name).c_str(), &st) != 0) { continue; }
+
+        if (S_ISDIR(st.st_mode)) {
+            folders.push_back(name);
+        } else if (isPhoto(name)) {
+            photos.push_back(name);
+        }
+    }
+
+    closedir(dir);
+    std::sort(photos.begin(), photos.end());
+    std::sort(folders.begin(), folders.end());
+
+    if ( (mkdir(output.c_str(), 0755) != 0) && (errno != EEXIST) ) {
+        fprintf(stderr, "%s: could not create directory\n", output.c_str());
+        return false;
+    }
+
+    for (size_t i = 0; i < photos.size(); i++) {
+        Job job;
+        job.source = source + "/" + photos[i];
+        job.output = output + "/" + std::to_string(i) + ".bmp";
+        jobs.push_back(job);
+    }
+
+    // Subalbums are visited in order of their names on card
+    std::vector<std::pair<std::string, std::string>> albums;
+    std::vector<std::string> taken;
+    for (const std::string &folder : folders) {
+        taken.push_back(albumName(folder, taken));
+        albums.push_back({taken.back(), folder});
+    }
+    std::sort(albums.begin(), albums.end());
+
+    for (const auto &album : albums) {
+        if (depth >= INDEX_MAX_DEPTH) {
+            fprintf(stderr, "%s/%s: too deep, skipped\n", source.c_str(), album.second.c_str());
+            continue;
+        }
+
+        if (!planAlbum(source + "/" + album.second, output + "/" + album.first, depth + 1, jobs)) { return false; }
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+    while (argc > 1) {
+        if ( (strcmp(argv[1], "-j") == 0) && (argc > 2) ) {
+            threads = std::max(1, atoi(argv[2]));
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "-k") == 0) {
+            options.keep = true;
+        } else if (strcmp(argv[1], "-i") == 0) {
+            options.interlaced = true;
+        } else if (strcmp(argv[1], "-n") == 0) {
+            options.dither = false;
+        } else {
+            break;
+        }
+
+        argv++;
+        argc--;
+    }
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: cardprep [-j threads] [-k] [-i] [-n] <photos directory> <sd card directory>\n");
+        return 1;
+    }
+
+    std::string card = argv[2];
+    std::string imagesDir = card + "/" + IMAGES_DIR;
+
+    // Old images would get mixed with new numbering
+    if (!isEmptyDirectory(imagesDir)) {
+        fprintf(stderr, "%s: not empty\n", imagesDir.c_str());
+        return 1;
+    }
+
+    std::vector<Job> jobs;
+    if (!planAlbum(argv[1], imagesDir, 0, jobs)) { return 1; }
+
+    if (jobs.empty()) {
+        fprintf(stderr, "%s: no photos\n", argv[1]);
+        return 1;
+    }
+
+    // Workers take next photo until all are done, thumbnails are kept in id order
+    std::vector<std::vector<uint8_t>> thumbs(jobs.size());
+    std::atomic<size_t> next(0);
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            jobs[i].ok = convert(jobs[i], options, thumbs[i]);
+            if (!jobs[i].ok) { fprintf(stderr, "%s: could not convert\n", jobs[i].source.c_str()); }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (uint32_t i = 0; i < threads; i++) { pool.emplace_back(worker); }
+    for (std::thread &t : pool) { t.join(); }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Failed photos leave gaps, rest of album is numbered again so numbers stay continuous
+    uint32_t failed = 0;
+    std::vector<std::vector<uint8_t>> written;
+    std::string album;
+    uint32_t number = 0;
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        std::string dir = jobs[i].output.substr(0, jobs[i].output.find_last_of('/'));
+        if (dir != album) {
+            album = dir;
+            number = 0;
+        }
+
+        if (!jobs[i].ok) {
+            failed++;
+            continue;
+        }
+
+        std::string path = dir + "/" + std::to_string(number++) + ".bmp";
+        if (path != jobs[i].output) { rename(jobs[i].output.c_str(), path.c_str()); }
+        written.push_back(std::move(thumbs[i]));
+    }
+
+    Index index;
+    indexAlbum(index, imagesDir, "", INDEX_NO_PARENT, 0);
+
+    std::vector<uint8_t> file;
+    putIndex(file, index);
+    if ( (index.images != written.size()) || (!writeFile((card + "/" + INDEX_FILE_NAME).c_str(), file)) ) {
+        fprintf(stderr, "%s: could not write index\n", card.c_str());
+        return 1;
+    }
+
+    // Gallery numbers thumbnails by image ids
+    if (written.size() <= UINT16_MAX) {
+        file.clear();
+        put16(file, THUMBS_MAGIC);
+        put16(file, THUMB_WIDTH);
+        put16(file, THUMB_HEIGHT);
+        put16(file, written.size());
+        for (const std::vector<uint8_t> &thumb : written) { file.insert(file.end(), thumb.begin(), thumb.end()); }
+
+        if (!writeFile((card + "/" + THUMBS_FILE_NAME).c_str(), file)) {
+            fprintf(stderr, "%s: could not write thumbnails\n", card.c_str());
+            return 1;
+        }
+    } else {
+        fprintf(stderr, "too many images for thumbnails, gallery is not available\n");
+    }
+
+    printf("%zu images in %zu albums (%u failed), %.1f s, %.1f images/s on %u threads\n",
+        written.size(), index.albums.size(), failed, seconds, jobs.size() / seconds, threads);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+flipbook.cpp
+
+PC tool encoding sequence of 24 bit bmp frames into animated image (see src/SDStorage/ImageFormat.h).
+First frame is stored as RLE16 image, every next frame only as rectangles changed since previous one.
+Last delta frame goes back to first frame, so animation loops without full redraw.
+
+Build: g++ -O2 -std=c++11 -o flipbook flipbook.cpp
+Usage: flipbook [-t frame_interval_ms] <output.bmp> <frame0.bmp> <frame1.bmp> ...
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "ImageTools.h"
+
+#define TILE 16 // Changes are detected in TILE x TILE blocks
+
+struct DeltaRect {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+};
+
+// Find rectangles covering all pixels that differ between frames
+static std::vector<DeltaRect> diff(const Image &prev, const Image &next) {
+    std::vector<DeltaRect> rects;
+    uint32_t tilesX = (next.width + TILE - 1) / TILE;
+
+    for (uint32_t ty = 0; ty * TILE < next.height; ty++) {
+        uint32_t y = ty * TILE;
+        uint32_t h = std::min<uint32_t>(TILE, next.height - y);
+
+        // Mark changed tiles of this tile row
+        std::vector<bool> changed(tilesX, false);
+        for (uint32_t row = y; row < y + h; row++) {
+            for (uint32_t x = 0; x < next.width; x++) {
+                uint32_t i = row * next.width + x;
+                if (prev.pixels[i] != next.pixels[i]) { changed[x / TILE] = true; }
+            }
+        }
+
+        // Join neighbour changed tiles, extend rectangle of previous tile row if it has the same span
+        for (uint32_t tx = 0; tx < tilesX; ) {
+            if (!changed[tx]) { tx++; continue; }
+
+            uint32_t end = tx;
+            while ( (end < tilesX) && (changed[end]) ) { end++; }
+
+            DeltaRect r = {(uint16_t)(tx * TILE), (uint16_t)y, (uint16_t)(std::min<uint32_t>(end * TILE, next.width) - tx * TILE), (uint16_t)h};
+
+            bool merged = false;
+            for (DeltaRect &o : rects) {
+                if ( (o.x == r.x) && (o.width == r.width) && (o.y + o.height == r.y) ) {
+                    o.height += r.height;
+                    merged = true;
+                    break;
+                }
+            }
+            if (!merged) { rects.push_back(r); }
+
+            tx = end;
+        }
+    }
+
+    return rects;
+}
+
+static void putDelta(std::vector<uint8_t> &d, const Image &next, const std::vector<DeltaRect> &rects) {
+    put16(d, rects.size());
+
+    for (const DeltaRect &r : rects) {
+        put16(d, r.x);
+        put16(d, r.y);
+        put16(d, r.width);
+        put16(d, r.height);
+
+        for (uint32_t row = r.y; row < (uint32_t)(r.y + r.height); row++) {
+            for (uint32_t x = r.x; x < (uint32_t)(r.x + r.width); x++) {
+                put16(d, next.pixels[row * next.width + x]);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    uint16_t interval = 100;
+    if ( (argc > 2) && (strcmp(argv[1], "-t") == 0) ) {
+        interval = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: flipbook [-t frame_interval_ms] <output.bmp> <frame0.bmp> <frame1.bmp> ...\n");
+        return 1;
+    }
+
+    std::vector<Image> frames(argc - 2);
+    for (int i = 2; i < argc; i++) {
+        Image &f = frames[i - 2];
+        if (!readBMP24(argv[i], f)) {
+            fprintf(stderr, "%s: not a 24 bit uncompressed bmp\n", argv[i]);
+            return 1;
+        }
+
+        if ( (f.width != frames[0].width) || (f.height != frames[0].height) ) {
+            fprintf(stderr, "%s: size differs from first frame\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> first;
+    encodeRLE16(frames[0].pixels, first);
+
+    // Animation header and delta frames, last one goes back to first frame
+    std::vector<uint8_t> deltas;
+    put16(deltas, ANIMATION_MAGIC);
+    put16(deltas, frames.size());
+    put16(deltas, interval);
+
+    printf("frame 0: %zu bytes (RLE16)\n", first.size());
+    size_t total = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        const Image &next = frames[(i + 1) % frames.size()];
+        std::vector<DeltaRect> rects = diff(frames[i], next);
+
+        size_t before = deltas.size();
+        putDelta(deltas, next, rects);
+        total += deltas.size() - before;
+
+        printf("delta %zu -> %zu: %zu rects, %zu bytes\n", i, (i + 1) % frames.size(), rects.size(), deltas.size() - before);
+    }
+
+    Image &image = frames[0];
+    printf("average delta: %zu bytes per frame, full frame: %u bytes\n", total / frames.size(), image.width * image.height * 2);
+
+    std::vector<uint8_t> file;
+    putRLE16Header(file, image, first.size(), BMP_HEADER_SIZE + first.size() + deltas.size(), BMP_FLAG_ANIMATION);
+    file.insert(file.end(), first.begin(), first.end());
+    file.insert(file.end(), deltas.begin(), deltas.end());
+
+    if (!writeFile(argv[1], file)) {
+        fprintf(stderr, "%s: could not write\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
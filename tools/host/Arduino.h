@@ -0,0 +1,162 @@
+/*
+Arduino.h
+
+Arduino core functions used by frame sources, implemented on PC for simulation (see Host.h).
+Time is virtual, it passes only when simulated device does something, random() is the same
+generator as in avr-libc, so simulated frame picks the same images as device with the same seed.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+
+#define PROGMEM
+#define A0 14
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+#define DEC 10
+#define HEX 16
+
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p) (*(p))
+inline void *memcpy_P(void *d, const void *s, size_t n) { return memcpy(d, s, n); }
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper*)(s))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// unsigned long is 32 bit on AVR, so differences of times are computed modulo 2^32 as on device
+uint32_t millis();
+uint32_t micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// long is 32 bit on AVR, results are computed the same way
+int32_t random(int32_t howbig);
+int32_t random(int32_t howsmall, int32_t howbig);
+void randomSeed(unsigned long seed);
+int analogRead(uint8_t pin);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+inline int32_t map(int32_t x, int32_t inMin, int32_t inMax, int32_t outMin, int32_t outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+template <class T, class U> auto min(T a, U b) -> typename std::decay<decltype(a < b ? a : b)>::type { return (a < b) ? a : b; }
+template <class T, class U> auto max(T a, U b) -> typename std::decay<decltype(a < b ? a : b)>::type { return (a > b) ? a : b; }
+
+// Buffer of every String is counted as heap (see Host::heapPeak)
+class String {
+public:
+    String(const char *s = ""): s(s ? s : "") { this->account(); }
+    String(const std::string &s): s(s) { this->account(); }
+    String(const String &o): s(o.s) { this->account(); }
+    explicit String(char c): s(1, c) { this->account(); }
+    explicit String(unsigned char n): s(std::to_string(n)) { this->account(); }
+    explicit String(int n): s(std::to_string(n)) { this->account(); }
+    explicit String(unsigned int n): s(std::to_string(n)) { this->account(); }
+    explicit String(long n): s(std::to_string(n)) { this->account(); }
+    explicit String(unsigned long n): s(std::to_string(n)) { this->account(); }
+    ~String() { this->s.clear(); this->account(); }
+
+    String &operator=(const String &o) { this->s = o.s; this->account(); return *this; }
+    String operator+(const String &o) const { return String(this->s + o.s); }
+    String operator+(const char *o) const { return String(this->s + o); }
+    String operator+(char c) const { return String(this->s + c); }
+    String &operator+=(const String &o) { this->s += o.s; this->account(); return *this; }
+    String &operator+=(char c) { this->s += c; this->account(); return *this; }
+    bool operator==(const String &o) const { return this->s == o.s; }
+    bool operator!=(const String &o) const { return this->s != o.s; }
+    char operator[](unsigned int i) const { return (i < this->s.size()) ? this->s[i] : 0; }
+
+    const char *c_str() const { return this->s.c_str(); }
+    unsigned int length() const { return this->s.size(); }
+    bool startsWith(const String &o) const { return this->s.compare(0, o.s.size(), o.s) == 0; }
+    bool endsWith(const String &o) const { return (this->s.size() >= o.s.size()) && (this->s.compare(this->s.size() - o.s.size(), o.s.size(), o.s) == 0); }
+    long toInt() const { return atol(this->s.c_str()); }
+    int indexOf(char c) const { size_t i = this->s.find(c); return (i == std::string::npos) ? -1 : (int)i; }
+    int lastIndexOf(char c) const { size_t i = this->s.rfind(c); return (i == std::string::npos) ? -1 : (int)i; }
+    String substring(unsigned int from) const { return String(this->s.substr(std::min<size_t>(from, this->s.size()))); }
+    String substring(unsigned int from, unsigned int to) const { return (to > from) ? this->substring(from).s.substr(0, to - from) : String(); }
+
+private:
+    std::string s;
+    uint32_t held = 0; // Bytes of AVR heap taken by buffer, empty String has no buffer
+
+    void account(); // Pass change of held bytes to Host
+};
+
+inline String operator+(const char *a, const String &b) { return String(a) + b; }
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const uint8_t *buffer, size_t n) { for (size_t i = 0; i < n; i++) { this->write(buffer[i]); } return n; }
+
+    size_t print(const char *s) { return this->write((const uint8_t*)s, strlen(s)); }
+    size_t print(const __FlashStringHelper *s) { return this->print((const char*)s); }
+    size_t print(const String &s) { return this->print(s.c_str()); }
+    size_t print(char c) { return this->write(c); }
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(long n, int base = DEC) { return (n < 0) ? this->print('-') + this->print((unsigned long)-n, base) : this->print((unsigned long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return this->print((unsigned long)n, base); }
+    size_t print(int n, int base = DEC) { return this->print((long)n, base); }
+    size_t print(unsigned char n, int base = DEC) { return this->print((unsigned long)n, base); }
+    size_t print(double n, int digits = 2);
+
+    template <class T> size_t println(T value) { return this->print(value) + this->println(); }
+    template <class T> size_t println(T value, int base) { return this->print(value, base) + this->println(); }
+    size_t println() { return this->print("\r\n"); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+};
+
+// Lines written over Serial are passed to Host::serialLine
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) { this->ready = true; }
+    explicit operator bool() { return this->ready; }
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+private:
+    bool ready = false;
+    std::string line;
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,864 @@
+/*
+Host.cpp
+
+Implementation of Arduino core, libraries and Host simulation control on PC.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cctype>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <Arduino.h>
+#include <SD.h>
+#include <SPI.h>
+#include <ILI9486.h>
+#include <XPT2046_Touchscreen.h>
+
+#include "Host.h"
+
+#define BLOCK_SIZE 512
+#define DATA_START_BLOCK 8192 // Block of cluster 2, first cluster of data area
+#define FAT_DEFAULT_DATE ((20 << 9) | (1 << 5) | 1) // 2000-01-01, date of files written without clock
+
+HardwareSerial Serial;
+SPIClass SPI;
+SDClass SD;
+
+Host::Counters Host::counters = {};
+void (*Host::serialLine)(const char *line) = nullptr;
+
+static uint64_t now = 0; // Virtual time [ns]
+static uint16_t analogValue = 0;
+static uint32_t randomState = 1;
+
+static bool cardPresent = true;
+static bool rawAccess = true;
+static uint32_t rawErrorInterval = 0;
+
+static uintptr_t stackBottom = 0; // Set by Host::markStack()
+static uint32_t stackDeepest = 0;
+static uint32_t heapUsed = 0; // String buffers
+static uint32_t heapDeepest = 0;
+
+// File or directory of card, files are read from PC until frame writes them
+struct Node {
+    bool dir;
+    std::string hostPath;
+    uint32_t hostSize; // Size of file on PC
+    bool modified; // Data is kept in memory only
+    uint32_t users; // Opened files
+    std::vector<uint8_t> data; // Loaded while file is opened or streamed, or after it was modified
+    std::vector<uint32_t> blocks; // Blocks of card holding file, in file order
+    uint16_t writeDate; // FAT date and time of last write
+    uint16_t writeTime;
+};
+
+// Nodes by upper case path without leading slash, root is ""
+static std::map<std::string, std::shared_ptr<Node>> nodes;
+
+// Block of card and its place in file
+struct BlockOwner {
+    std::shared_ptr<Node> node;
+    uint32_t index;
+};
+
+// Owners of blocks from DATA_START_BLOCK, blocks are never reused, card does not get full
+static std::vector<BlockOwner> cardBlocks;
+
+// Card side of SPI protocol, only commands sent by RawStream are answered
+static uint8_t sdCsPin = 0xFF; // Set by SD.begin() or Sd2Card::init()
+static bool sdSelected = false;
+static bool sdInitialized = false; // Card removed since initialization does not answer
+static uint8_t sdCommand[6];
+static uint8_t sdCommandLen = 0;
+static std::deque<uint8_t> sdResponse; // Bytes sent by card before streamed blocks
+static bool sdStreaming = false;
+static uint32_t sdBlock = 0; // Streamed block
+static uint16_t sdBlockPos = 0; // Position in token, data and CRC of streamed block
+static uint32_t sdBlocksStreamed = 0;
+
+struct HostFile {
+    std::shared_ptr<Node> node;
+    std::string key;
+    char name[13];
+    uint32_t pos;
+    uint8_t mode;
+    bool open;
+    std::string lastChild; // Key of entry returned by openNextFile
+
+    ~HostFile() { this->close(); }
+
+    void close() {
+        if (!this->open) { return; }
+        this->open = false;
+
+        // Unmodified data is read from PC again next time
+        if ( (--this->node->users == 0) && (!this->node->modified) ) { std::vector<uint8_t>().swap(this->node->data); }
+    }
+};
+
+struct Touch {
+    uint32_t ms;
+    int16_t x, y;
+};
+
+static std::deque<Touch> touches;
+
+static uint16_t screen[HOST_PANEL_WIDTH * HOST_PANEL_HEIGHT];
+static uint32_t textHash = 0; // Texts are not rasterized, drawn strings are hashed since last clear
+static uint8_t backlightLevel = 0;
+
+// Called from simulated hardware, so deepest frame stack is found at its leaf calls
+__attribute__((noinline)) static void sampleStack() {
+    uintptr_t sp = (uintptr_t)__builtin_frame_address(0);
+    if ( (stackBottom > sp) && (stackBottom - sp > stackDeepest) ) { stackDeepest = stackBottom - sp; }
+}
+
+static uint32_t fnv(uint32_t hash, const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; i++) { hash = (hash ^ p[i]) * 16777619u; }
+    return hash;
+}
+
+// Arduino core
+
+uint32_t millis() { return (uint32_t)(now / 1000000); }
+uint32_t micros() { return (uint32_t)(now / 1000); }
+void delay(unsigned long ms) { now += (uint64_t)ms * 1000000; }
+void delayMicroseconds(unsigned int us) { now += (uint64_t)us * 1000; }
+
+// Park-Miller generator of avr-libc random()
+static int32_t nextRandom() {
+    int32_t x = (randomState == 0) ? 123459876 : randomState;
+    int32_t hi = x / 127773, lo = x % 127773;
+    x = 16807 * lo - 2836 * hi;
+    if (x < 0) { x += 0x7FFFFFFF; }
+    randomState = x;
+    return x % ((uint32_t)0x7FFFFFFF + 1);
+}
+
+int32_t random(int32_t howbig) { return (howbig == 0) ? 0 : nextRandom() % howbig; }
+int32_t random(int32_t howsmall, int32_t howbig) { return (howsmall >= howbig) ? howsmall : random(howbig - howsmall) + howsmall; }
+void randomSeed(unsigned long seed) { if (seed != 0) { randomState = seed; } }
+int analogRead(uint8_t pin) { return (pin == A0) ? analogValue : 0; }
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin == sdCsPin) { sdSelected = (value == LOW); }
+}
+int digitalRead(uint8_t) { return LOW; }
+
+void String::account() {
+    uint32_t bytes = this->s.empty() ? 0 : this->s.size() + 1;
+    Host::heapChange((int32_t)bytes - (int32_t)this->held);
+    this->held = bytes;
+}
+
+size_t Print::print(unsigned long n, int base) {
+    char text[33];
+    char *p = text + sizeof(text) - 1;
+    *p = '\0';
+    do {
+        uint8_t digit = n % base;
+        *--p = (digit < 10) ? '0' + digit : 'A' + digit - 10;
+        n /= base;
+    } while (n);
+
+    return this->print(p);
+}
+
+size_t Print::print(double n, int digits) {
+    char text[40];
+    snprintf(text, sizeof(text), "%.*f", digits, n);
+    return this->print(text);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (c == '\r') { return 1; }
+    if (c != '\n') {
+        this->line += (char)c;
+        return 1;
+    }
+
+    if (Host::serialLine) { Host::serialLine(this->line.c_str()); } else { puts(this->line.c_str()); }
+    this->line.clear();
+    return 1;
+}
+
+// Card side of SPI
+
+static void loadNode(Node &node);
+
+// Copy n bytes of block from offset, bytes past end of file and blocks without file are 0
+static void copyBlock(uint32_t block, uint16_t offset, uint8_t *buffer, uint16_t n) {
+    memset(buffer, 0, n);
+    if ( (block < DATA_START_BLOCK) || (block - DATA_START_BLOCK >= cardBlocks.size()) ) { return; }
+
+    BlockOwner &owner = cardBlocks[block - DATA_START_BLOCK];
+    if (!owner.node) { return; }
+
+    loadNode(*owner.node);
+    uint32_t pos = owner.index * BLOCK_SIZE + offset;
+    const std::vector<uint8_t> &data = owner.node->data;
+    if (pos < data.size()) { memcpy(buffer, data.data() + pos, min((uint32_t)n, (uint32_t)(data.size() - pos))); }
+}
+
+// Answers start one byte after command (NCR), stop command is followed by stuff byte
+static void sdExecute() {
+    uint8_t cmd = sdCommand[0] & 0x3F;
+    uint32_t arg = ((uint32_t)sdCommand[1] << 24) | ((uint32_t)sdCommand[2] << 16) | ((uint32_t)sdCommand[3] << 8) | sdCommand[4];
+
+    sdStreaming = false;
+    sdResponse.clear();
+    if (!sdInitialized) { return; }
+
+    if (cmd == 12) {
+        sdResponse = {0xFF, 0xFF, 0x00};
+    } else if (cmd == 13) {
+        sdResponse = {0xFF, 0x00, 0x00};
+    } else if (cmd == 18) {
+        // SDHC card is addressed by block
+        sdResponse = {0xFF, 0x00};
+        sdStreaming = true;
+        sdBlock = arg;
+        sdBlockPos = 0;
+        now += (uint64_t)(HOST_SD_READ_WAIT_US - HOST_SD_BLOCK_WAIT_US) * 1000;
+    } else {
+        sdResponse = {0xFF, 0x04}; // Illegal command
+    }
+}
+
+static uint8_t sdByte(uint8_t in) {
+    // Command starts with bits 01, card stops streaming to answer it
+    if ( (sdCommandLen > 0) || ((in & 0xC0) == 0x40) ) {
+        sdCommand[sdCommandLen++] = in;
+        if (sdCommandLen == sizeof(sdCommand)) {
+            sdCommandLen = 0;
+            sdExecute();
+        }
+        return 0xFF;
+    }
+
+    if (!sdResponse.empty()) {
+        uint8_t out = sdResponse.front();
+        sdResponse.pop_front();
+        return out;
+    }
+
+    if (!sdStreaming) { return 0xFF; }
+
+    // Block is data token, data and two bytes of CRC
+    uint16_t pos = sdBlockPos++;
+    if (pos == 0) {
+        now += (uint64_t)HOST_SD_BLOCK_WAIT_US * 1000;
+        if ( (rawErrorInterval > 0) && (++sdBlocksStreamed % rawErrorInterval == 0) ) {
+            sdStreaming = false;
+            return 0x08; // Error token, address out of range
+        }
+        return 0xFE;
+    }
+
+    if (pos <= BLOCK_SIZE) {
+        uint8_t out;
+        copyBlock(sdBlock, pos - 1, &out, 1);
+        Host::counters.sdRawBytes++;
+        return out;
+    }
+
+    if (pos == BLOCK_SIZE + 2) {
+        sdBlock++;
+        sdBlockPos = 0;
+    }
+    return 0xFF;
+}
+
+// Bytes of buffer are replaced with answers of card, data of streamed block is copied at once
+static void sdTransfer(uint8_t *buffer, size_t n) {
+    if ( (!cardPresent) || (!sdSelected) ) {
+        memset(buffer, 0xFF, n);
+        return;
+    }
+
+    while (n > 0) {
+        bool data = (sdStreaming) && (sdCommandLen == 0) && (sdResponse.empty()) && (sdBlockPos > 0) && (sdBlockPos <= BLOCK_SIZE);
+        if ( (data) && (buffer[0] == 0xFF) ) {
+            uint16_t k = min(n, (size_t)(BLOCK_SIZE + 1 - sdBlockPos));
+            copyBlock(sdBlock, sdBlockPos - 1, buffer, k);
+            sdBlockPos += k;
+            Host::counters.sdRawBytes += k;
+            buffer += k;
+            n -= k;
+            continue;
+        }
+
+        *buffer = sdByte(*buffer);
+        buffer++;
+        n--;
+    }
+}
+
+// SPI
+
+uint8_t SPIClass::transfer(uint8_t data) {
+    sampleStack();
+    now += HOST_SPI_BYTE_NS;
+    Host::counters.spiBytes++;
+    sdTransfer(&data, 1);
+    return data;
+}
+
+uint16_t SPIClass::transfer16(uint16_t data) {
+    return (this->transfer(data >> 8) << 8) | this->transfer(data & 0xFF);
+}
+
+void SPIClass::transfer(void *buffer, size_t n) {
+    sampleStack();
+    now += (uint64_t)n * HOST_SPI_BYTE_NS;
+    Host::counters.spiBytes += n;
+    sdTransfer((uint8_t*)buffer, n);
+}
+
+// SD library
+
+static std::string toKey(const char *path) {
+    std::string key;
+    for (const char *p = path; *p; p++) {
+        if ( (*p == '/') && ( (key.empty()) || (key.back() == '/') ) ) { continue; }
+        key += toupper((unsigned char)*p);
+    }
+
+    if ( (!key.empty()) && (key.back() == '/') ) { key.pop_back(); }
+    return key;
+}
+
+static std::string parentKey(const std::string &key) {
+    size_t slash = key.rfind('/');
+    return (slash == std::string::npos) ? "" : key.substr(0, slash);
+}
+
+static uint32_t nodeSize(const Node &node) {
+    return (node.modified) ? node.data.size() : node.hostSize;
+}
+
+// Blocks are taken from end of used area, so file written at once is contiguous
+static void allocateBlocks(const std::shared_ptr<Node> &node, uint32_t size) {
+    while ((uint32_t)node->blocks.size() * BLOCK_SIZE < size) {
+        node->blocks.push_back(DATA_START_BLOCK + cardBlocks.size());
+        cardBlocks.push_back({node, (uint32_t)node->blocks.size() - 1});
+    }
+}
+
+static void freeBlocks(Node &node) {
+    for (uint32_t block : node.blocks) { cardBlocks[block - DATA_START_BLOCK] = BlockOwner(); }
+    node.blocks.clear();
+}
+
+static void toFatTime(time_t t, uint16_t &date, uint16_t &fatTime) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    date = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+    fatTime = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+}
+
+static void loadNode(Node &node) {
+    if ( (node.dir) || (node.modified) || (!node.data.empty()) ) { return; }
+
+    FILE *f = fopen(node.hostPath.c_str(), "rb");
+    if (!f) { return; }
+
+    fseek(f, 0, SEEK_END);
+    node.data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    if (fread(node.data.data(), 1, node.data.size(), f) != node.data.size()) { node.data.clear(); }
+    fclose(f);
+}
+
+static void scanDirectory(const std::string &hostPath, const std::string &key) {
+    DIR *dir = opendir(hostPath.c_str());
+    if (!dir) { return; }
+
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') { continue; }
+
+        std::string path = hostPath + "/" + entry->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) { continue; }
+
+        std::string childKey = (key.empty() ? "" : key + "/") + toKey(entry->d_name);
+        uint16_t date, fatTime;
+        toFatTime(st.st_mtime, date, fatTime);
+        nodes[childKey] = std::make_shared<Node>(Node{(bool)S_ISDIR(st.st_mode), path, (uint32_t)st.st_size, false, 0, {}, {}, date, fatTime});
+        if (S_ISDIR(st.st_mode)) { scanDirectory(path, childKey); }
+    }
+
+    closedir(dir);
+}
+
+static File openKey(const std::string &key, const char *name, uint8_t mode) {
+    now += (uint64_t)HOST_SD_OPEN_US * 1000;
+    Host::counters.sdOpens++;
+
+    auto it = nodes.find(key);
+    if (it == nodes.end()) {
+        // Files are created only in existing directories
+        auto parent = nodes.find(parentKey(key));
+        if ( (!(mode & O_CREAT)) || (parent == nodes.end()) || (!parent->second->dir) ) { return File(); }
+
+        it = nodes.emplace(key, std::make_shared<Node>(Node{false, "", 0, true, 0, {}, {}, FAT_DEFAULT_DATE, 0})).first;
+    }
+
+    std::shared_ptr<Node> node = it->second;
+    if ( (node->dir) && (mode & O_WRITE) ) { return File(); }
+
+    loadNode(*node);
+    if ( (mode & O_WRITE) && (!node->modified) ) {
+        // Written file is kept in memory from now on
+        node->modified = true;
+    }
+    if ( (mode & O_TRUNC) && (mode & O_WRITE) ) {
+        // Truncated file gets new blocks when it is written again
+        node->data.clear();
+        freeBlocks(*node);
+    }
+
+    std::shared_ptr<HostFile> file = std::make_shared<HostFile>();
+    file->node = node;
+    file->key = key;
+    strncpy(file->name, name, sizeof(file->name) - 1);
+    file->name[sizeof(file->name) - 1] = '\0';
+    file->mode = mode;
+    file->pos = (mode & O_APPEND) ? node->data.size() : 0;
+    file->open = true;
+    node->users++;
+    return File(file);
+}
+
+bool SDClass::begin(uint8_t csPin) {
+    // Missing card is detected after initialization timeout
+    now += (uint64_t)(cardPresent ? HOST_MOUNT_MS : HOST_MOUNT_TIMEOUT_MS) * 1000000;
+    sdCsPin = csPin;
+    sdInitialized = cardPresent;
+    return cardPresent;
+}
+
+void SDClass::end() {}
+
+File SDClass::open(const char *path, uint8_t mode) {
+    if (!cardPresent) { return File(); }
+
+    std::string key = toKey(path);
+    const char *slash = strrchr(path, '/');
+    const char *name = (key.empty()) ? "/" : (slash && slash[1]) ? slash + 1 : path;
+    return openKey(key, name, mode);
+}
+
+bool SDClass::exists(const char *path) {
+    now += (uint64_t)HOST_SD_OPEN_US * 1000;
+    return (cardPresent) && (nodes.count(toKey(path)) > 0);
+}
+
+bool SDClass::mkdir(const char *path) {
+    if (!cardPresent) { return false; }
+
+    // Missing parent directories are created too
+    std::string key = toKey(path);
+    for (size_t end = 0; end != std::string::npos; ) {
+        end = key.find('/', end + 1);
+        std::string part = key.substr(0, end);
+
+        auto it = nodes.find(part);
+        if (it == nodes.end()) {
+            nodes[part] = std::make_shared<Node>(Node{true, "", 0, true, 0, {}, {}, FAT_DEFAULT_DATE, 0});
+        } else if (!it->second->dir) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SDClass::remove(const char *path) {
+    if (!cardPresent) { return false; }
+
+    auto it = nodes.find(toKey(path));
+    if ( (it == nodes.end()) || (it->second->dir) ) { return false; }
+
+    freeBlocks(*it->second);
+    nodes.erase(it);
+    return true;
+}
+
+int File::read(void *buffer, uint16_t n) {
+    sampleStack();
+    if ( (!cardPresent) || (!this->file) || (!this->file->open) || (this->file->node->dir) ) { return -1; }
+
+    const std::vector<uint8_t> &data = this->file->node->data;
+    uint32_t k = (this->file->pos < data.size()) ? min((uint32_t)n, (uint32_t)(data.size() - this->file->pos)) : 0;
+    memcpy(buffer, data.data() + this->file->pos, k);
+    this->file->pos += k;
+
+    now += (uint64_t)k * HOST_SD_BYTE_NS;
+    Host::counters.sdReadBytes += k;
+    return k;
+}
+
+int File::read() {
+    uint8_t c;
+    return (this->read(&c, 1) == 1) ? c : -1;
+}
+
+int File::peek() {
+    int c = this->read();
+    if (c >= 0) { this->file->pos--; }
+    return c;
+}
+
+int File::available() {
+    uint32_t size = this->size();
+    return (size > this->position()) ? min(size - this->position(), (uint32_t)0x7FFF) : 0;
+}
+
+size_t File::write(const uint8_t *buffer, size_t n) {
+    if ( (!cardPresent) || (!this->file) || (!this->file->open) || (!(this->file->mode & O_WRITE)) ) { return 0; }
+
+    std::vector<uint8_t> &data = this->file->node->data;
+    if (this->file->mode & O_APPEND) { this->file->pos = data.size(); }
+    if (this->file->pos + n > data.size()) {
+        data.resize(this->file->pos + n);
+        allocateBlocks(this->file->node, data.size());
+    }
+
+    memcpy(data.data() + this->file->pos, buffer, n);
+    this->file->pos += n;
+
+    now += (uint64_t)n * HOST_SD_BYTE_NS;
+    Host::counters.sdWrittenBytes += n;
+    return n;
+}
+
+size_t File::write(uint8_t c) {
+    return this->write(&c, 1);
+}
+
+bool File::seek(uint32_t pos) {
+    if ( (!cardPresent) || (!this->file) || (!this->file->open) || (pos > this->file->node->data.size()) ) { return false; }
+
+    this->file->pos = pos;
+    return true;
+}
+
+uint32_t File::position() {
+    return (this->file) ? this->file->pos : 0;
+}
+
+uint32_t File::size() {
+    return ( (this->file) && (this->file->open) ) ? this->file->node->data.size() : 0;
+}
+
+void File::close() {
+    if (this->file) { this->file->close(); }
+}
+
+char *File::name() {
+    static char empty[1] = "";
+    return (this->file) ? this->file->name : empty;
+}
+
+bool File::isDirectory() {
+    return (this->file) && (this->file->open) && (this->file->node->dir);
+}
+
+File File::openNextFile(uint8_t mode) {
+    if ( (!cardPresent) || (!this->isDirectory()) ) { return File(); }
+
+    // Entries are listed in name order, only direct children of directory
+    std::string prefix = this->file->key.empty() ? "" : this->file->key + "/";
+    auto it = this->file->lastChild.empty() ? nodes.lower_bound(prefix) : nodes.upper_bound(this->file->lastChild);
+
+    for (; (it != nodes.end()) && (it->first.compare(0, prefix.size(), prefix) == 0); ++it) {
+        if ( (it->first.size() == prefix.size()) || (it->first.find('/', prefix.size()) != std::string::npos) ) { continue; }
+
+        this->file->lastChild = it->first;
+        return openKey(it->first, it->first.c_str() + prefix.size(), mode);
+    }
+
+    // Last entry is kept, so next call returns nothing as well
+    return File();
+}
+
+void File::rewindDirectory() {
+    if (this->file) { this->file->lastChild.clear(); }
+}
+
+File::operator bool() {
+    return (this->file) && (this->file->open);
+}
+
+// Low level card access of SD library
+
+uint8_t Sd2Card::init(uint8_t, uint8_t csPin) {
+    sdCsPin = csPin;
+    if (!rawAccess) { return false; }
+
+    now += (uint64_t)(cardPresent ? HOST_MOUNT_MS : HOST_MOUNT_TIMEOUT_MS) * 1000000;
+    sdInitialized = cardPresent;
+    return cardPresent;
+}
+
+uint8_t SdVolume::init(Sd2Card*) {
+    return (rawAccess) && (cardPresent) && (sdInitialized);
+}
+
+static Node *findNode(const std::string &key) {
+    auto it = nodes.find(key);
+    return (it == nodes.end()) ? nullptr : it->second.get();
+}
+
+uint8_t SdFile::open(SdFile *dir, const char *name, uint8_t mode) {
+    now += (uint64_t)HOST_SD_OPEN_US * 1000;
+    Host::counters.sdOpens++;
+
+    // Files are only read through SdFile
+    this->opened = false;
+    if ( (!cardPresent) || (!sdInitialized) || (!dir) || (!dir->isDir()) || (mode & O_WRITE) ) { return false; }
+
+    std::string key = (dir->key.empty() ? "" : dir->key + "/") + toKey(name);
+    if (!findNode(key)) { return false; }
+
+    this->key = key;
+    this->opened = true;
+    return true;
+}
+
+uint8_t SdFile::openRoot(SdVolume*) {
+    this->key = "";
+    this->opened = (cardPresent) && (sdInitialized);
+    return this->opened;
+}
+
+uint8_t SdFile::isDir() const {
+    Node *node = this->opened ? findNode(this->key) : nullptr;
+    return (node) && (node->dir);
+}
+
+uint8_t SdFile::contiguousRange(uint32_t *bgnBlock, uint32_t *endBlock) {
+    Node *node = this->opened ? findNode(this->key) : nullptr;
+    if ( (!node) || (node->dir) || (node->blocks.empty()) ) { return false; }
+
+    for (size_t i = 1; i < node->blocks.size(); i++) {
+        if (node->blocks[i] != node->blocks[0] + i) { return false; }
+    }
+
+    *bgnBlock = node->blocks.front();
+    *endBlock = node->blocks.back();
+    return true;
+}
+
+uint8_t SdFile::dirEntry(dir_t *dir) {
+    Node *node = this->opened ? findNode(this->key) : nullptr;
+    if (!node) { return false; }
+
+    memset(dir, 0, sizeof(dir_t));
+    dir->attributes = node->dir ? 0x10 : 0x20;
+    dir->lastWriteDate = node->writeDate;
+    dir->lastWriteTime = node->writeTime;
+    dir->firstClusterHigh = this->firstCluster() >> 16;
+    dir->firstClusterLow = this->firstCluster() & 0xFFFF;
+    dir->fileSize = this->fileSize();
+    return true;
+}
+
+uint32_t SdFile::fileSize() const {
+    Node *node = this->opened ? findNode(this->key) : nullptr;
+    return ( (node) && (!node->dir) ) ? nodeSize(*node) : 0;
+}
+
+uint32_t SdFile::firstCluster() const {
+    // Clusters have single block, cluster 2 is first block of data area
+    Node *node = this->opened ? findNode(this->key) : nullptr;
+    return ( (node) && (!node->blocks.empty()) ) ? node->blocks.front() - DATA_START_BLOCK + 2 : 0;
+}
+
+// ILI9486
+
+ILI9486::ILI9486(uint8_t, uint8_t, uint8_t, uint8_t, Orientation, uint8_t defaultBacklight, ILI9486_COLOR background):
+    defaultBacklight(defaultBacklight), x1(0), y1(0), x2(0), y2(0), x(0), y(0)
+{
+    this->clear(background);
+}
+
+uint16_t ILI9486::getWidth() { return HOST_PANEL_WIDTH; }
+uint16_t ILI9486::getHeight() { return HOST_PANEL_HEIGHT; }
+uint32_t ILI9486::getSize() { return (uint32_t)HOST_PANEL_WIDTH * HOST_PANEL_HEIGHT; }
+
+void ILI9486::put(uint16_t x, uint16_t y, ILI9486_COLOR color) {
+    if ( (x < HOST_PANEL_WIDTH) && (y < HOST_PANEL_HEIGHT) ) { screen[(uint32_t)y * HOST_PANEL_WIDTH + x] = color; }
+    now += HOST_PANEL_PIXEL_NS;
+    Host::counters.panelPixels++;
+}
+
+void ILI9486::openWindow(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+    this->x1 = this->x = x1;
+    this->y1 = this->y = y1;
+    this->x2 = max(x2, (uint16_t)(x1 + 1));
+    this->y2 = max(y2, (uint16_t)(y1 + 1));
+    now += 11 * HOST_SPI_BYTE_NS; // Column and row address commands
+}
+
+void ILI9486::writeBuffer(uint16_t *buffer, uint32_t n) {
+    sampleStack();
+    for (uint32_t i = 0; i < n; i++) {
+        this->put(this->x, this->y, buffer[i]);
+
+        // Window is filled row by row and starts again after last row
+        if (++this->x >= this->x2) {
+            this->x = this->x1;
+            if (++this->y >= this->y2) { this->y = this->y1; }
+        }
+    }
+}
+
+void ILI9486::fill(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, ILI9486_COLOR color) {
+    for (uint16_t y = y1; y <= y2; y++) {
+        for (uint16_t x = x1; x <= x2; x++) { this->put(x, y, color); }
+    }
+}
+
+void ILI9486::clear(ILI9486_COLOR color) {
+    this->fill(0, 0, HOST_PANEL_WIDTH - 1, HOST_PANEL_HEIGHT - 1, color);
+    textHash = 0;
+}
+
+void ILI9486::drawCircle(uint16_t x, uint16_t y, uint16_t r, ILI9486_COLOR color, bool filled) {
+    for (int32_t dy = -r; dy <= r; dy++) {
+        for (int32_t dx = -r; dx <= r; dx++) {
+            int32_t d = dx * dx + dy * dy;
+            if ( (d <= r * r) && ( (filled) || (d > (r - 1) * (r - 1)) ) ) { this->put(x + dx, y + dy, color); }
+        }
+    }
+}
+
+void ILI9486::drawLine(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, ILI9486_COLOR color) {
+    int32_t dx = abs(x2 - x1), dy = -abs(y2 - y1);
+    int32_t sx = (x1 < x2) ? 1 : -1, sy = (y1 < y2) ? 1 : -1;
+    int32_t error = dx + dy, x = x1, y = y1;
+
+    while (true) {
+        this->put(x, y, color);
+        if ( (x == x2) && (y == y2) ) { break; }
+
+        int32_t e2 = 2 * error;
+        if (e2 >= dy) { error += dy; x += sx; }
+        if (e2 <= dx) { error += dx; y += sy; }
+    }
+}
+
+void ILI9486::drawString(uint16_t x, uint16_t y, const char *text, FontSize size, ILI9486_COLOR color) {
+    uint16_t params[4] = {x, y, (uint16_t)size, color};
+    textHash = fnv(fnv(textHash, params, sizeof(params)), text, strlen(text));
+    now += (uint64_t)strlen(text) * HOST_TEXT_CHAR_US * 1000;
+}
+
+void ILI9486::setBacklight(uint8_t value) {
+    backlightLevel = value;
+    Host::counters.backlightChanges++;
+    now += 20000; // PWM register write
+}
+
+// XPT2046
+
+bool XPT2046_Touchscreen::touched() {
+    // Touches can be queued past millis() overflow
+    return (!touches.empty()) && ((int32_t)(millis() - touches.front().ms) >= 0);
+}
+
+TS_Point XPT2046_Touchscreen::getPoint() {
+    now += (uint64_t)HOST_TOUCH_READ_US * 1000;
+    if (!this->touched()) { return TS_Point(); }
+
+    Touch t = touches.front();
+    touches.pop_front();
+    return TS_Point(t.x, t.y, 1000);
+}
+
+// Host
+
+bool Host::mountCard(const char *dir, bool fragmented) {
+    struct stat st;
+    if ( (stat(dir, &st) != 0) || (!S_ISDIR(st.st_mode)) ) { return false; }
+
+    nodes.clear();
+    cardBlocks.clear();
+    nodes[""] = std::make_shared<Node>(Node{true, dir, 0, false, 0, {}, {}, FAT_DEFAULT_DATE, 0});
+    scanDirectory(dir, "");
+
+    // Files are copied to card in name order, whole or in turns of HOST_FRAGMENT_BLOCKS blocks
+    for (uint32_t turn = 1, left = 1; left > 0; turn++) {
+        left = 0;
+        for (auto &it : nodes) {
+            if (it.second->dir) { continue; }
+
+            uint32_t size = fragmented ? min(it.second->hostSize, turn * HOST_FRAGMENT_BLOCKS * BLOCK_SIZE) : it.second->hostSize;
+            allocateBlocks(it.second, size);
+            left += it.second->hostSize - size;
+        }
+    }
+
+    return true;
+}
+
+void Host::setCardPresent(bool present) {
+    cardPresent = present;
+
+    // Removed card must be initialized again
+    if (!present) {
+        sdInitialized = false;
+        sdStreaming = false;
+        sdResponse.clear();
+        sdCommandLen = 0;
+    }
+}
+
+bool Host::isCardPresent() { return cardPresent; }
+void Host::setRawAccess(bool enabled) { rawAccess = enabled; }
+void Host::setRawErrorInterval(uint32_t blocks) { rawErrorInterval = blocks; }
+
+void Host::advance(uint64_t ns) { now += ns; }
+uint64_t Host::clock() { return now; }
+void Host::setAnalog(uint16_t value) { analogValue = value; }
+
+void Host::touchAt(uint32_t ms, int16_t x, int16_t y) { touches.push_back({ms, x, y}); }
+uint32_t Host::touchesLeft() { return touches.size(); }
+
+uint32_t Host::screenHash() { return fnv(fnv(2166136261u, screen, sizeof(screen)), &textHash, sizeof(textHash)); }
+uint8_t Host::backlight() { return backlightLevel; }
+
+void Host::markStack() { stackBottom = (uintptr_t)__builtin_frame_address(0); }
+uint32_t Host::stackPeak() { return stackDeepest; }
+
+void Host::heapChange(int32_t bytes) {
+    heapUsed += bytes;
+    heapDeepest = max(heapDeepest, heapUsed);
+}
+
+uint32_t Host::heapPeak() { return heapDeepest; }
+uint32_t Host::heapInUse() { return heapUsed; }
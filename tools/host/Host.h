@@ -0,0 +1,85 @@
+/*
+Host.h
+
+Simulation of frame hardware on PC, frame sources are compiled with headers of this directory
+instead of Arduino libraries (see tools/replay.cpp).
+Clock is virtual: it advances by modeled duration of every sd card read or write, panel write, SPI transfer
+and delay(), so the same inputs always give the same run, regardless of PC speed.
+Model is rough (SD library reads, multi block reads and panel writes at 8 MHz), it is meant for comparing runs, not for predicting load times.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#define HOST_PANEL_WIDTH 320
+#define HOST_PANEL_HEIGHT 480
+
+// Modeled durations
+#define HOST_SPI_BYTE_NS 1000 // 8 MHz bus
+#define HOST_SD_BYTE_NS 3000 // SD library reads through its block buffer
+#define HOST_SD_OPEN_US 2000 // Directory lookup
+#define HOST_SD_READ_WAIT_US 500 // First block of multi block read
+#define HOST_SD_BLOCK_WAIT_US 20 // Following blocks of multi block read
+#define HOST_MOUNT_MS 40 // Card and volume initialization, as in tools/hotplugsim.cpp
+#define HOST_MOUNT_TIMEOUT_MS 2000 // Initialization of missing card
+#define HOST_PANEL_PIXEL_NS 2000 // 16 bit pixel at 8 MHz
+#define HOST_TEXT_CHAR_US 300
+#define HOST_TOUCH_READ_US 50
+
+#define HOST_FRAGMENT_BLOCKS 16 // Files of fragmented card are placed in turns of this many blocks
+
+class Host {
+public:
+    // Work done by simulated frame, compared between runs
+    struct Counters {
+        uint32_t sdOpens;
+        uint32_t sdReadBytes;
+        uint32_t sdRawBytes; // Streamed by multi block reads, not counted in sdReadBytes
+        uint32_t sdWrittenBytes;
+        uint32_t panelPixels;
+        uint32_t spiBytes;
+        uint32_t backlightChanges;
+    };
+
+    static Counters counters;
+    static void (*serialLine)(const char *line); // Called with every line written over Serial, lines are printed if not set
+
+    static bool mountCard(const char *dir, bool fragmented = false); // Use directory on PC as sd card, files larger than HOST_FRAGMENT_BLOCKS blocks of fragmented card are not contiguous
+    static void setCardPresent(bool present); // Removed card does not answer and SD library fails
+    static bool isCardPresent();
+    static void setRawAccess(bool enabled); // Low level card initialization fails when disabled, so images are read through SD library
+    static void setRawErrorInterval(uint32_t blocks); // Every blocks-th streamed block starts with error token, 0 for none
+
+    static void advance(uint64_t ns); // Pass time
+    static uint64_t clock(); // Time since start [ns]
+    static void setAnalog(uint16_t value); // Value read from floating analog pin, seed of random()
+
+    static void touchAt(uint32_t ms, int16_t x, int16_t y); // Queue touch at raw controller coordinates, touches must be queued in time order
+    static uint32_t touchesLeft(); // Queued touches not read by frame
+
+    static uint32_t screenHash(); // Hash of displayed pixels and texts
+    static uint8_t backlight(); // Current backlight level
+
+    // Memory use of frame, stack is sampled whenever frame reads sd card, writes display or uses SPI bus
+    // and String buffers are counted as on AVR (length + 1 bytes), so values are comparable between builds, not with device
+    static void markStack(); // Position of caller is bottom of frame stack, call before setup()
+    static uint32_t stackPeak(); // Deepest sampled stack below markStack() [B]
+    static void heapChange(int32_t bytes); // Called when String buffer changes
+    static uint32_t heapPeak(); // Largest heap taken by String buffers at once [B]
+    static uint32_t heapInUse(); // Heap taken by String buffers now [B]
+};
@@ -0,0 +1,63 @@
+/*
+ILI9486.h
+
+ILI9486 display library used by frame sources, implemented on PC for simulation (see Host.h).
+Written pixels are kept in frame buffer, so screens of two runs can be compared by Host::screenHash,
+drawing takes time of PANEL_SPI_CLOCK bus.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+typedef uint16_t ILI9486_COLOR;
+#define ILI9486_BLACK 0x0000
+#define ILI9486_WHITE 0xFFFF
+#define ILI9486_RED 0xF800
+
+class ILI9486 {
+public:
+    enum Orientation { L2R_U2D, R2L_U2D };
+    enum FontSize { S, M, L };
+
+    ILI9486(uint8_t cs, uint8_t bl, uint8_t rst, uint8_t dc, Orientation orientation, uint8_t defaultBacklight, ILI9486_COLOR background);
+
+    uint16_t getWidth();
+    uint16_t getHeight();
+    uint32_t getSize();
+
+    void openWindow(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2); // x2 and y2 are not included
+    void writeBuffer(uint16_t *buffer, uint32_t n);
+    void fill(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, ILI9486_COLOR color); // x2 and y2 are included
+    void clear(ILI9486_COLOR color = ILI9486_BLACK);
+    void drawCircle(uint16_t x, uint16_t y, uint16_t r, ILI9486_COLOR color, bool filled);
+    void drawLine(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, ILI9486_COLOR color);
+    void drawString(uint16_t x, uint16_t y, const char *text, FontSize size, ILI9486_COLOR color);
+    void drawString(uint16_t x, uint16_t y, uint8_t *text, FontSize size, ILI9486_COLOR color) { this->drawString(x, y, (const char*)text, size, color); }
+
+    void setBacklight(uint8_t value);
+    uint8_t getDefaultBacklight() { return this->defaultBacklight; }
+    void changeDefaultBacklight(uint8_t value) { this->defaultBacklight = value; }
+    void setDefaultBacklight() { this->setBacklight(this->defaultBacklight); }
+    void turnOffBacklight() { this->setBacklight(0); }
+
+private:
+    uint8_t defaultBacklight;
+    uint16_t x1, y1, x2, y2; // Opened window
+    uint16_t x, y; // Next written pixel
+
+    void put(uint16_t x, uint16_t y, ILI9486_COLOR color);
+};
@@ -0,0 +1,140 @@
+/*
+SD.h
+
+SD library used by frame sources, implemented on PC for simulation (see Host.h).
+Card is a directory on PC, names are matched ignoring case as on FAT card and directories are listed
+in name order. Files written by frame are kept in memory, so directory is never changed and every
+run starts with the same card. Every file is also placed in blocks of card (clusters of single block),
+files of PC are placed in name order when card is mounted, written files get new blocks as they grow.
+Low level card access (Sd2Card, SdVolume, SdFile) finds blocks of files, so RawStream streams contiguous
+files with multi block reads answered by SPI (see Host.cpp), unless it is disabled by Host::setRawAccess().
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#define O_READ 0x01
+#define O_RDONLY O_READ
+#define O_WRITE 0x02
+#define O_RDWR (O_READ | O_WRITE)
+#define O_APPEND 0x04
+#define O_CREAT 0x10
+#define O_TRUNC 0x40
+#define FILE_READ O_READ
+#define FILE_WRITE (O_READ | O_WRITE | O_CREAT | O_APPEND)
+
+#define SD_CARD_TYPE_SDHC 3
+#define SPI_FULL_SPEED 0
+#define SPI_HALF_SPEED 1
+
+struct dir_t {
+    uint8_t name[11];
+    uint8_t attributes;
+    uint8_t reservedNT;
+    uint8_t creationTimeTenths;
+    uint16_t creationTime;
+    uint16_t creationDate;
+    uint16_t lastAccessDate;
+    uint16_t firstClusterHigh;
+    uint16_t lastWriteTime;
+    uint16_t lastWriteDate;
+    uint16_t firstClusterLow;
+    uint32_t fileSize;
+};
+
+class Sd2Card {
+public:
+    uint8_t init(uint8_t speed, uint8_t csPin);
+    uint8_t type() const { return SD_CARD_TYPE_SDHC; }
+    uint8_t readBlock(uint32_t, uint8_t*) { return false; }
+    uint8_t writeBlock(uint32_t, const uint8_t*) { return false; }
+};
+
+class SdVolume {
+public:
+    uint8_t init(Sd2Card *card);
+    uint8_t blocksPerCluster() const { return 1; }
+    uint32_t clusterCount() const { return 0; }
+    uint8_t fatType() const { return 32; }
+};
+
+// Only reading of directory entries is simulated, data of files is streamed through SPI
+class SdFile {
+public:
+    uint8_t open(SdFile *dir, const char *name, uint8_t mode);
+    uint8_t openRoot(SdVolume *volume);
+    uint8_t close() { this->opened = false; return true; }
+    uint8_t isOpen() const { return this->opened; }
+    uint8_t isDir() const;
+    uint8_t contiguousRange(uint32_t *bgnBlock, uint32_t *endBlock);
+    uint8_t dirEntry(dir_t *dir);
+    uint32_t fileSize() const;
+    uint32_t firstCluster() const;
+
+private:
+    std::string key; // Key of node on card (see Host.cpp)
+    bool opened = false;
+};
+
+struct HostFile; // State shared by copies of File, as in SD library
+
+class File : public Stream {
+public:
+    File() {}
+    File(std::shared_ptr<HostFile> file): file(file) {}
+
+    int read() override;
+    int read(void *buffer, uint16_t n);
+    int peek() override;
+    int available() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t n);
+    size_t write(const char *s) { return this->write((const uint8_t*)s, strlen(s)); }
+    bool seek(uint32_t pos);
+    uint32_t position();
+    uint32_t size();
+    void flush() {}
+    void close();
+    char *name();
+    bool isDirectory();
+    File openNextFile(uint8_t mode = O_RDONLY);
+    void rewindDirectory();
+    operator bool();
+
+private:
+    std::shared_ptr<HostFile> file;
+};
+
+class SDClass {
+public:
+    bool begin(uint8_t csPin);
+    void end();
+    File open(const char *path, uint8_t mode = FILE_READ);
+    File open(const String &path, uint8_t mode = FILE_READ) { return this->open(path.c_str(), mode); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return this->exists(path.c_str()); }
+    bool mkdir(const char *path);
+    bool mkdir(const String &path) { return this->mkdir(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return this->remove(path.c_str()); }
+};
+
+extern SDClass SD;
@@ -0,0 +1,41 @@
+/*
+XPT2046_Touchscreen.h
+
+XPT2046 touch controller library used by frame sources, implemented on PC for simulation.
+Touches are queued with Host::touchAt, each is reported from its time until its point is read.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+class TS_Point {
+public:
+    TS_Point(): x(0), y(0), z(0) {}
+    TS_Point(int16_t x, int16_t y, int16_t z): x(x), y(y), z(z) {}
+
+    int16_t x, y, z;
+};
+
+class XPT2046_Touchscreen {
+public:
+    XPT2046_Touchscreen(uint8_t, uint8_t = 255) {}
+
+    bool begin() { return true; }
+    bool tirqTouched() { return this->touched(); }
+    bool touched();
+    TS_Point getPoint();
+};
@@ -0,0 +1,145 @@
+/*
+hotplugsim.cpp
+
+PC simulation of sd card removal and remount (see src/HotPlug/HotPlug.h).
+Scripted card stands in for real one: it is removed, images are added or removed
+and it is inserted again. Frame loop is simulated with the same presence check interval,
+remount backoff and incremental rescan as on device, with card operation times below.
+For every removal detection time, recovery time after insertion, number of remount
+attempts and cost of rescan are printed, rescan is compared with counting all images
+as done on startup.
+
+Build: g++ -O2 -std=c++11 -o hotplugsim hotplugsim.cpp
+Usage: hotplugsim
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cstdio>
+#include <vector>
+
+#include "../src/HotPlug/HotPlug.h"
+
+// Card operation times [ms], roughly as measured with SD library on Arduino Pro Mini
+#define LOOP_MS 10 // Frame loop iteration while image is displayed
+#define MOUNT_MS 40 // Card and volume initialization when card is present
+#define INIT_TIMEOUT_MS 2000 // Card initialization timeout when card is missing
+#define BLOCK_MS 1 // Read of single block (16 directory entries or image header)
+#define DIR_ENTRIES_PER_BLOCK 16
+
+// Card with images 0.bmp ... (count - 1).bmp stored in directory in number order
+struct SimCard {
+    bool present = true;
+    uint32_t count = 0;
+    uint32_t blocksRead = 0;
+
+    // Directory is searched from beginning until name is found
+    bool exists(uint32_t number) {
+        bool found = number < this->count;
+        uint32_t entries = found ? number + 1 : this->count;
+        this->blocksRead += (entries + DIR_ENTRIES_PER_BLOCK - 1) / DIR_ENTRIES_PER_BLOCK;
+        return found;
+    }
+};
+
+struct Event {
+    uint32_t time;
+    bool insert; // Card inserted with count images, otherwise removed
+    uint32_t count;
+};
+
+int main() {
+    // Removals with images added, quick reinsertion, long absence with images removed and card swap
+    const Event script[] = {
+        {5000, false, 0}, {20000, true, 1020},
+        {30000, false, 0}, {31000, true, 1020},
+        {40000, false, 0}, {100000, true, 990},
+        {110000, false, 0}, {112000, true, 200},
+    };
+    const uint32_t events = sizeof(script) / sizeof(script[0]);
+
+    SimCard card;
+    card.count = 1000;
+    uint32_t imagesN = card.count;
+
+    Backoff backoff;
+    bool error = false;
+    uint32_t now = 0, lastCheck = 0, next = 0;
+    uint32_t removedAt = 0, insertedAt = 0, attempts = 0;
+
+    printf("%u images on card, presence checked every %u ms, remount backoff %u..%u ms\n",
+        imagesN, CARD_CHECK_INTERVAL, REMOUNT_FIRST_DELAY, REMOUNT_MAX_DELAY);
+    printf("%-30s %10s %10s %9s %8s %10s %10s\n", "event", "detect ms", "recover ms", "attempts", "lookups", "rescan ms", "full ms");
+
+    while ( (next < events) || (error) ) {
+        // Script changes card between loop iterations
+        if ( (next < events) && (now >= script[next].time) ) {
+            card.present = script[next].insert;
+            if (script[next].insert) {
+                card.count = script[next].count;
+                insertedAt = now;
+            } else {
+                removedAt = now;
+            }
+            next++;
+        }
+
+        if ( (!error) && (now - lastCheck >= CARD_CHECK_INTERVAL) ) {
+            lastCheck = now;
+            if (!card.present) {
+                error = true;
+                attempts = 0;
+                backoff.reset();
+                printf("%-30s %10u", "removed", now - removedAt);
+            }
+        }
+
+        if ( (error) && (backoff.due(now)) ) {
+            attempts++;
+            if (!card.present) {
+                now += INIT_TIMEOUT_MS;
+                backoff.failed(now);
+                continue;
+            }
+
+            // Mounted, count is updated by lookups of changed numbers
+            uint32_t lookups = 0;
+            card.blocksRead = 0;
+            uint32_t before = imagesN;
+            imagesN = rescanImages(imagesN, [&](uint32_t n) { lookups++; return card.exists(n); });
+            uint32_t rescanMs = MOUNT_MS + card.blocksRead * BLOCK_MS;
+            now += rescanMs;
+
+            // Counting on startup opens every image and reads its header
+            uint32_t fullMs = MOUNT_MS + (imagesN + (imagesN + DIR_ENTRIES_PER_BLOCK - 1) / DIR_ENTRIES_PER_BLOCK) * BLOCK_MS;
+
+            char name[32];
+            snprintf(name, sizeof(name), "inserted, %u -> %u images", before, imagesN);
+            printf("\n%-30s %10s %10u %9u %8u %10u %10u\n", name, "", now - insertedAt, attempts, lookups, rescanMs, fullMs);
+
+            if (imagesN != card.count) {
+                fprintf(stderr, "rescan found %u images, card has %u\n", imagesN, card.count);
+                return 1;
+            }
+
+            error = false;
+            lastCheck = now;
+            continue;
+        }
+
+        now += LOOP_MS;
+    }
+
+    return 0;
+}
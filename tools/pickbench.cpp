@@ -0,0 +1,310 @@
+/*
+pickbench.cpp
+
+PC benchmark of picking next image in random display orders for 100, 10000 and 65535 images.
+Random order bucket pick from DigitalFrame and loop it replaced are compared with
+alias table ("By weight") and order queue ("Oldest first") picks, tables are kept in memory in the same layout as files on sd card.
+Besides time, number of loop steps and bytes read from weights / order file per pick are printed,
+on Arduino loop steps cost CPU time and bytes cost sd card reads.
+Random picks are checked for repeats, weighted picks against weights and oldest first picks against
+display times, with some images displayed without being picked.
+
+Build: g++ -O2 -std=c++11 -o pickbench pickbench.cpp
+Usage: pickbench [-n picks]
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "ImageTools.h"
+
+#define DIFF_RAND_IMG_N 256 // As in DigitalFrame.h
+
+static std::mt19937 rng(1);
+
+// Arduino random(max)
+static uint32_t random(uint32_t max) {
+    return std::uniform_int_distribution<uint32_t>(0, max - 1)(rng);
+}
+
+// Random order loop DigitalFrame used before buckets, it walked over images and
+// returned numbers past last image for more than DIFF_RAND_IMG_N images (wrapped here)
+class LoopRandomPicker {
+public:
+    uint64_t steps = 0;
+
+    explicit LoopRandomPicker(uint32_t n): n(n) {}
+
+    uint16_t pick() {
+        uint16_t imageN = random(this->n - this->displayedN);
+        uint16_t notDisp = imageN;
+        uint16_t index = 0;
+        for (uint16_t i = 0; i < imageN + 1; i++) {
+            if (this->displayed[index % DIFF_RAND_IMG_N]) {
+                notDisp++;
+                i--;
+            }
+
+            index++;
+            this->steps++;
+        }
+
+        this->displayed[notDisp % DIFF_RAND_IMG_N] = true;
+        this->displayedN++;
+
+        if (this->displayedN >= std::min<uint32_t>(this->n, DIFF_RAND_IMG_N)) {
+            this->displayedN = 0;
+            memset(this->displayed, 0, sizeof(this->displayed));
+        }
+
+        return notDisp % this->n;
+    }
+
+private:
+    uint32_t n;
+    uint32_t displayedN = 0;
+    bool displayed[DIFF_RAND_IMG_N] = {};
+};
+
+// Random order as in DigitalFrame::pickRandom
+class RandomPicker {
+public:
+    uint64_t steps = 0;
+
+    explicit RandomPicker(uint32_t n): n(n) {}
+
+    uint16_t pick() {
+        uint16_t buckets = std::min<uint32_t>(this->n, DIFF_RAND_IMG_N);
+        uint16_t k = random(buckets - this->displayedN);
+        uint16_t bucket = 0;
+        for (;; bucket++) {
+            this->steps++;
+            if (this->displayed[bucket]) { continue; }
+            if (k == 0) { break; }
+            k--;
+        }
+
+        this->displayed[bucket] = true;
+        this->displayedN++;
+
+        if (this->displayedN >= buckets) {
+            this->displayedN = 0;
+            memset(this->displayed, 0, sizeof(this->displayed));
+        }
+
+        uint16_t inBucket = (this->n - bucket + DIFF_RAND_IMG_N - 1) / DIFF_RAND_IMG_N;
+        return bucket + random(inBucket) * DIFF_RAND_IMG_N;
+    }
+
+private:
+    uint32_t n;
+    uint32_t displayedN = 0;
+    bool displayed[DIFF_RAND_IMG_N] = {};
+};
+
+// Weighted order as in SDStorage::pickWeighted, file in memory
+class WeightedPicker {
+public:
+    uint64_t bytes = 0;
+
+    explicit WeightedPicker(const std::vector<double> &weights) {
+        std::vector<uint16_t> threshold, alias;
+        buildAliasTable(weights, threshold, alias);
+
+        put16(this->file, WEIGHTS_MAGIC);
+        put16(this->file, weights.size());
+        for (size_t i = 0; i < weights.size(); i++) {
+            put16(this->file, threshold[i]);
+            put16(this->file, alias[i]);
+        }
+    }
+
+    uint16_t pick() {
+        uint16_t n = get16(this->file, 2);
+        uint16_t slot = random(n);
+        uint32_t entry = WEIGHTS_HEADER_SIZE + (uint32_t)slot * WEIGHTS_ENTRY_SIZE;
+        this->bytes += WEIGHTS_HEADER_SIZE + WEIGHTS_ENTRY_SIZE;
+        return aliasPick(slot, random(0x10000), get16(this->file, entry), get16(this->file, entry + 2));
+    }
+
+private:
+    std::vector<uint8_t> file;
+};
+
+// Least recently shown order as in SDStorage::pickLeastRecent and markShown, file in memory
+class LeastRecentPicker {
+public:
+    uint64_t bytes = 0;
+
+    explicit LeastRecentPicker(uint32_t n) {
+        put16(this->file, ORDER_MAGIC);
+        put16(this->file, n);
+        put16(this->file, 0);
+        put16(this->file, n - 1);
+        for (uint32_t i = 0; i < n; i++) {
+            put16(this->file, (i > 0) ? i - 1 : ORDER_NONE);
+            put16(this->file, (i + 1 < n) ? i + 1 : ORDER_NONE);
+        }
+    }
+
+    // Picked image is displayed
+    uint16_t pick() {
+        uint16_t image = get16(this->file, 4);
+        this->bytes += ORDER_HEADER_SIZE;
+        this->markShown(image);
+        return image;
+    }
+
+    void markShown(uint16_t id) {
+        uint16_t head = get16(this->file, 4);
+        uint16_t tail = get16(this->file, 6);
+        this->bytes += ORDER_HEADER_SIZE;
+        if (tail == id) { return; }
+
+        uint32_t entry = ORDER_HEADER_SIZE + (uint32_t)id * ORDER_ENTRY_SIZE;
+        uint16_t prev = get16(this->file, entry);
+        uint16_t next = get16(this->file, entry + 2);
+
+        if (prev != ORDER_NONE) {
+            set16(ORDER_HEADER_SIZE + (uint32_t)prev * ORDER_ENTRY_SIZE + 2, next);
+        } else {
+            head = next;
+        }
+        set16(ORDER_HEADER_SIZE + (uint32_t)next * ORDER_ENTRY_SIZE, prev);
+        set16(ORDER_HEADER_SIZE + (uint32_t)tail * ORDER_ENTRY_SIZE + 2, id);
+        set16(entry, tail);
+        set16(entry + 2, ORDER_NONE);
+        set16(4, head);
+        set16(6, id);
+        this->bytes += ORDER_ENTRY_SIZE + 2 + 2 + 2 + ORDER_ENTRY_SIZE + 4;
+    }
+
+private:
+    std::vector<uint8_t> file;
+
+    void set16(uint32_t pos, uint16_t value) {
+        this->file[pos] = value & 0xFF;
+        this->file[pos + 1] = value >> 8;
+    }
+};
+
+template <class Picker>
+static double measure(Picker &picker, uint32_t picks, uint32_t *counts) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < picks; i++) { counts[picker.pick()]++; }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / picks;
+}
+
+int main(int argc, char **argv) {
+    uint32_t picks = 1000000;
+    if ( (argc > 2) && (strcmp(argv[1], "-n") == 0) ) { picks = atoi(argv[2]); }
+
+    const uint32_t sizes[] = {100, 10000, 65535};
+    bool ok = true;
+
+    printf("%u picks\n", picks);
+    printf("%8s  %-14s %10s %12s %12s\n", "images", "order", "ns/pick", "steps/pick", "bytes/pick");
+
+    for (uint32_t n : sizes) {
+        std::vector<uint32_t> counts(n);
+
+        // Old loop is slow, fewer picks are enough
+        uint32_t loopPicks = std::max(1u, picks / 100);
+        LoopRandomPicker loopRandom(n);
+        double ns = measure(loopRandom, loopPicks, counts.data());
+        printf("%8u  %-14s %10.1f %12.1f %12s\n", n, "random, loop", ns, (double)loopRandom.steps / loopPicks, "-");
+
+        std::fill(counts.begin(), counts.end(), 0);
+        RandomPicker random(n);
+        ns = measure(random, picks, counts.data());
+        printf("%8u  %-14s %10.1f %12.1f %12s\n", n, "random", ns, (double)random.steps / picks, "-");
+
+        // Image may not repeat until min(n, DIFF_RAND_IMG_N) images were picked
+        RandomPicker fresh(n);
+        std::vector<uint32_t> cycle(n, UINT32_MAX);
+        uint32_t window = std::min<uint32_t>(n, DIFF_RAND_IMG_N);
+        for (uint32_t i = 0; i < 10 * window; i++) {
+            uint16_t image = fresh.pick();
+            if ( (image >= n) || (cycle[image] == i / window) ) {
+                fprintf(stderr, "%u images: random picked %u twice in %u picks\n", n, image, window);
+                ok = false;
+                break;
+            }
+            cycle[image] = i / window;
+        }
+
+        // Every 10th image is favorite with weight 10, every 7th is excluded
+        std::vector<double> weights(n, 1.0);
+        double total = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (i % 10 == 0) { weights[i] = 10; }
+            if (i % 7 == 0) { weights[i] = 0; }
+            total += weights[i];
+        }
+
+        std::fill(counts.begin(), counts.end(), 0);
+        WeightedPicker weighted(weights);
+        ns = measure(weighted, picks, counts.data());
+        printf("%8u  %-14s %10.1f %12s %12.1f\n", n, "by weight", ns, "1", (double)weighted.bytes / picks);
+
+        // Share of picks of every weight class must match weights
+        double favorites = 0, excluded = 0, expected = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (weights[i] == 10) {
+                favorites += counts[i];
+                expected += weights[i] / total;
+            }
+            if (weights[i] == 0) { excluded += counts[i]; }
+        }
+
+        favorites /= picks;
+        if ( (excluded > 0) || (std::fabs(favorites - expected) > 0.01) ) {
+            fprintf(stderr, "%u images: favorites picked %.3f, expected %.3f, excluded picked %.0f times\n", n, favorites, expected, excluded);
+            ok = false;
+        }
+
+        std::fill(counts.begin(), counts.end(), 0);
+        LeastRecentPicker leastRecent(n);
+        ns = measure(leastRecent, picks, counts.data());
+        printf("%8u  %-14s %10.1f %12s %12.1f\n", n, "oldest first", ns, "1", (double)leastRecent.bytes / picks);
+
+        // Images displayed in other ways count too, pick must be image not displayed for longest time
+        LeastRecentPicker oldest(n);
+        std::vector<uint32_t> shown(n, 0);
+        for (uint32_t i = 1; i <= 1000; i++) {
+            uint16_t image;
+            if (i % 3 == 0) {
+                image = ::random(n);
+                oldest.markShown(image);
+            } else {
+                image = oldest.pick();
+                if (shown[image] != *std::min_element(shown.begin(), shown.end())) {
+                    fprintf(stderr, "%u images: oldest first picked %u shown at %u\n", n, image, shown[image]);
+                    ok = false;
+                    break;
+                }
+            }
+            shown[image] = i;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+/*
+pipebench.cpp
+
+PC benchmark comparing pixel pipeline (see src/Pipeline/Pipeline.h) with hand written
+loading loop it replaced. Both decode the same RLE16 image from memory into framebuffer,
+so difference is cost of pipeline abstraction.
+
+Build: g++ -O2 -std=c++11 -o pipebench pipebench.cpp
+Usage: pipebench [-n iterations] [input.bmp]
+Without input synthetic image with flat areas and gradients is used.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "ImageTools.h"
+#include "../src/Pipeline/Pipeline.h"
+
+#define WIDTH 320
+#define HEIGHT 480
+#define BUFFER 64
+
+typedef FramebufferSink<WIDTH, HEIGHT> Framebuffer;
+
+// Loading loop as it was written before pipeline, with the same source and sink
+static void handLoad(MemoryRLE16Source &source, Framebuffer &sink) {
+    uint16_t buffer[PORTION_BUFFER(BUFFER)];
+    sink.open(0, 0, WIDTH, HEIGHT);
+
+    for (uint32_t left = (uint32_t)WIDTH * HEIGHT; left > 0; ) {
+        uint16_t color;
+        uint16_t n = source.readSolidSpan(color, (left < SOLID_SPAN_MAX) ? left : SOLID_SPAN_MAX);
+
+        if (n) {
+            for (uint8_t i = 0; i < BUFFER; i++) { buffer[i] = color; }
+            for (uint16_t k = n; k > 0; ) {
+                uint16_t m = (k < BUFFER) ? k : BUFFER;
+                sink.write(buffer, m);
+                k -= m;
+            }
+        } else {
+            n = (left < BUFFER) ? left : BUFFER;
+            source.readImagePortion(buffer, n);
+            sink.write(buffer, n);
+        }
+
+        left -= n;
+    }
+}
+
+template <class Loader>
+static void pipelineLoad(Loader &loader) {
+    loader.open(0, 0, WIDTH, HEIGHT);
+    for (uint32_t left = (uint32_t)WIDTH * HEIGHT; left > 0; ) {
+        left -= loader.push(left);
+    }
+}
+
+static Image syntheticImage() {
+    Image image;
+    image.width = WIDTH;
+    image.height = HEIGHT;
+
+    // Flat background with gradient band and noisy patch
+    for (uint32_t y = 0; y < HEIGHT; y++) {
+        for (uint32_t x = 0; x < WIDTH; x++) {
+            uint16_t color = RGB24ToRGB16(30, 60, 90);
+            if ( (y > 160) && (y < 320) ) { color = RGB24ToRGB16(x * 255 / WIDTH, y - 160, 128); }
+            if ( (x > 200) && (y > 360) ) { color = rand(); }
+            image.pixels.push_back(color);
+        }
+    }
+
+    return image;
+}
+
+template <class F>
+static double measure(const char *name, uint32_t iterations, F load) {
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) { load(); }
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations / (WIDTH * HEIGHT);
+    printf("  %-22s %.3f ns/px\n", name, ns);
+    return ns;
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = 200;
+    if ( (argc > 2) && (strcmp(argv[1], "-n") == 0) ) {
+        iterations = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+
+    Image image;
+    if (argc > 1) {
+        if ( (!readBMP24(argv[1], image)) || (image.width != WIDTH) || (image.height != HEIGHT) ) {
+            fprintf(stderr, "%s: not a %ux%u 24 bit uncompressed bmp\n", argv[1], WIDTH, HEIGHT);
+            return 1;
+        }
+    } else {
+        image = syntheticImage();
+    }
+
+    std::vector<uint8_t> data;
+    uint32_t solid = encodeRLE16(image.pixels, data);
+    printf("image: %ux%u, %.1f%% solid span pixels, %u iterations\n", WIDTH, HEIGHT, 100.0 * solid / (WIDTH * HEIGHT), iterations);
+
+    MemoryRLE16Source source(data);
+    static Framebuffer hand;
+    static uint16_t buffer[PORTION_BUFFER(BUFFER)];
+    static Pipeline<MemoryRLE16Source, NoTransform, Framebuffer, BUFFER> plain(&source, Framebuffer(), buffer);
+    static Pipeline<MemoryRLE16Source, Chain<NoTransform, NoTransform>, Framebuffer, BUFFER> chained(&source, Framebuffer(), buffer);
+
+    double base = measure("hand written loop", iterations, [&]() { source.rewind(); handLoad(source, hand); });
+    double p1 = measure("pipeline", iterations, [&]() { source.rewind(); pipelineLoad(plain); });
+    double p2 = measure("pipeline, 2 transforms", iterations, [&]() { source.rewind(); pipelineLoad(chained); });
+    printf("  pipeline / hand written: %.2f, %.2f\n", p1 / base, p2 / base);
+
+    // Both loops must produce the same pixels
+    if ( (memcmp(hand.pixels, plain.getSink().pixels, sizeof(hand.pixels)) != 0)
+        || (memcmp(hand.pixels, image.pixels.data(), sizeof(hand.pixels)) != 0) )
+    {
+        fprintf(stderr, "pipeline output differs\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+playlist.cpp
+
+PC tool compiling text playlist into playlist file (see src/SDStorage/ImageFormat.h).
+Text playlist lists images in order they should be displayed, one image per line,
+as number or file name (for example "12" or "12.bmp"), lines starting with # are comments.
+Headers of listed images are stored in playlist, so frame opens them without reading header.
+Compile playlist again after its images are changed, changed images are still displayed, but opened slower.
+
+Build: g++ -O2 -std=c++11 -o playlist playlist.cpp
+Usage: playlist [-n name] <images directory> <list.txt> <playlist.bin>
+Name is shown on frame when choosing playlist, by default it is list file name.
+Put output into lists directory of sd card as 1.bin, 2.bin, ... (numbers without gaps).
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cstdio>
+#include <cstring>
+
+#include "ImageTools.h"
+
+int main(int argc, char **argv) {
+    std::string name;
+    if ( (argc > 2) && (strcmp(argv[1], "-n") == 0) ) {
+        name = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc != 4) {
+        fprintf(stderr, "Usage: playlist [-n name] <images directory> <list.txt> <playlist.bin>\n");
+        return 1;
+    }
+
+    if (name.empty()) {
+        name = argv[2];
+        name = name.substr(name.find_last_of('/') + 1);
+        name = name.substr(0, name.find_last_of('.'));
+    }
+
+    if (name.size() > PLAYLIST_NAME_LEN) {
+        fprintf(stderr, "name cut to %u characters\n", PLAYLIST_NAME_LEN);
+        name.resize(PLAYLIST_NAME_LEN);
+    }
+
+    FILE *list = fopen(argv[2], "r");
+    if (!list) {
+        fprintf(stderr, "%s: could not open\n", argv[2]);
+        return 1;
+    }
+
+    std::vector<uint8_t> entries;
+    uint32_t count = 0;
+    char line[256];
+
+    for (uint32_t lineN = 1; fgets(line, sizeof(line), list); lineN++) {
+        if ( (line[0] == '#') || (strspn(line, " \t\r\n") == strlen(line)) ) { continue; }
+
+        char *end;
+        unsigned long image = strtoul(line, &end, 10);
+        std::string path = std::string(argv[1]) + "/" + std::to_string(image) + ".bmp";
+
+        ImageHeader header;
+        if ( (end == line) || (image > UINT16_MAX) || (!readHeader(path.c_str(), header)) ) {
+            fprintf(stderr, "%s:%u: no valid image, skipped\n", argv[2], lineN);
+            continue;
+        }
+
+        put16(entries, image);
+        entries.push_back(header.format);
+        entries.push_back(header.flags);
+        put16(entries, header.dataOffset);
+        put32(entries, header.dataSize);
+        put32(entries, header.fileSize);
+        put16(entries, 0);
+        count++;
+    }
+
+    fclose(list);
+
+    if ( (count == 0) || (count > UINT16_MAX) ) {
+        fprintf(stderr, "%s: no images or too many images\n", argv[2]);
+        return 1;
+    }
+
+    std::vector<uint8_t> file;
+    put16(file, PLAYLIST_MAGIC);
+    put16(file, count);
+    file.insert(file.end(), name.begin(), name.end());
+    file.resize(PLAYLIST_HEADER_SIZE, 0);
+    file.insert(file.end(), entries.begin(), entries.end());
+
+    if (!writeFile(argv[3], file)) {
+        fprintf(stderr, "%s: could not write\n", argv[3]);
+        return 1;
+    }
+
+    printf("%s: %u images, %zu bytes\n", name.c_str(), count, file.size());
+    return 0;
+}
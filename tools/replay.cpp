@@ -0,0 +1,190 @@
+/*
+replay.cpp
+
+PC replay of trace recorded on device (see src/Trace/Trace.h).
+Frame sources are compiled with simulated hardware (see host/Host.h) and run with sd card directory
+on PC, random seed and touches of trace. Records of simulated frame are printed in the same format as on device,
+each followed by virtual time and work (sd card opens, read and written bytes, panel pixels) spent until next record
+and hash of screen at that moment. Records are compared with trace, first record which differs is reported.
+Output does not depend on PC speed, so outputs of two builds replaying the same trace can be compared with diff.
+Trace with only touch records (P) can be written by hand, output of replay is a complete trace again.
+Summary reports size of arena (see src/Arena/Arena.h) and peak stack and String heap of simulated frame.
+
+Build: g++ -O2 -std=gnu++11 -DTRACING -Ihost -o replay replay.cpp host/Host.cpp
+Usage: replay [-t ms] <sd card directory> <trace file>
+-t time to simulate [ms], by default until time of last record of trace and one more second
+Card directory is not changed, files written by frame are kept in memory.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "host/Host.h"
+
+// Frame firmware is compiled into tool, setup() and loop() are defined in main.cpp
+#include "../src/main.cpp"
+#include "../src/Arena/Arena.cpp"
+#include "../src/Calibration/Calibration.cpp"
+#include "../src/DigitalFrame/DigitalFrame.cpp"
+#include "../src/Energy/Energy.cpp"
+#include "../src/Overlay/Overlay.cpp"
+#include "../src/Profiler/Profiler.cpp"
+#include "../src/SDStorage/RawStream.cpp"
+#include "../src/SDStorage/SDStorage.cpp"
+#include "../src/SPIBus/SPIBus.cpp"
+#include "../src/Trace/Trace.cpp"
+#include "../src/Widget/Widget.cpp"
+
+#define LOOP_US 1000 // Virtual time of loop() without work
+#define TAIL_MS 1000 // Time simulated after last record of trace
+
+struct Record {
+    uint32_t ms;
+    char event;
+    uint32_t values[2];
+    uint8_t valuesN;
+};
+
+static std::vector<Record> trace; // Records of device
+static size_t next = 0; // Record of device compared with next record of simulated frame
+static bool diverged = false;
+static uint32_t records = 0;
+
+// Record of simulated frame waits for work done until next one
+static std::string pending;
+static uint64_t pendingStart = 0;
+static Host::Counters pendingCounters;
+
+static bool parseRecord(const char *line, Record &record) {
+    int n = sscanf(line, "T %u %c %u %u", &record.ms, &record.event, &record.values[0], &record.values[1]);
+    if (n < 3) { return false; }
+
+    record.valuesN = n - 2;
+    return true;
+}
+
+static bool sameRecord(const Record &a, const Record &b) {
+    if ( (a.event != b.event) || (a.valuesN != b.valuesN) ) { return false; }
+    for (uint8_t i = 0; i < a.valuesN; i++) {
+        if (a.values[i] != b.values[i]) { return false; }
+    }
+    return true;
+}
+
+static void flushPending() {
+    if (pending.empty()) { return; }
+
+    const Host::Counters &c = Host::counters, &p = pendingCounters;
+    printf("%s | ms: %llu | sd opens: %u | sd read: %u | sd written: %u | panel px: %u | screen: %08x\n", pending.c_str(),
+        (unsigned long long)((Host::clock() - pendingStart) / 1000000), c.sdOpens - p.sdOpens, c.sdReadBytes - p.sdReadBytes,
+        c.sdWrittenBytes - p.sdWrittenBytes, c.panelPixels - p.panelPixels, Host::screenHash());
+    pending.clear();
+}
+
+static void onSerialLine(const char *line) {
+    Record record;
+    if (!parseRecord(line, record)) {
+        // Profiler reports are passed through
+        printf("%s\n", line);
+        return;
+    }
+
+    flushPending();
+    records++;
+    pending = line;
+    pendingStart = Host::clock();
+    pendingCounters = Host::counters;
+
+    if (diverged) { return; }
+
+    if ( (next < trace.size()) && (sameRecord(record, trace[next])) ) {
+        pending += " | device ms: " + std::to_string(trace[next].ms);
+        next++;
+    } else if (next < trace.size()) {
+        diverged = true;
+        printf("Diverged from device at record %zu, expected: T %u %c", next + 1, trace[next].ms, trace[next].event);
+        for (uint8_t i = 0; i < trace[next].valuesN; i++) { printf(" %u", trace[next].values[i]); }
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    uint64_t endMs = 0;
+
+    if ( (argc > 2) && (strcmp(argv[1], "-t") == 0) ) {
+        endMs = strtoull(argv[2], nullptr, 10);
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: replay [-t ms] <sd card directory> <trace file>\n");
+        return 1;
+    }
+
+    if (!Host::mountCard(argv[1])) {
+        fprintf(stderr, "%s: not a directory\n", argv[1]);
+        return 1;
+    }
+
+    FILE *f = fopen(argv[2], "r");
+    if (!f) {
+        fprintf(stderr, "%s: could not open\n", argv[2]);
+        return 1;
+    }
+
+    // Other lines of serial output (profiler reports) are skipped
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        Record record;
+        if (!parseRecord(line, record)) { continue; }
+        trace.push_back(record);
+
+        if ( (record.event == 'S') && (record.valuesN == 1) ) { Host::setAnalog(record.values[0]); }
+        if ( (record.event == 'P') && (record.valuesN == 2) ) { Host::touchAt(record.ms, record.values[0], record.values[1]); }
+    }
+    fclose(f);
+
+    if (endMs == 0) { endMs = (trace.empty() ? 0 : trace.back().ms) + TAIL_MS; }
+
+    Host::serialLine = onSerialLine;
+    auto start = std::chrono::steady_clock::now();
+
+    Host::markStack();
+    setup();
+    while (Host::clock() / 1000000 < endMs) {
+        loop();
+        Host::advance((uint64_t)LOOP_US * 1000);
+    }
+
+    flushPending();
+
+#ifdef ENERGY_ACCOUNTING
+    // Estimate of whole simulated time, device reports it every ENERGY_REPORT_INTERVAL
+    Energy::report(Serial);
+#endif
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%u records, %zu of %zu device records matched%s, %u touches not used, %.1f s simulated in %.2f s\n",
+        records, next, trace.size(), diverged ? " (diverged)" : "", Host::touchesLeft(), Host::clock() / 1e9, seconds);
+    printf("arena: %u B (stream %u, path %u, text %u, buckets %u), peak stack: %u B, peak String heap: %u B (sizes of PC build)\n",
+        Arena::size(), Arena::size(Arena::STREAM), Arena::size(Arena::PATH), Arena::size(Arena::TEXT), Arena::size(Arena::BUCKETS),
+        Host::stackPeak(), Host::heapPeak());
+    return ( (diverged) || (next < trace.size()) ) ? 2 : 0;
+}
@@ -0,0 +1,37 @@
+/*
+sizeprobe.cpp
+
+Object file with image loader compiled for two panels: one used by frame (PANEL_WIDTH x PANEL_HEIGHT)
+and 240x320 one, so sizereport.sh can compare instantiations without avr toolchain or second firmware.
+Both are compiled with the same interrupt type, frame passes lambda instead.
+
+Build: g++ -Os -std=gnu++11 -Ihost -c -o sizeprobe.o sizeprobe.cpp
+Usage: NM=nm SIZE=size sizereport.sh sizeprobe.o
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include "host/Host.h"
+#include "../src/DigitalFrame/DigitalFrame.h"
+
+typedef bool (*Interrupt)();
+typedef ImageLoader<SDStorage, Overlay, PanelSink<ILI9486>, 240, 320, IMG_BUFFER> SmallLoader;
+
+template class ImageLoader<SDStorage, Overlay, PanelSink<ILI9486>, PANEL_WIDTH, PANEL_HEIGHT, IMG_BUFFER>;
+template bool FrameLoader::loadSequential<Interrupt>(Interrupt);
+template bool FrameLoader::loadProgressive<Interrupt>(Interrupt, bool);
+
+template class ImageLoader<SDStorage, Overlay, PanelSink<ILI9486>, 240, 320, IMG_BUFFER>;
+template bool SmallLoader::loadSequential<Interrupt>(Interrupt);
+template bool SmallLoader::loadProgressive<Interrupt>(Interrupt, bool);
@@ -0,0 +1,52 @@
+#!/bin/sh
+# sizereport.sh
+#
+# Prints flash and RAM used by every ImageLoader and Pipeline instantiation in firmware elf,
+# followed by totals of whole firmware. Loader members live inside DigitalFrame object on heap,
+# so RAM column shows only static data of instantiation.
+# Elf is left in build directory, for example: arduino-cli compile --output-dir build
+# NM and SIZE select other tools, for example NM=nm SIZE=size for PC object built from sizeprobe.cpp.
+#
+# Usage: sizereport.sh <firmware.elf>
+#
+# Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see https://www.gnu.org/licenses/.
+
+if [ $# -ne 1 ]; then
+    echo "Usage: sizereport.sh <firmware.elf>" >&2
+    exit 1
+fi
+
+NM=${NM:-avr-nm}
+SIZE=${SIZE:-avr-size -C --mcu=atmega328p}
+
+# Symbol lines are: address size type name, text symbols are in flash, data and bss in RAM
+$NM -C -S "$1" | awk '
+function hex(s,    i, n) {
+    n = 0
+    s = tolower(s)
+    for (i = 1; i <= length(s); i++) { n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1 }
+    return n
+}
+NF >= 4 && match($0, /(ImageLoader|Pipeline)<.*>::/) {
+    name = substr($0, RSTART, RLENGTH - 2)
+    type = tolower($3)
+    if (type == "t" || type == "w") { flash[name] += hex($2) }
+    if (type == "d" || type == "b") { ram[name] += hex($2) }
+    seen[name] = 1
+}
+END {
+    for (name in seen) { printf "%-80s flash %6d B  ram %5d B\n", name, flash[name], ram[name] }
+}'
+
+$SIZE "$1"
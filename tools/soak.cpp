@@ -0,0 +1,316 @@
+/*
+soak.cpp
+
+Long run of frame firmware on simulated hardware (see host/Host.h), checks that frame does not degrade
+over months of image switches and that its timers keep working when millis() overflows (every 49.7 days).
+Virtual clock starts shortly before overflow and passes of loop() without work are accelerated, so million
+image switches (about two months of frame time at shortest display time) take about 20 minutes on PC.
+Touches are scripted: display time is set to shortest level at start, then every period turn off is scheduled
+from menu, frame goes to sleep and it is woken up by touch.
+Run fails (exit code 2) if any of checks fails:
+- image is switched after display time, not earlier and not later than LATE_MS,
+- scheduled turn off comes on time,
+- average switch time of last DRIFT_WINDOW switches is not longer than of first ones by more than DRIFT_PERCENT,
+- peak stack and high water marks of arena regions (see src/Arena/Arena.h) do not grow after first DRIFT_WINDOW switches.
+Frame code allocates no heap, its buffers are arena regions and stack, so their high water marks are what can grow
+(SD library on device allocates object of every open File, simulated library does not).
+Switches started by touch are not checked.
+
+Build: g++ -O2 -std=gnu++11 -DTRACING -Ihost -o soak soak.cpp host/Host.cpp
+Usage: soak [-n switches] [-w ms] [-i ms] [-p ms] <sd card directory>
+-n image switches to simulate, 1000000 by default
+-w time from start to millis() overflow [ms], 120000 by default
+-i virtual time of loop() pass [ms], 10 by default (device needs microseconds, timers are late by up to this time)
+-p period of scripted turn off [ms], 3600000 by default
+Card directory is not changed, files written by frame are kept in memory.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "host/Host.h"
+
+// Frame firmware is compiled into tool, setup() and loop() are defined in main.cpp
+#include "../src/main.cpp"
+#include "../src/Arena/Arena.cpp"
+#include "../src/Calibration/Calibration.cpp"
+#include "../src/DigitalFrame/DigitalFrame.cpp"
+#include "../src/Energy/Energy.cpp"
+#include "../src/Overlay/Overlay.cpp"
+#include "../src/Profiler/Profiler.cpp"
+#include "../src/SDStorage/RawStream.cpp"
+#include "../src/SDStorage/SDStorage.cpp"
+#include "../src/SPIBus/SPIBus.cpp"
+#include "../src/Trace/Trace.cpp"
+#include "../src/Widget/Widget.cpp"
+
+#define SCRIPT_START_MS 10000 // Time of first scripted touch, intro is replaced by image before
+#define TAP_INTERVAL_MS 1000 // Time between scripted touches, loading of menu screens fits into it
+#define SETUP_MS 30000 // Time from first touch of script setting display time to first turn off
+#define WAKE_AFTER_MS 30000 // Frame is woken up this time after scheduled turn off
+#define LATE_MS 3000 // Allowed delay of timers besides loop() pass, covers image loaded when deadline passes
+#define DRIFT_WINDOW 1000 // Switches compared at start and end of run
+#define DRIFT_PERCENT 10
+#define STALL_MS 3600000 // Run stops if no image is switched for this time
+#define ARENA_PAINT 0xA5 // Arena regions are filled with this before setup(), bytes still holding it were never written
+
+#define SWITCH_TIME dispTimeLvls[0] // Display time set by script
+#define TURN_OFF_TIME turnOffTimes[1] // Turn off time set by script
+
+static uint64_t idleNs = 10000000; // Virtual time of loop() pass
+static uint64_t clockMs() { return Host::clock() / 1000000; }
+
+// Tap on screen coordinates, converted into raw touch controller coordinates of main.cpp calibration (with swapped axes)
+static void tapAt(uint64_t ms, int32_t x, int32_t y) {
+    Host::touchAt((uint32_t)ms, Y_BEGIN + y * (Y_END - Y_BEGIN) / (PANEL_HEIGHT - 1), X_BEGIN + x * (X_END - X_BEGIN) / (PANEL_WIDTH - 1));
+}
+
+// Centers of touch zones of DigitalFrame.cpp used by script
+#define TAP_IMAGE_MENU 160, 240
+#define TAP_MENU_DISP_TIME 160, 336
+#define TAP_MENU_TURN_OFF 160, 144
+#define TAP_MENU_BACK 240, 48
+#define TAP_LEVEL_UP 160, 420
+#define TAP_LEVEL_DOWN 160, 180
+#define TAP_LEVEL_BACK 160, 60
+#define TAP_TURN_OFF_CONFIRM 240, 60
+
+// Shortest display time is chosen, so images are switched as often as possible
+static void queueSetup(uint64_t ms) {
+    tapAt(ms, TAP_IMAGE_MENU);
+    tapAt(ms += TAP_INTERVAL_MS, TAP_MENU_DISP_TIME);
+    for (uint8_t i = 0; i < DISP_TIME_LEVEL_N; i++) { tapAt(ms += TAP_INTERVAL_MS, TAP_LEVEL_DOWN); }
+    tapAt(ms += TAP_INTERVAL_MS, TAP_LEVEL_BACK);
+    tapAt(ms += TAP_INTERVAL_MS, TAP_MENU_BACK);
+}
+
+// Turn off is scheduled at first level and frame is woken up after it went to sleep
+static void queueTurnOff(uint64_t ms) {
+    tapAt(ms, TAP_IMAGE_MENU);
+    tapAt(ms += TAP_INTERVAL_MS, TAP_MENU_TURN_OFF);
+    tapAt(ms += TAP_INTERVAL_MS, TAP_LEVEL_UP);
+    tapAt(ms += TAP_INTERVAL_MS, TAP_TURN_OFF_CONFIRM);
+    tapAt(ms += TAP_INTERVAL_MS, TAP_MENU_BACK);
+    tapAt(ms + TURN_OFF_TIME + WAKE_AFTER_MS, TAP_IMAGE_MENU);
+}
+
+// Regions with high water mark, bits of buckets are cleared as whole, so it is not painted
+static const Arena::Region painted[] = {Arena::STREAM, Arena::PATH, Arena::TEXT};
+static const char *paintedNames[] = {"stream", "path", "text"};
+#define PAINTED_N (sizeof(painted) / sizeof(painted[0]))
+
+static uint8_t *regionData(Arena::Region region) {
+    switch (region) {
+        case Arena::STREAM: return (uint8_t*)Arena::stream();
+        case Arena::PATH: return (uint8_t*)Arena::path();
+        case Arena::TEXT: return (uint8_t*)Arena::text();
+        default: return Arena::buckets();
+    }
+}
+
+static void paintArena() {
+    for (Arena::Region region : painted) { memset(regionData(region), ARENA_PAINT, Arena::size(region)); }
+}
+
+// Bytes from start of region to its last written byte
+static uint16_t highWater(Arena::Region region) {
+    const uint8_t *data = regionData(region);
+    uint16_t size = Arena::size(region);
+    while ( (size > 0) && (data[size - 1] == ARENA_PAINT) ) { size--; }
+    return size;
+}
+
+// Records of simulated frame, images and states are followed
+static uint8_t state = DigitalFrame::IMAGE_DISPLAY;
+static bool touchedSinceLoad = false; // Switch was not started by display time
+static bool checking = false; // Display time was set by script
+static uint64_t switchAt = 0; // Image record of current loop() pass [ns], 0 if none
+static uint64_t loadedAt = 0; // End of loop() pass which loaded last image [ms]
+static uint64_t confirmAt = 0; // Turn off was scheduled [ns], 0 if frame is not waiting for it
+static uint32_t switches = 0, early = 0, late = 0, turnOffs = 0, turnOffsOnTime = 0;
+
+static void onSerialLine(const char *line) {
+    uint32_t ms, value;
+    char event;
+    if (sscanf(line, "T %u %c %u", &ms, &event, &value) != 3) { return; }
+
+    switch (event) {
+        case Trace::TOUCH:
+            touchedSinceLoad = true;
+            break;
+
+        case Trace::IMAGE:
+            switches++;
+            switchAt = Host::clock();
+            if ( (checking) && (loadedAt) && (!touchedSinceLoad) ) {
+                // millis() of load end is truncated, so switch can come up to 1 ms before full display time
+                uint64_t shown = clockMs() - loadedAt;
+                if (shown + 1 < SWITCH_TIME) { early++; }
+                if (shown > SWITCH_TIME + idleNs / 1000000 + LATE_MS) { late++; }
+            }
+            break;
+
+        case Trace::STATE:
+            if ( (value == DigitalFrame::MENU_DISPLAY) && (state == DigitalFrame::SET_TURN_OFF) ) { confirmAt = Host::clock(); }
+
+            // As with switches, millis() of confirmation is truncated
+            if (value == DigitalFrame::SLEEP) {
+                turnOffs++;
+                uint64_t waited = confirmAt ? (Host::clock() - confirmAt) / 1000000 : 0;
+                if ( (confirmAt) && (waited + 1 >= TURN_OFF_TIME) && (waited <= TURN_OFF_TIME + idleNs / 1000000 + LATE_MS) ) { turnOffsOnTime++; }
+                confirmAt = 0;
+            }
+
+            state = value;
+            break;
+
+        default:
+            break;
+    }
+}
+
+static double average(const std::vector<uint32_t> &values, size_t from, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = from; i < from + n; i++) { sum += values[i]; }
+    return n ? (double)sum / n : 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t switchesN = 1000000;
+    uint64_t toOverflowMs = 120000;
+    uint64_t periodMs = 3600000;
+
+    while ( (argc > 3) && (argv[1][0] == '-') ) {
+        uint64_t value = strtoull(argv[2], nullptr, 10);
+        switch (argv[1][1]) {
+            case 'n': switchesN = value; break;
+            case 'w': toOverflowMs = value; break;
+            case 'i': idleNs = value * 1000000; break;
+            case 'p': periodMs = value; break;
+            default: argc = 0; break;
+        }
+        argv += 2;
+        argc -= 2;
+    }
+
+    if ( (argc != 2) || (periodMs < TURN_OFF_TIME + WAKE_AFTER_MS + 10 * TAP_INTERVAL_MS) ) {
+        fprintf(stderr, "Usage: soak [-n switches] [-w ms] [-i ms] [-p ms] <sd card directory>\n");
+        fprintf(stderr, "Period must be longer than turn off time and wake up (%u ms)\n", TURN_OFF_TIME + WAKE_AFTER_MS + 10 * TAP_INTERVAL_MS);
+        return 1;
+    }
+
+    if (!Host::mountCard(argv[1])) {
+        fprintf(stderr, "%s: not a directory\n", argv[1]);
+        return 1;
+    }
+
+    // Virtual clock starts before overflow of 32 bit millis()
+    uint64_t overflowMs = (uint64_t)1 << 32;
+    uint64_t startMs = overflowMs - std::min(toOverflowMs, overflowMs);
+    Host::advance(startMs * 1000000);
+    Host::serialLine = onSerialLine;
+    auto start = std::chrono::steady_clock::now();
+
+    Host::markStack();
+    paintArena();
+    setup();
+
+    // First turn off is scheduled right after setup, so it passes overflow with default -w
+    queueSetup(startMs + SCRIPT_START_MS);
+    uint64_t nextTurnOff = startMs + SCRIPT_START_MS + SETUP_MS;
+
+    std::vector<uint32_t> switchMs; // Virtual time of switches not interrupted by touch
+    uint32_t missedTurnOffs = 0, overflows = 0, lastMillis = millis();
+    uint32_t stackWindow = 0;
+    uint16_t arenaWindow[PAINTED_N] = {};
+    uint64_t lastSwitchMs = clockMs();
+    bool stalled = false;
+
+    while (switches < switchesN) {
+        switchAt = 0;
+        loop();
+
+        if (switchAt) {
+            lastSwitchMs = clockMs();
+            if (!touchedSinceLoad) { switchMs.push_back((Host::clock() - switchAt) / 1000000); }
+            if (switchMs.size() == DRIFT_WINDOW) {
+                stackWindow = Host::stackPeak();
+                for (size_t i = 0; i < PAINTED_N; i++) { arenaWindow[i] = highWater(painted[i]); }
+            }
+
+            loadedAt = clockMs();
+            touchedSinceLoad = false;
+            if (switches % 100000 == 0) { printf("%u switches, %.1f days\n", switches, (clockMs() - startMs) / 86400000.0); }
+        }
+
+        // Checks start after script of setup was used
+        if ( (!checking) && (Host::touchesLeft() == 0) && (clockMs() > startMs + SCRIPT_START_MS) ) { checking = true; }
+
+        if ( (clockMs() >= nextTurnOff) && (Host::touchesLeft() == 0) ) {
+            if (confirmAt) { missedTurnOffs++; }
+            confirmAt = 0;
+            queueTurnOff(nextTurnOff);
+            nextTurnOff += periodMs;
+        }
+
+        if (clockMs() - lastSwitchMs > STALL_MS) {
+            stalled = true;
+            break;
+        }
+
+        Host::advance(idleNs);
+        if (millis() < lastMillis) { overflows++; }
+        lastMillis = millis();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t window = std::min<size_t>(DRIFT_WINDOW, switchMs.size() / 2);
+    double first = average(switchMs, 0, window), last = average(switchMs, switchMs.size() - window, window);
+    double drift = first ? (last - first) * 100 / first : 0;
+
+    printf("%u switches in %.1f days of frame time, millis() overflowed %u times, %.2f s on PC\n",
+        switches, (clockMs() - startMs) / 86400000.0, overflows, seconds);
+    printf("switch ms: first %zu average %.1f, last %zu average %.1f, drift %+.1f %%, max %u\n",
+        window, first, window, last, drift, switchMs.empty() ? 0 : *std::max_element(switchMs.begin(), switchMs.end()));
+    printf("early switches: %u, late switches: %u, turn offs on time: %u of %u, missed: %u\n",
+        early, late, turnOffsOnTime, turnOffs, missedTurnOffs);
+    // Values after first DRIFT_WINDOW switches are in parentheses
+    bool arenaGrows = false;
+    printf("peak stack: %u B (%u B, PC build), arena high water:", Host::stackPeak(), stackWindow);
+    for (size_t i = 0; i < PAINTED_N; i++) {
+        uint16_t mark = highWater(painted[i]);
+        if (mark > arenaWindow[i]) { arenaGrows = true; }
+        printf(" %s %u of %u B (%u B)", paintedNames[i], mark, Arena::size(painted[i]), arenaWindow[i]);
+    }
+    printf("\n");
+
+    bool failed = false;
+    auto check = [&failed](bool ok, const char *what) {
+        if (ok) { return; }
+        printf("FAILED: %s\n", what);
+        failed = true;
+    };
+
+    check(!stalled, "no image switched for STALL_MS");
+    check( (early == 0) && (late == 0), "image switched out of display time");
+    check( (turnOffsOnTime == turnOffs) && (missedTurnOffs == 0), "turn off out of time");
+    check(drift <= DRIFT_PERCENT, "switch time drift");
+    check( (window < DRIFT_WINDOW) || ( (!arenaGrows) && (Host::stackPeak() <= stackWindow) ), "stack or arena high water grows");
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,158 @@
+/*
+streambench.cpp
+
+PC benchmark of image reads through SDStorage on simulated sd card (see host/Host.h).
+Every image of the same card directory is read in five ways: with SD library only, streamed by RawStream
+from contiguous files, from card with fragmented files (RawStream refuses them and SD library reads them),
+streamed with read error every RAW_ERROR_INTERVAL blocks (reading continues with SD library) and the same
+after image was opened again from its ImageInfo, without file of SD library.
+Two more ways read 24 bit images from their copies in cache (see SDStorage::cacheStep) on contiguous and on
+fragmented card: every image is read, copied and then opened and read again, copies are keyed by stamps from
+directory entries, which fragmented files have too.
+For every way virtual time of opening and reading, bytes read by SD library and streamed by multi block reads
+are printed per image, with number of images read from cache and images whose pixels differ from SD library reads.
+
+Build: g++ -O2 -std=gnu++11 -Ihost -o streambench streambench.cpp host/Host.cpp
+Usage: streambench <sd card directory>
+Images are read from images directory (or index), card directory is not changed.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cstdio>
+#include <vector>
+
+#include "host/Host.h"
+
+// Storage sources are compiled into tool
+#include "../src/Arena/Arena.cpp"
+#include "../src/Energy/Energy.cpp"
+#include "../src/Profiler/Profiler.cpp"
+#include "../src/SDStorage/RawStream.cpp"
+#include "../src/SDStorage/SDStorage.cpp"
+#include "../src/SPIBus/SPIBus.cpp"
+
+#define WIDTH 320
+#define HEIGHT 480
+#define IMAGE_DIR "images"
+#define SD_CS 5
+#define RAW_ERROR_INTERVAL 300 // Blocks, 24 bit image has 900
+
+struct Way {
+    const char *name;
+    bool rawAccess;
+    bool fragmented;
+    uint32_t errorInterval;
+    bool reopen; // Image is opened again from its ImageInfo
+    bool cache; // Image is read and copied into cache before it is opened and read
+};
+
+static const Way ways[] = {
+    {"sd library", false, false, 0, false, false},
+    {"raw stream", true, false, 0, false, false},
+    {"fragmented", true, true, 0, false, false},
+    {"raw errors", true, false, RAW_ERROR_INTERVAL, false, false},
+    {"reopened with errors", true, false, RAW_ERROR_INTERVAL, true, false},
+    {"cache", true, false, 0, false, true},
+    {"cache, fragmented", true, true, 0, false, true}
+};
+
+static uint16_t buffer[PORTION_BUFFER(WIDTH)];
+
+static uint32_t fnv(uint32_t hash, const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; i++) { hash = (hash ^ p[i]) * 16777619u; }
+    return hash;
+}
+
+// Whole first frame is read row by row, interlaced rows in file order
+static uint32_t readImage(SDStorage &storage) {
+    uint32_t hash = 2166136261u;
+    for (uint16_t row = 0; row < HEIGHT; row++) {
+        storage.readImagePortion(buffer, WIDTH);
+        hash = fnv(hash, buffer, WIDTH * 2);
+    }
+    return hash;
+}
+
+// Copy is written in steps until cacheStep() has no work, which takes no time
+static void copyImage(SDStorage &storage) {
+    uint64_t t;
+    do {
+        t = Host::clock();
+        storage.cacheStep();
+    } while (Host::clock() != t);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: streambench <sd card directory>\n");
+        return 1;
+    }
+
+    std::vector<uint32_t> reference; // Pixel hashes of SD library reads
+
+    for (const Way &way : ways) {
+        Host::setRawAccess(way.rawAccess);
+        Host::setRawErrorInterval(way.errorInterval);
+        if (!Host::mountCard(argv[1], way.fragmented)) {
+            fprintf(stderr, "%s: not a directory\n", argv[1]);
+            return 1;
+        }
+
+        SDStorage storage(SD_CS, WIDTH, HEIGHT, IMAGE_DIR);
+        uint32_t images = storage.imagesInDir();
+        if ( (storage.error()) || (images == 0) ) {
+            fprintf(stderr, "%s: no images\n", argv[1]);
+            return 1;
+        }
+
+        uint64_t openNs = 0, readNs = 0;
+        uint32_t differ = 0, failed = 0, cached = 0;
+        Host::Counters read = {}; // Bytes of measured opens and reads, copying is not counted
+
+        for (uint32_t id = 0; id < images; id++) {
+            if ( (way.cache) && (storage.toImage(id)) ) {
+                readImage(storage);
+                copyImage(storage);
+            }
+
+            Host::Counters start = Host::counters;
+            uint64_t t = Host::clock();
+            bool opened = storage.toImage(id);
+            if ( (opened) && (way.reopen) ) { opened = storage.toImage(storage.getImageInfo()); }
+            openNs += Host::clock() - t;
+
+            t = Host::clock();
+            uint32_t hash = opened ? readImage(storage) : 0;
+            readNs += Host::clock() - t;
+            read.sdReadBytes += Host::counters.sdReadBytes - start.sdReadBytes;
+            read.sdRawBytes += Host::counters.sdRawBytes - start.sdRawBytes;
+
+            if ( (!opened) || (storage.error()) ) { failed++; }
+            if (storage.isCached()) { cached++; }
+            if (reference.size() < images) {
+                reference.push_back(hash);
+            } else if (reference[id] != hash) {
+                differ++;
+            }
+        }
+
+        printf("%s: %u images | ms per image: open %.1f, read %.1f | KB per image: sd library %.1f, streamed %.1f | cached: %u | differ: %u | failed: %u\n",
+            way.name, images, openNs / 1e6 / images, readNs / 1e6 / images, read.sdReadBytes / 1024.0 / images,
+            read.sdRawBytes / 1024.0 / images, cached, differ, failed);
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+thumbs.cpp
+
+PC tool generating thumbnails file for gallery (see src/SDStorage/ImageFormat.h).
+Images are read from images directory of sd card (0.bmp, 1.bmp, ...) in any format
+understood by frame and scaled down into THUMB_WIDTH x THUMB_HEIGHT thumbnails.
+Missing or invalid images get black thumbnails, so thumbnail offsets stay fixed.
+Generate thumbnails again after images are added or changed.
+
+Build: g++ -O2 -std=c++11 -o thumbs thumbs.cpp
+Usage: thumbs <images directory> <thumbs.bin>
+Put output into root directory of sd card.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cstdio>
+#include <string>
+
+#include "ImageTools.h"
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: thumbs <images directory> <thumbs.bin>\n");
+        return 1;
+    }
+
+    // Thumbnails are needed up to highest image number
+    int32_t count = countImages(argv[1]);
+    if (count < 0) {
+        fprintf(stderr, "%s: could not open directory\n", argv[1]);
+        return 1;
+    }
+
+    if (count > UINT16_MAX) {
+        fprintf(stderr, "%s: too many images\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<uint8_t> file;
+    put16(file, THUMBS_MAGIC);
+    put16(file, THUMB_WIDTH);
+    put16(file, THUMB_HEIGHT);
+    put16(file, count);
+
+    uint32_t missing = 0;
+    for (int32_t i = 0; i < count; i++) {
+        std::string path = std::string(argv[1]) + "/" + std::to_string(i) + ".bmp";
+
+        Image image;
+        if ( (readImage(path.c_str(), image)) && (image.width >= THUMB_WIDTH) && (image.height >= THUMB_HEIGHT) ) {
+            putThumbnail(file, image);
+        } else {
+            file.resize(file.size() + THUMB_SIZE, 0);
+            missing++;
+        }
+    }
+
+    if (!writeFile(argv[2], file)) {
+        fprintf(stderr, "%s: could not write\n", argv[2]);
+        return 1;
+    }
+
+    printf("%d thumbnails (%u missing), %zu bytes\n", count, missing, file.size());
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+weights.cpp
+
+PC tool generating weights file for "By weight" display order (see src/SDStorage/ImageFormat.h).
+Weights are read from text file, each line holds image number and its weight, for example "3 5"
+makes image 3.bmp five times more likely than images not listed (they have weight 1).
+Weight 0 excludes image, lines starting with # are comments.
+Frame picks image with two reads from weights file, regardless of number of images.
+Generate weights file again after images are added or removed, outdated file is ignored.
+
+Build: g++ -O2 -std=c++11 -o weights weights.cpp
+Usage: weights <images directory> <weights.txt> <weights.bin>
+Put output into root directory of sd card.
+
+Copyright (C) 2024 Mateusz Bogusławski, E: mateusz.boguslawski@ibnet.pl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see https://www.gnu.org/licenses/.
+*/
+
+#include <cstdio>
+
+#include "ImageTools.h"
+
+static bool readWeights(const char *path, std::vector<double> &weights) {
+    FILE *f = fopen(path, "r");
+    if (!f) { return false; }
+
+    char line[256];
+    for (uint32_t lineN = 1; fgets(line, sizeof(line), f); lineN++) {
+        if ( (line[0] == '#') || (strspn(line, " \t\r\n") == strlen(line)) ) { continue; }
+
+        unsigned long image;
+        double weight;
+        if ( (sscanf(line, "%lu %lf", &image, &weight) != 2) || (weight < 0) ) {
+            fprintf(stderr, "%s:%u: expected image number and weight\n", path, lineN);
+            fclose(f);
+            return false;
+        }
+
+        if (image >= weights.size()) {
+            fprintf(stderr, "%s:%u: no image %lu.bmp, ignored\n", path, lineN, image);
+            continue;
+        }
+
+        weights[image] = weight;
+    }
+
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: weights <images directory> <weights.txt> <weights.bin>\n");
+        return 1;
+    }
+
+    int32_t count = countImages(argv[1]);
+    if (count < 0) {
+        fprintf(stderr, "%s: could not open directory\n", argv[1]);
+        return 1;
+    }
+
+    if ( (count == 0) || (count > UINT16_MAX) ) {
+        fprintf(stderr, "%s: no images or too many images\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<double> weights(count, 1.0);
+    if (!readWeights(argv[2], weights)) { return 1; }
+
+    double total = 0, top = 0;
+    for (double w : weights) {
+        total += w;
+        top = std::max(top, w);
+    }
+
+    if (total <= 0) {
+        fprintf(stderr, "%s: all weights are 0\n", argv[2]);
+        return 1;
+    }
+
+    std::vector<uint16_t> threshold, alias;
+    buildAliasTable(weights, threshold, alias);
+
+    std::vector<uint8_t> file;
+    put16(file, WEIGHTS_MAGIC);
+    put16(file, count);
+    for (int32_t i = 0; i < count; i++) {
+        put16(file, threshold[i]);
+        put16(file, alias[i]);
+    }
+
+    if (!writeFile(argv[3], file)) {
+        fprintf(stderr, "%s: could not write\n", argv[3]);
+        return 1;
+    }
+
+    printf("%d images, most likely shown with %.2f%% probability, %zu bytes\n", count, 100.0 * top / total, file.size());
+    return 0;
+}